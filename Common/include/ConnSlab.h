@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <sys/resource.h>
+
+/**
+ * 以 fd 为下标存放连接对象的分块数组，每个槽位带一个代数，绑定与解绑时加一。
+ * 注册进事件循环时带上「代数 << 32 | fd」的句柄（epoll 的 data.u64 / io_uring 的 user_data），事件到达后按下标直接取槽位并比对代数：
+ * fd 关闭或被新连接复用之后，旧句柄的事件会被拒绝。
+ * 代数只用低 30 位，句柄最高两位留给 io_uring 后端标记请求类型。
+ * 内核总是分配最小的空闲 fd，下标天然稠密；分块按需分配、分配后不再移动，查找不哈希也没有全局锁，
+ * 只在读写单个槽位时短暂自旋，同一连接的事件同时落到两个线程时才会相互等待。
+ */
+template <typename T>
+class ConnSlab {
+public:
+    static constexpr size_t CHUNK_SIZE = 1024;
+    static constexpr uint32_t GEN_MASK = (1u << 30) - 1;
+
+    ConnSlab() {
+        rlimit lim{};
+        size_t max_fds = DEFAULT_FDS;
+        if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur != RLIM_INFINITY) {
+            max_fds = static_cast<size_t>(lim.rlim_cur);
+        }
+        _chunk_count = (max_fds + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        _chunks = std::make_unique<std::atomic<Slot*>[]>(_chunk_count);
+    }
+
+    ~ConnSlab() {
+        for (size_t i = 0; i < _chunk_count; ++i) delete[] _chunks[i].load();
+    }
+
+    ConnSlab(const ConnSlab&) = delete;
+    ConnSlab& operator=(const ConnSlab&) = delete;
+
+    static int fd_of(uint64_t handle) { return static_cast<int>(handle & 0xffffffffu); }
+
+    // 把 fd 绑定到 value，返回新句柄，此前发出的句柄随之失效；fd 超出 RLIMIT_NOFILE 时返回 0
+    uint64_t bind(int fd, T value) {
+        Slot* s = slot(fd, true);
+        if (!s) return 0;
+        lock(s);
+        std::swap(s->value, value);
+        uint32_t gen = next_gen(s);
+        unlock(s);
+        return make(fd, gen);  // 旧值在锁外析构
+    }
+
+    // 解绑并取出原值，此前发出的句柄随之失效
+    T unbind(int fd) {
+        T old{};
+        Slot* s = slot(fd, false);
+        if (!s) return old;
+        lock(s);
+        std::swap(s->value, old);
+        next_gen(s);
+        unlock(s);
+        return old;
+    }
+
+    // 同上，但只在句柄仍有效时解绑：fd 可能已被关闭并被新连接复用时，由持有句柄的一方调用
+    T unbind(uint64_t handle) {
+        T old{};
+        uint32_t gen = static_cast<uint32_t>(handle >> 32);
+        Slot* s = gen != 0 ? slot(fd_of(handle), false) : nullptr;
+        if (!s) return old;
+        lock(s);
+        if (s->gen.load(std::memory_order_relaxed) == gen) {
+            std::swap(s->value, old);
+            next_gen(s);
+        }
+        unlock(s);
+        return old;
+    }
+
+    // 句柄仍有效时返回绑定的值，否则返回空值
+    T get(uint64_t handle) {
+        uint32_t gen = static_cast<uint32_t>(handle >> 32);
+        Slot* s = gen != 0 ? slot(fd_of(handle), false) : nullptr;
+        if (!s) return T{};
+        lock(s);
+        T value = s->gen.load(std::memory_order_relaxed) == gen ? s->value : T{};
+        unlock(s);
+        return value;
+    }
+
+    // fd 当前的句柄，注册进事件循环时使用；只由持有该连接的线程调用
+    uint64_t handle(int fd) {
+        Slot* s = slot(fd, false);
+        return s ? make(fd, s->gen.load(std::memory_order_relaxed)) : 0;
+    }
+
+    // 解绑全部槽位
+    void clear() {
+        for (size_t i = 0; i < _chunk_count; ++i) {
+            Slot* slots = _chunks[i].load(std::memory_order_acquire);
+            if (!slots) continue;
+            for (size_t j = 0; j < CHUNK_SIZE; ++j) unbind(static_cast<int>(i * CHUNK_SIZE + j));
+        }
+    }
+
+private:
+    static constexpr size_t DEFAULT_FDS = 1 << 20;  // RLIMIT_NOFILE 不限或取不到时
+
+    struct Slot {
+        std::atomic_flag busy;
+        std::atomic<uint32_t> gen{0};  // 0 留给监听 socket 等不在表中的 fd
+        T value{};
+    };
+
+    static uint64_t make(int fd, uint32_t gen) {
+        return static_cast<uint64_t>(gen) << 32 | static_cast<uint32_t>(fd);
+    }
+
+    static uint32_t next_gen(Slot* s) {
+        uint32_t gen = (s->gen.load(std::memory_order_relaxed) + 1) & GEN_MASK;
+        if (gen == 0) gen = 1;
+        s->gen.store(gen, std::memory_order_relaxed);
+        return gen;
+    }
+
+    // 临界区只有几条指令，自旋等待即可
+    static void lock(Slot* s) {
+        while (s->busy.test_and_set(std::memory_order_acquire)) {
+            while (s->busy.test(std::memory_order_relaxed)) std::this_thread::yield();
+        }
+    }
+
+    static void unlock(Slot* s) {
+        s->busy.clear(std::memory_order_release);
+    }
+
+    Slot* slot(int fd, bool create) {
+        if (fd < 0 || static_cast<size_t>(fd) >= _chunk_count * CHUNK_SIZE) return nullptr;
+        std::atomic<Slot*>& chunk = _chunks[fd / CHUNK_SIZE];
+        Slot* slots = chunk.load(std::memory_order_acquire);
+        if (!slots && create) {
+            std::lock_guard<std::mutex> lock(_grow_mutex);
+            slots = chunk.load(std::memory_order_acquire);
+            if (!slots) {
+                slots = new Slot[CHUNK_SIZE];
+                chunk.store(slots, std::memory_order_release);
+            }
+        }
+        return slots ? &slots[fd % CHUNK_SIZE] : nullptr;
+    }
+
+    size_t _chunk_count = 0;
+    std::unique_ptr<std::atomic<Slot*>[]> _chunks;
+    std::mutex _grow_mutex;  // 只在分配新分块时使用
+};
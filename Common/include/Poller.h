@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <sys/epoll.h>
+
+// 事件循环交回的一个事件
+struct PollEvent {
+    enum Kind : uint8_t {
+        READY,   // fd 就绪，events 为 EPOLLIN / EPOLLOUT / EPOLLERR / EPOLLHUP 等的组合
+        ACCEPT,  // 监听 socket 上接受了新连接，res 为新 fd，失败为 -errno
+        RECV,    // 收到数据，res 为字节数；0 表示对端关闭，负数为 -errno，此后不再有 RECV 事件
+        SEND,    // send 的字节已全部写出，res 为字节数，失败为 -errno
+    };
+    Kind kind = READY;
+    uint64_t handle = 0;         // 注册时给出的句柄；ACCEPT 为监听 socket 的 fd
+    uint32_t events = 0;
+    int res = 0;
+    const char* data = nullptr;  // RECV 收到的字节，下一次 wait 时失效
+};
+
+/**
+ * 事件循环的 I/O 后端，ConnectionManager 只经由它关注 fd 与收发数据。
+ * epoll：只通知就绪，accept / read / write 由调用方完成。
+ * io_uring：监听 socket 上挂多发 accept，新连接直接以 ACCEPT 事件交回；fd 上挂多发 poll，语义与边缘触发的 epoll 相同。
+ *   关注、修改、取消都只写进提交队列，一批事件处理完后与下一次等待合并为一次 io_uring_enter。
+ *   另有完成式收发：多发 recv 从注册给内核的缓冲区环（provided buffer ring）取缓冲区，
+ *   send 由内核写完全部字节，需要时链接上取消与关闭，整条响应连同关闭只需一次提交。
+ *   一个环只由创建它的线程使用，只用于反应堆模式。
+ */
+class Poller {
+public:
+    virtual ~Poller() = default;
+
+    // 按名字（epoll / uring）创建后端，每次 wait 最多交回 max_events 个事件；失败返回 nullptr
+    static std::unique_ptr<Poller> create(const std::string& engine, int max_events);
+
+    virtual const char* name() const = 0;
+
+    // 加入监听 socket；exclusive 表示多个事件循环共用同一个 socket，新连接只唤醒其中一个
+    virtual bool add_listener(int fd, bool exclusive = false) = 0;
+    // 为 true 时新连接以 ACCEPT 事件交回，否则监听 socket 以 READY 事件通知，由调用方 accept
+    virtual bool accepts() const { return false; }
+
+    // 以边缘触发关注 fd 上的 events，就绪时以 READY 事件带着 handle 交回
+    virtual bool add(int fd, uint64_t handle, uint32_t events) = 0;
+    // 修改关注的事件；fd 此时已满足新的事件时随即通知一次
+    virtual bool mod(int fd, uint64_t handle, uint32_t events) = 0;
+    // 不再关注 fd 并取消其上的在途收发，fd 之后可以继续使用或直接关闭
+    virtual void del(int fd) = 0;
+    // fd 马上要关闭：epoll 在关闭时自动移除，什么也不做；io_uring 的在途请求持有文件引用，须先取消
+    virtual void forget(int fd) { del(fd); }
+
+    // 是否支持下面的完成式收发
+    virtual bool completion() const { return false; }
+    // 在 fd 上持续接收，数据以 RECV 事件交回
+    virtual bool recv(int /*fd*/, uint64_t /*handle*/) { return false; }
+    // 停止 fd 上的持续接收，取消生效前已收到的数据仍以 RECV 事件交回；再次调用 recv 恢复
+    virtual void stop_recv(int /*fd*/) {}
+    /**
+     * 发送 data 的全部字节，写完后以 SEND 事件交回；同一 fd 上一次只能有一个在途的 send。
+     * close_after 时写完接着取消 fd 上的接收并关闭 fd，调用方不能再关闭它。
+     */
+    virtual bool send(int /*fd*/, uint64_t /*handle*/, std::string /*data*/, bool /*close_after*/) { return false; }
+
+    // 提交积攒的请求并等待至少一个事件，本轮的事件放进 events；出错返回 -1
+    virtual int wait(std::vector<PollEvent>& events) = 0;
+};
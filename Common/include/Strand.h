@@ -0,0 +1,54 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+/**
+ * 一个连接上的事件串行执行：第一个到达的工作线程取得执行权，处理期间别的线程送来的事件只记下就返回，
+ * 由持有执行权的线程处理完手头的事件后接着处理，直到没有待处理的事件才交出执行权。
+ * 同一句柄的多次事件合并成一项（按位或），待处理项不超过连接上的 fd 数，稳定后不再分配内存。
+ * 锁只保护待处理列表，不在处理事件时持有，工作线程不会因为连接忙而阻塞。
+ */
+class Strand {
+public:
+    // 返回 true 表示取得执行权，调用方先处理这个事件，再用 next 取后续事件
+    bool enter(uint64_t handle, uint32_t events) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_running) {
+            _running = true;
+            return true;
+        }
+        for (auto& item : _pending) {
+            if (item.handle == handle) {
+                item.events |= events;
+                return false;
+            }
+        }
+        _pending.push_back({handle, events});
+        return false;
+    }
+
+    // 取下一个待处理的事件；没有时交出执行权并返回 false
+    bool next(uint64_t& handle, uint32_t& events) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_pending.empty()) {
+            _running = false;
+            return false;
+        }
+        handle = _pending.front().handle;
+        events = _pending.front().events;
+        _pending.erase(_pending.begin());
+        return true;
+    }
+
+private:
+    struct Item {
+        uint64_t handle;
+        uint32_t events;
+    };
+
+    std::mutex _mutex;
+    bool _running = false;
+    std::vector<Item> _pending;
+};
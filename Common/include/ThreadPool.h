@@ -0,0 +1,352 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <new>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "Singleton.h"
+
+/**
+ * 工作窃取线程池。
+ * post 提交的任务按值存放在固定大小的槽位中（可平凡复制、最多 TASK_WORDS 个字），提交和执行都不分配内存。
+ * 非工作线程（epoll 循环）提交的任务进入全局注入队列，工作线程提交的进自己的双端队列；
+ * 工作线程先取自己队列的队尾，空了从注入队列成批搬一些到自己队列，再空就从其他线程的队头窃取。
+ * 都没有任务时先自旋若干轮，再睡眠等待提交方唤醒。
+ */
+class ThreadPool : public Singleton<ThreadPool> {
+	friend class Singleton;
+public:
+	static constexpr size_t TASK_WORDS = 3;  // 任务捕获的数据最多 24 字节
+
+	~ThreadPool() {
+		Stop();
+	};
+
+	// 正在睡眠等待任务的线程数
+	int idleThreadCount() {
+		return sleepers_.load(std::memory_order_relaxed);
+	}
+
+	int threadCount() {
+		return static_cast<int>(pool_.size());
+	}
+
+	// 排队等待执行的任务数（近似值）
+	size_t queueDepth() {
+		size_t depth = inject_.size();
+		for (auto& worker : workers_) depth += worker->deque.size();
+		return depth;
+	}
+
+	/**
+	 * 提交一个不关心结果的任务。
+	 * @param f 可平凡复制、不超过 TASK_WORDS 个字的可调用对象，例如只捕获指针和整数的 lambda
+	 */
+	template <typename F>
+	void post(F&& f) {
+		Task task = make_task(std::forward<F>(f));
+		if (!current_ || !current_->deque.push(task)) {
+			// 注入队列满时等工作线程取走一些
+			while (!inject_.push(task)) std::this_thread::yield();
+		}
+		wake();
+	}
+
+	// 需要结果的任务：在堆上包装成 packaged_task 后经 post 提交
+	template <typename F, typename... Args>
+	auto commit(F&& f, Args&&... args) -> std::future<typename std::invoke_result<F, Args...>::type> {
+		using ReturnType = typename std::invoke_result<F, Args...>::type;
+		// 先检查再分配，抛出时没有要释放的任务
+		if (stop_.load())
+			throw std::runtime_error("ThreadPool had stopped, can't commit new tasks");
+		auto task = new std::packaged_task<ReturnType()>([f = std::forward<F>(f), ... args = std::forward<Args>(args)]() mutable {
+			return f(args...);
+		});
+
+		auto future = task->get_future();
+		post([task]() {
+			(*task)();
+			delete task;
+		});
+		return future;
+	}
+
+private:
+	using Invoke = void (*)(const uint64_t*);
+
+	// 调用入口 + 按值保存的可调用对象
+	struct Task {
+		Invoke invoke = nullptr;
+		uint64_t data[TASK_WORDS] = {};
+	};
+
+	// 队列中的任务槽位：逐字原子读写，窃取方读到一半被覆盖的副本会在随后的 CAS 失败后丢弃
+	struct Slot {
+		std::atomic<Invoke> invoke{nullptr};
+		std::atomic<uint64_t> data[TASK_WORDS] = {};
+
+		void store(const Task& task) {
+			invoke.store(task.invoke, std::memory_order_relaxed);
+			for (size_t i = 0; i < TASK_WORDS; ++i) data[i].store(task.data[i], std::memory_order_relaxed);
+		}
+
+		Task load() const {
+			Task task;
+			task.invoke = invoke.load(std::memory_order_relaxed);
+			for (size_t i = 0; i < TASK_WORDS; ++i) task.data[i] = data[i].load(std::memory_order_relaxed);
+			return task;
+		}
+	};
+
+	// 每个工作线程的 Chase-Lev 双端队列：所有者在 bottom 端压入弹出，其他线程从 top 端窃取
+	struct WorkDeque {
+		static constexpr int64_t CAPACITY = 1024;
+
+		alignas(64) std::atomic<int64_t> top{0};
+		alignas(64) std::atomic<int64_t> bottom{0};
+		Slot slots[CAPACITY];
+
+		bool push(const Task& task) {
+			int64_t b = bottom.load(std::memory_order_relaxed);
+			if (b - top.load(std::memory_order_acquire) >= CAPACITY) return false;
+			slots[b & (CAPACITY - 1)].store(task);
+			bottom.store(b + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool pop(Task& task) {
+			int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+			bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = top.load(std::memory_order_relaxed);
+			if (t > b) {
+				bottom.store(b + 1, std::memory_order_relaxed);
+				return false;
+			}
+			task = slots[b & (CAPACITY - 1)].load();
+			if (t < b) return true;
+			// 只剩最后一个，和窃取方抢
+			bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return won;
+		}
+
+		bool steal(Task& task) {
+			int64_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t b = bottom.load(std::memory_order_acquire);
+			if (t >= b) return false;
+			task = slots[t & (CAPACITY - 1)].load();
+			return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+		}
+
+		size_t size() const {
+			int64_t n = bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_relaxed);
+			return n > 0 ? static_cast<size_t>(n) : 0;
+		}
+	};
+
+	// 全局注入队列：有界多生产者多消费者环形队列，每个格子用序号标明可写还是可读
+	struct InjectQueue {
+		static constexpr size_t CAPACITY = 16384;
+
+		struct Cell {
+			std::atomic<size_t> seq{0};
+			Slot slot;
+		};
+
+		std::unique_ptr<Cell[]> cells{new Cell[CAPACITY]};
+		alignas(64) std::atomic<size_t> head{0};
+		alignas(64) std::atomic<size_t> tail{0};
+
+		InjectQueue() {
+			for (size_t i = 0; i < CAPACITY; ++i) cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+
+		bool push(const Task& task) {
+			size_t pos = tail.load(std::memory_order_relaxed);
+			while (true) {
+				Cell& cell = cells[pos & (CAPACITY - 1)];
+				auto diff = static_cast<std::ptrdiff_t>(cell.seq.load(std::memory_order_acquire) - pos);
+				if (diff == 0) {
+					if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						cell.slot.store(task);
+						cell.seq.store(pos + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (diff < 0) {
+					return false;
+				}
+				else {
+					pos = tail.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		bool pop(Task& task) {
+			size_t pos = head.load(std::memory_order_relaxed);
+			while (true) {
+				Cell& cell = cells[pos & (CAPACITY - 1)];
+				auto diff = static_cast<std::ptrdiff_t>(cell.seq.load(std::memory_order_acquire) - (pos + 1));
+				if (diff == 0) {
+					if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						task = cell.slot.load();
+						cell.seq.store(pos + CAPACITY, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (diff < 0) {
+					return false;
+				}
+				else {
+					pos = head.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		size_t size() const {
+			size_t t = tail.load(std::memory_order_relaxed), h = head.load(std::memory_order_relaxed);
+			return t > h ? t - h : 0;
+		}
+	};
+
+	struct Worker {
+		WorkDeque deque;
+		uint32_t rand = 0;  // 选窃取对象的 xorshift 状态
+	};
+
+	static constexpr int SPIN_ROUNDS = 64;   // 睡眠前空转找任务的轮数
+	static constexpr size_t INJECT_BATCH = 32;  // 一次从注入队列搬到本地队列的任务数
+
+	template <typename F>
+	static Task make_task(F&& f) {
+		using Fn = std::decay_t<F>;
+		static_assert(sizeof(Fn) <= sizeof(uint64_t) * TASK_WORDS && alignof(Fn) <= alignof(uint64_t),
+			"task captures too much, capture pointers instead or use commit");
+		static_assert(std::is_trivially_copyable_v<Fn> && std::is_trivially_destructible_v<Fn>,
+			"task must be trivially copyable, use commit for other callables");
+		Fn fn(std::forward<F>(f));
+		Task task;
+		std::memcpy(task.data, &fn, sizeof(Fn));
+		task.invoke = [](const uint64_t* data) {
+			alignas(Fn) unsigned char storage[sizeof(Fn)];
+			std::memcpy(storage, data, sizeof(Fn));
+			(*std::launder(reinterpret_cast<Fn*>(storage)))();
+		};
+		return task;
+	}
+
+	ThreadPool(unsigned int num = std::thread::hardware_concurrency()) : stop_(false) {
+		int thread_num = num <= 1 ? 2 : static_cast<int>(num);
+		for (int i = 0; i < thread_num; ++i) {
+			workers_.push_back(std::make_unique<Worker>());
+			workers_.back()->rand = 2654435761u * (i + 1);
+		}
+
+		Start();
+	};
+
+	void Start() {
+		for (auto& worker : workers_) {
+			pool_.emplace_back([this, self = worker.get()]() {
+				Run(self);
+			});
+		}
+	}
+
+	void Stop() {
+		stop_.store(true);
+		epoch_.fetch_add(1);
+		epoch_.notify_all();
+
+		for (auto& td : pool_) {
+			if (td.joinable()) {
+				std::cout << "Join thread " << td.get_id() << std::endl;
+				td.join();
+			}
+		}
+	}
+
+	void Run(Worker* self) {
+		current_ = self;
+		Task task;
+		while (true) {
+			bool found = FindTask(self, task);
+			for (int i = 0; !found && i < SPIN_ROUNDS; ++i) {
+				std::this_thread::yield();
+				found = FindTask(self, task);
+			}
+			if (found) {
+				task.invoke(task.data);
+				continue;
+			}
+			if (stop_.load()) return;
+
+			// 先登记为睡眠再检查一次队列，与 wake 中「先入队再看有没有睡眠者」配对：
+			// 两边各有一道 seq_cst 栅栏，入队方与睡眠方至少有一方看到对方的写入，不会漏掉唤醒
+			uint32_t epoch = epoch_.load();
+			sleepers_.fetch_add(1);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!stop_.load() && !HasWork()) epoch_.wait(epoch);
+			sleepers_.fetch_sub(1);
+		}
+	}
+
+	bool FindTask(Worker* self, Task& task) {
+		if (self->deque.pop(task)) return true;
+
+		if (inject_.pop(task)) {
+			// 多搬一些到本地队列，空闲的线程可以从这里窃取
+			Task extra;
+			size_t moved = 0;
+			while (moved + 1 < INJECT_BATCH && inject_.size() > 0 && inject_.pop(extra)) {
+				if (!self->deque.push(extra)) {
+					while (!inject_.push(extra)) std::this_thread::yield();
+					break;
+				}
+				++moved;
+			}
+			if (moved > 0) wake();
+			return true;
+		}
+
+		size_t n = workers_.size();
+		self->rand ^= self->rand << 13;
+		self->rand ^= self->rand >> 17;
+		self->rand ^= self->rand << 5;
+		size_t start = self->rand % n;
+		for (size_t i = 0; i < n; ++i) {
+			Worker* victim = workers_[(start + i) % n].get();
+			if (victim != self && victim->deque.steal(task)) return true;
+		}
+		return false;
+	}
+
+	bool HasWork() {
+		return queueDepth() > 0;
+	}
+
+	void wake() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleepers_.load(std::memory_order_relaxed) > 0) {
+			epoch_.fetch_add(1);
+			epoch_.notify_one();
+		}
+	}
+
+	inline static thread_local Worker* current_ = nullptr;  // 当前线程是工作线程时指向它
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+	InjectQueue inject_;
+	std::vector<std::thread> pool_;
+	std::atomic_bool stop_;
+	std::atomic<int> sleepers_{0};
+	std::atomic<uint32_t> epoch_{0};  // 唤醒计数，睡眠的线程在它上面等待
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <sys/types.h>
+#include <openssl/ssl.h>
+#include "Singleton.h"
+
+// 监听端口的 TLS 配置
+struct TlsOptions {
+    std::string cert_file;          // PEM 证书链，空表示不启用 TLS
+    std::string key_file;           // PEM 私钥，空表示与证书在同一文件
+    size_t session_cache = 20480;   // 按会话 ID 恢复的服务端缓存条目数，0 表示关闭
+    int session_timeout = 300;      // 会话与会话票据的有效期（秒）
+    std::string ticket_key_file;    // 80 字节的会话票据密钥，多个实例共用同一文件即可互相恢复会话；空表示启动时随机生成
+    bool ktls = true;               // 握手完成后尽量把记录层的加解密交给内核（kTLS）
+    std::string session_id_context; // 会话 ID 缓存的上下文名，用同一证书的不同服务各取一个，会话不会串用
+};
+
+// 推进一步握手的结果
+enum class TlsStatus {
+    DONE,
+    WANT_READ,   // 等客户端发来数据
+    WANT_WRITE,  // 套接字写满，等可写
+    FAILED,
+};
+
+/**
+ * 监听端口的 TLS 终结：所有连接共用一个 SSL_CTX，会话缓存与票据密钥因此在各工作线程间共享，
+ * 恢复会话的握手不再做完整的密钥交换。握手在事件循环中非阻塞推进；完成后内核接管了发送方向（kTLS）的连接
+ * 可以直接对 fd write / splice，与明文连接走同一条路径，否则经 SSL_write 在用户态加密。
+ */
+class TlsContext : public Singleton<TlsContext> {
+    friend class Singleton<TlsContext>;
+public:
+    ~TlsContext();
+    bool start(const TlsOptions& opts);
+    bool enabled() const { return _ctx != nullptr; }
+
+    // 为新接受的连接创建 SSL 对象，失败返回 nullptr
+    SSL* accept(int fd);
+    // 握手完成后调用：记录统计并打印协商结果
+    void on_established(SSL* ssl, int fd);
+
+    static TlsStatus handshake(SSL* ssl);
+    // 内核是否接管了发送 / 接收方向的加解密
+    static bool kernel_send(SSL* ssl);
+    static bool kernel_recv(SSL* ssl);
+    /**
+     * 与 read / write 相同的返回约定：需要等待时返回 -1 且 errno 为 EAGAIN，对端关闭返回 0。
+     * 接收方向由内核解密时 read 仍经过 OpenSSL，由它处理告警等非应用数据的记录。
+     */
+    static ssize_t read(SSL* ssl, char* buf, size_t len);
+    static ssize_t write(SSL* ssl, const char* data, size_t len);
+    // 由本端发起关闭时发出 close_notify（不等回应）并释放；须在关闭 fd 之前调用
+    static void close(SSL* ssl);
+
+    uint64_t handshakes() const { return _handshakes.load(); }
+    uint64_t resumed() const { return _resumed.load(); }
+
+private:
+    // 用 ticket_key_file 中的密钥加解密会话票据
+    static int ticket_key_cb(SSL* ssl, unsigned char* name, unsigned char* iv, EVP_CIPHER_CTX* cipher,
+                             EVP_MAC_CTX* mac, int enc);
+    // 连接出错：记下 OpenSSL 的错误，之后关闭时不再发 close_notify
+    static void fail(SSL* ssl, const char* what);
+
+    SSL_CTX* _ctx = nullptr;
+    unsigned char _ticket_key[80] = {};  // 名称 16 字节 + HMAC 密钥 32 字节 + AES 密钥 32 字节
+    std::atomic<uint64_t> _handshakes{0};
+    std::atomic<uint64_t> _resumed{0};
+};
@@ -0,0 +1,598 @@
+#include "Poller.h"
+#include <iostream>
+#include <atomic>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+namespace {
+
+class EpollPoller : public Poller {
+public:
+    explicit EpollPoller(int max_events) : _events(max_events) {}
+
+    ~EpollPoller() override {
+        if (_epfd >= 0) close(_epfd);
+    }
+
+    bool start() {
+        _epfd = epoll_create1(0);
+        if (_epfd < 0) {
+            perror("epoll_create1");
+            return false;
+        }
+        return true;
+    }
+
+    const char* name() const override { return "epoll"; }
+
+    bool add_listener(int fd, bool exclusive) override {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLET;
+        if (exclusive) ev.events |= EPOLLEXCLUSIVE;
+        ev.data.u64 = fd;  // 代数为 0，不会与连接句柄混淆
+        return epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+
+    bool add(int fd, uint64_t handle, uint32_t events) override {
+        return ctl(EPOLL_CTL_ADD, fd, handle, events);
+    }
+
+    bool mod(int fd, uint64_t handle, uint32_t events) override {
+        return ctl(EPOLL_CTL_MOD, fd, handle, events);
+    }
+
+    void del(int fd) override {
+        epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    void forget(int) override {}
+
+    int wait(std::vector<PollEvent>& events) override {
+        int n = epoll_wait(_epfd, _events.data(), static_cast<int>(_events.size()), -1);
+        if (n < 0) return -1;
+        events.resize(n);
+        for (int i = 0; i < n; ++i) {
+            events[i] = PollEvent{};
+            events[i].handle = _events[i].data.u64;
+            events[i].events = _events[i].events;
+        }
+        return n;
+    }
+
+private:
+    bool ctl(int op, int fd, uint64_t handle, uint32_t events) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.u64 = handle;
+        return epoll_ctl(_epfd, op, fd, &ev) == 0;
+    }
+
+    int _epfd = -1;
+    std::vector<epoll_event> _events;
+};
+
+/**
+ * user_data 的最高两位标记请求类型，其余位是句柄（ConnSlab 的代数只用 30 位）。
+ * POLL 类型中代数为 0 的是监听 socket 上的多发 accept；OTHER 类型的请求不关心结果，只有 accept 重试的定时器例外。
+ */
+constexpr int TAG_SHIFT = 62;
+constexpr uint64_t HANDLE_MASK = (1ull << TAG_SHIFT) - 1;
+constexpr uint64_t TAG_POLL = 0;
+constexpr uint64_t TAG_RECV = 1;
+constexpr uint64_t TAG_SEND = 2;
+constexpr uint64_t TAG_OTHER = 3;
+constexpr uint64_t IGNORED = TAG_OTHER << TAG_SHIFT;
+constexpr uint64_t ACCEPT_RETRY = IGNORED | 1ull << 32;  // 低 32 位为监听 socket 的 fd
+
+class UringPoller : public Poller {
+public:
+    static constexpr unsigned SQ_ENTRIES = 4096;
+    static constexpr unsigned CQ_ENTRIES = SQ_ENTRIES * 4;
+    static constexpr unsigned BUF_COUNT = 1024;  // 2 的幂
+    static constexpr unsigned BUF_SIZE = 4096;
+    static constexpr uint16_t BUF_GROUP = 0;
+
+    // 每轮收割的完成事件有上限，一批事件处理中积攒的 SQE 不至于填满提交队列
+    explicit UringPoller(int max_events) : _max_events(std::min<int>(max_events, SQ_ENTRIES / 4)) {}
+
+    ~UringPoller() override {
+        if (_bufs) munmap(_bufs, BUF_COUNT * BUF_SIZE);
+        if (_buf_ring) munmap(_buf_ring, BUF_COUNT * sizeof(io_uring_buf));
+        if (_sqes) munmap(_sqes, _sqes_len);
+        if (_cq_ptr && _cq_ptr != _sq_ptr) munmap(_cq_ptr, _cq_len);
+        if (_sq_ptr) munmap(_sq_ptr, _sq_len);
+        if (_ring_fd >= 0) close(_ring_fd);
+    }
+
+    bool start() {
+        io_uring_params params{};
+        // 只由本线程提交与收割：完成事件推迟到 io_uring_enter 时才处理，不打断正在处理事件的线程
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+                       IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+        params.cq_entries = CQ_ENTRIES;
+        _ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, SQ_ENTRIES, &params));
+        if (_ring_fd < 0 && errno == EINVAL) {
+            // 较老的内核不认识后几个标志
+            params = io_uring_params{};
+            params.flags = IORING_SETUP_CQSIZE;
+            params.cq_entries = CQ_ENTRIES;
+            _ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, SQ_ENTRIES, &params));
+        }
+        if (_ring_fd < 0) {
+            perror("io_uring_setup");
+            return false;
+        }
+        if (!(params.features & IORING_FEAT_NODROP)) {
+            std::cerr << "[ERROR] io_uring: kernel too old, completions may be dropped" << std::endl;
+            return false;
+        }
+
+        _sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        _cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) _sq_len = _cq_len = std::max(_sq_len, _cq_len);
+        _sq_ptr = map(_sq_len, IORING_OFF_SQ_RING);
+        _cq_ptr = single_mmap ? _sq_ptr : map(_cq_len, IORING_OFF_CQ_RING);
+        _sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+        _sqes = static_cast<io_uring_sqe*>(map(_sqes_len, IORING_OFF_SQES));
+        if (!_sq_ptr || !_cq_ptr || !_sqes) {
+            perror("mmap (io_uring)");
+            return false;
+        }
+
+        char* sq = static_cast<char*>(_sq_ptr);
+        _sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        _sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        _sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        _sq_entries = params.sq_entries;
+        // SQE 按顺序使用，索引数组固定为恒等映射
+        unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < _sq_entries; ++i) array[i] = i;
+        _sq_local_tail = *_sq_tail;
+
+        char* cq = static_cast<char*>(_cq_ptr);
+        _cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        _cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        _cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        _cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // 缓冲区环注册失败（内核早于 5.19）时退回就绪通知，由调用方自己读写
+        _completion = setup_buffers();
+        std::cout << "[INIT] io_uring ready, sq " << params.sq_entries << ", cq " << params.cq_entries
+                  << ", provided buffers " << (_completion ? BUF_COUNT : 0) << " x " << BUF_SIZE << std::endl;
+        return true;
+    }
+
+    const char* name() const override { return "uring"; }
+
+    bool add_listener(int fd, bool) override {
+        // 多发 accept 由内核逐个接受，共用的监听 socket 上每个连接也只会被一个环接受
+        arm_accept(fd);
+        return true;
+    }
+
+    bool accepts() const override { return true; }
+
+    bool add(int fd, uint64_t handle, uint32_t events) override {
+        FdOps* ops = fd_ops(fd, true);
+        if (!ops) return false;
+        if (ops->poll) remove_poll(ops->poll);
+        ops->events = events;
+        arm_poll(fd, handle);
+        return true;
+    }
+
+    bool mod(int fd, uint64_t handle, uint32_t events) override {
+        FdOps* ops = fd_ops(fd, true);
+        if (!ops) return false;
+        if (ops->poll != handle) return add(fd, handle, events);
+        ops->events = events;
+        // 原地更新多发 poll 的事件，内核随即按新事件检查一次就绪
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = handle;
+        sqe->len = IORING_POLL_UPDATE_EVENTS | IORING_POLL_ADD_MULTI;
+        sqe->poll32_events = events;
+        sqe->user_data = IGNORED;
+        return true;
+    }
+
+    void del(int fd) override {
+        FdOps* ops = fd_ops(fd, false);
+        if (!ops) return;
+        if (ops->poll) remove_poll(ops->poll);
+        if (ops->recv) cancel(ops->recv);
+        if (ops->send) {
+            // 发送缓冲区留到内核交回完成事件再释放
+            _sends[ops->send].cancelled = true;
+            cancel(ops->send);
+        }
+        *ops = FdOps{};
+    }
+
+    bool completion() const override { return _completion; }
+
+    bool recv(int fd, uint64_t handle) override {
+        FdOps* ops = fd_ops(fd, true);
+        if (!ops || !_completion) return false;
+        if (ops->recv) cancel(ops->recv);
+        ops->recv = TAG_RECV << TAG_SHIFT | handle;
+        ops->recv_stopped = false;
+        arm_recv(fd, ops->recv);
+        return true;
+    }
+
+    void stop_recv(int fd) override {
+        FdOps* ops = fd_ops(fd, false);
+        if (!ops || !ops->recv || ops->recv_stopped) return;
+        // 保留 user_data：取消生效前已完成的接收照常交回
+        cancel(ops->recv);
+        ops->recv_stopped = true;
+    }
+
+    bool send(int fd, uint64_t handle, std::string data, bool close_after) override {
+        FdOps* ops = fd_ops(fd, true);
+        if (!ops || !_completion) return false;
+        uint64_t user_data = TAG_SEND << TAG_SHIFT | handle;
+        SendOp& op = _sends[user_data];
+        op.data = std::move(data);
+        op.fd = fd;
+        op.close_after = close_after;
+        if (!close_after) {
+            ops->send = user_data;
+            submit_send(op, user_data, 0);
+            return true;
+        }
+
+        // send -> 按 fd 取消在途的接收 -> close，硬链接保证前一步失败也继续往下走
+        submit_send(op, user_data, IOSQE_IO_HARDLINK);
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->flags = IOSQE_IO_HARDLINK;
+        sqe->fd = fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = IGNORED;
+        sqe = get_sqe();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fd;
+        sqe->user_data = IGNORED;
+        // fd 交给内核关闭，之后可能被新连接复用，不再跟踪
+        *ops = FdOps{};
+        return true;
+    }
+
+    int wait(std::vector<PollEvent>& events) override {
+        events.clear();
+        recycle_buffers();
+
+        // 上一批事件处理中积攒的请求与这次等待合成一次系统调用
+        bool pending = cq_ready() > 0;
+        if (enter(pending ? 0 : 1, IORING_ENTER_GETEVENTS) < 0) {
+            // 完成队列溢出时先收割再提交
+            if (errno != EBUSY && errno != EAGAIN) return -1;
+        }
+
+        unsigned head = *_cq_head;
+        unsigned tail = std::atomic_ref<unsigned>(*_cq_tail).load(std::memory_order_acquire);
+        while (head != tail && static_cast<int>(events.size()) < _max_events) {
+            on_completion(_cqes[head & _cq_mask], events);
+            ++head;
+        }
+        std::atomic_ref<unsigned>(*_cq_head).store(head, std::memory_order_release);
+        return static_cast<int>(events.size());
+    }
+
+private:
+    // 一个 fd 上在途的请求，值为各自的 user_data，0 表示没有
+    struct FdOps {
+        uint64_t poll = 0;
+        uint32_t events = 0;
+        uint64_t recv = 0;
+        bool recv_stopped = false;  // 接收已取消，等再次 recv
+        uint64_t send = 0;
+    };
+
+    struct SendOp {
+        std::string data;
+        size_t done = 0;
+        int fd = -1;
+        bool close_after = false;
+        bool cancelled = false;  // 连接已关闭，完成时不再交回事件
+    };
+
+    void* map(size_t len, uint64_t offset) {
+        void* ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+
+    bool setup_buffers() {
+        void* ring = mmap(nullptr, BUF_COUNT * sizeof(io_uring_buf), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        void* bufs = mmap(nullptr, BUF_COUNT * BUF_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED || bufs == MAP_FAILED) {
+            if (ring != MAP_FAILED) munmap(ring, BUF_COUNT * sizeof(io_uring_buf));
+            if (bufs != MAP_FAILED) munmap(bufs, BUF_COUNT * BUF_SIZE);
+            return false;
+        }
+        _buf_ring = static_cast<io_uring_buf_ring*>(ring);
+        _bufs = static_cast<char*>(bufs);
+
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+        reg.ring_entries = BUF_COUNT;
+        reg.bgid = BUF_GROUP;
+        if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            perror("io_uring_register (buffer ring)");
+            return false;
+        }
+        for (unsigned i = 0; i < BUF_COUNT; ++i) _used_bufs.push_back(static_cast<uint16_t>(i));
+        recycle_buffers();
+        return true;
+    }
+
+    // 把上一轮交出去的缓冲区还给内核
+    void recycle_buffers() {
+        if (_used_bufs.empty()) return;
+        // 头文件中 bufs 柔性数组前的空结构体在 C++ 里占一个字节，偏移不对，直接按 io_uring_buf 数组访问
+        io_uring_buf* ring = reinterpret_cast<io_uring_buf*>(_buf_ring);
+        for (uint16_t bid : _used_bufs) {
+            io_uring_buf& buf = ring[_buf_tail & (BUF_COUNT - 1)];
+            buf.addr = reinterpret_cast<uint64_t>(_bufs + static_cast<size_t>(bid) * BUF_SIZE);
+            buf.len = BUF_SIZE;
+            buf.bid = bid;
+            ++_buf_tail;
+        }
+        std::atomic_ref<uint16_t>(_buf_ring->tail).store(_buf_tail, std::memory_order_release);
+        _used_bufs.clear();
+    }
+
+    FdOps* fd_ops(int fd, bool create) {
+        if (fd < 0) return nullptr;
+        if (static_cast<size_t>(fd) >= _fds.size()) {
+            if (!create) return nullptr;
+            _fds.resize(std::max<size_t>(fd + 1, _fds.size() * 2));
+        }
+        return &_fds[fd];
+    }
+
+    unsigned cq_ready() const {
+        return std::atomic_ref<unsigned>(*_cq_tail).load(std::memory_order_acquire) - *_cq_head;
+    }
+
+    // 提交队列满了就先提交一次
+    io_uring_sqe* get_sqe() {
+        while (_sq_local_tail - std::atomic_ref<unsigned>(*_sq_head).load(std::memory_order_acquire) >= _sq_entries) {
+            if (enter(0, 0) < 0 && errno != EBUSY && errno != EAGAIN) {
+                perror("io_uring_enter");
+                std::this_thread::yield();
+            }
+        }
+        io_uring_sqe* sqe = &_sqes[_sq_local_tail & _sq_mask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        ++_sq_local_tail;
+        ++_to_submit;
+        return sqe;
+    }
+
+    int enter(unsigned wait_nr, unsigned flags) {
+        std::atomic_ref<unsigned>(*_sq_tail).store(_sq_local_tail, std::memory_order_release);
+        while (true) {
+            long ret = syscall(__NR_io_uring_enter, _ring_fd, _to_submit, wait_nr, flags, nullptr, 0);
+            if (ret >= 0) {
+                _to_submit -= std::min<unsigned>(_to_submit, static_cast<unsigned>(ret));
+                return static_cast<int>(ret);
+            }
+            // 提交队列满时的内部提交不能丢下请求
+            if (errno == EINTR && wait_nr == 0) continue;
+            return -1;
+        }
+    }
+
+    void arm_accept(int fd) {
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK;
+        sqe->user_data = static_cast<uint32_t>(fd);
+    }
+
+    void arm_poll(int fd, uint64_t handle) {
+        FdOps* ops = fd_ops(fd, true);
+        ops->poll = handle;
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->poll32_events = ops->events;
+        sqe->user_data = handle;
+    }
+
+    void remove_poll(uint64_t user_data) {
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = user_data;
+        sqe->user_data = IGNORED;
+    }
+
+    void arm_recv(int fd, uint64_t user_data) {
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUF_GROUP;
+        sqe->user_data = user_data;
+    }
+
+    void submit_send(const SendOp& op, uint64_t user_data, uint8_t flags) {
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_SEND;
+        sqe->flags = flags;
+        sqe->fd = op.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(op.data.data() + op.done);
+        sqe->len = static_cast<uint32_t>(op.data.size() - op.done);
+        // 流式 socket 上由内核写到全部写完或出错为止
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+        sqe->user_data = user_data;
+    }
+
+    void cancel(uint64_t user_data) {
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = user_data;
+        sqe->user_data = IGNORED;
+    }
+
+    void on_completion(const io_uring_cqe& cqe, std::vector<PollEvent>& events) {
+        uint64_t user_data = cqe.user_data;
+        uint64_t handle = user_data & HANDLE_MASK;
+        int fd = static_cast<int>(user_data & 0xffffffffu);
+        bool more = cqe.flags & IORING_CQE_F_MORE;
+        PollEvent ev;
+        ev.handle = handle;
+        ev.res = cqe.res;
+
+        switch (user_data >> TAG_SHIFT) {
+        case TAG_POLL: {
+            if (handle >> 32 == 0) {
+                ev.kind = PollEvent::ACCEPT;
+                if (cqe.res == -ECANCELED) break;
+                events.push_back(ev);
+                if (more) break;
+                if (cqe.res >= 0) {
+                    arm_accept(fd);
+                }
+                else {
+                    // 多发 accept 因出错（如 fd 用尽）结束：稍后再挂，避免空转
+                    io_uring_sqe* sqe = get_sqe();
+                    sqe->opcode = IORING_OP_TIMEOUT;
+                    sqe->fd = -1;
+                    sqe->addr = reinterpret_cast<uint64_t>(&ACCEPT_RETRY_DELAY);
+                    sqe->len = 1;
+                    sqe->user_data = ACCEPT_RETRY | static_cast<uint32_t>(fd);
+                }
+                break;
+            }
+            FdOps* ops = fd_ops(fd, false);
+            // 已取消或已被新的关注取代
+            if (!ops || ops->poll != user_data || cqe.res == -ECANCELED) break;
+            if (cqe.res >= 0) {
+                ev.events = static_cast<uint32_t>(cqe.res);
+                events.push_back(ev);
+                // 多发 poll 被内核结束（如完成队列溢出），重新挂上
+                if (!more) arm_poll(fd, handle);
+            }
+            else if (!more) {
+                ops->poll = 0;
+                ev.events = EPOLLERR | EPOLLHUP;
+                events.push_back(ev);
+            }
+            break;
+        }
+        case TAG_RECV: {
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                _used_bufs.push_back(bid);
+                ev.data = _bufs + static_cast<size_t>(bid) * BUF_SIZE;
+            }
+            FdOps* ops = fd_ops(fd, false);
+            if (!ops || ops->recv != user_data || cqe.res == -ECANCELED) break;
+            ev.kind = PollEvent::RECV;
+            if (cqe.res > 0) events.push_back(ev);
+            if (more) break;
+            if (cqe.res > 0 || cqe.res == -ENOBUFS) {
+                // 缓冲区暂时用完：本轮交出的缓冲区在下一次 wait 时归还，之后重新挂上；已停止接收的等 recv 再挂
+                if (!ops->recv_stopped) arm_recv(fd, user_data);
+            }
+            else {
+                ops->recv = 0;
+                ev.data = nullptr;
+                events.push_back(ev);
+            }
+            break;
+        }
+        case TAG_SEND: {
+            auto it = _sends.find(user_data);
+            if (it == _sends.end()) break;
+            SendOp& op = it->second;
+            if (cqe.res > 0) op.done += cqe.res;
+            if (!op.cancelled && !op.close_after && cqe.res > 0 && op.done < op.data.size()) {
+                submit_send(op, user_data, 0);
+                break;
+            }
+            if (!op.cancelled) {
+                if (!op.close_after) fd_ops(op.fd, true)->send = 0;
+                ev.kind = PollEvent::SEND;
+                ev.res = cqe.res < 0 ? cqe.res : static_cast<int>(op.done);
+                events.push_back(ev);
+            }
+            _sends.erase(it);
+            break;
+        }
+        default:
+            if ((user_data & ~0xffffffffull) == ACCEPT_RETRY) arm_accept(fd);
+            break;
+        }
+    }
+
+    inline static const __kernel_timespec ACCEPT_RETRY_DELAY{0, 100 * 1000 * 1000};
+
+    int _max_events;
+    int _ring_fd = -1;
+    void* _sq_ptr = nullptr;
+    void* _cq_ptr = nullptr;
+    size_t _sq_len = 0;
+    size_t _cq_len = 0;
+    io_uring_sqe* _sqes = nullptr;
+    size_t _sqes_len = 0;
+    unsigned* _sq_head = nullptr;
+    unsigned* _sq_tail = nullptr;
+    unsigned _sq_mask = 0;
+    unsigned _sq_entries = 0;
+    unsigned _sq_local_tail = 0;  // 已填好、尚未告诉内核的 SQE 的尾
+    unsigned _to_submit = 0;
+    unsigned* _cq_head = nullptr;
+    unsigned* _cq_tail = nullptr;
+    unsigned _cq_mask = 0;
+    io_uring_cqe* _cqes = nullptr;
+
+    bool _completion = false;
+    io_uring_buf_ring* _buf_ring = nullptr;
+    char* _bufs = nullptr;
+    uint16_t _buf_tail = 0;
+    std::vector<uint16_t> _used_bufs;  // 本轮交给调用方、下一次 wait 时归还的缓冲区
+
+    std::vector<FdOps> _fds;                       // 按 fd 下标
+    std::unordered_map<uint64_t, SendOp> _sends;  // 在途的 send，缓冲区由这里持有到完成
+};
+
+}  // namespace
+
+std::unique_ptr<Poller> Poller::create(const std::string& engine, int max_events) {
+    if (engine == "epoll") {
+        auto poller = std::make_unique<EpollPoller>(max_events);
+        if (!poller->start()) return nullptr;
+        return poller;
+    }
+    if (engine == "uring") {
+        auto poller = std::make_unique<UringPoller>(max_events);
+        if (!poller->start()) return nullptr;
+        return poller;
+    }
+    std::cerr << "[ERROR] Unknown I/O engine: " << engine << std::endl;
+    return nullptr;
+}
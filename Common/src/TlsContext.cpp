@@ -0,0 +1,199 @@
+#include "TlsContext.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/core_names.h>
+
+TlsContext::~TlsContext() {
+    if (_ctx) SSL_CTX_free(_ctx);
+}
+
+bool TlsContext::start(const TlsOptions& opts) {
+    if (_ctx) return true;
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        fail(nullptr, "SSL_CTX_new");
+        return false;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    // 客户端不发 close_notify 直接断开按正常关闭处理，HTTP 自己有分帧
+    uint64_t options = SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_IGNORE_UNEXPECTED_EOF;
+    if (opts.ktls) options |= SSL_OP_ENABLE_KTLS;
+    SSL_CTX_set_options(ctx, options);
+    // 写缓冲区在两次重试之间会移动（Buffer 会扩容），部分写出也算成功
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+
+    const std::string& key = opts.key_file.empty() ? opts.cert_file : opts.key_file;
+    if (SSL_CTX_use_certificate_chain_file(ctx, opts.cert_file.c_str()) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ctx, key.c_str(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1) {
+        fail(nullptr, "TLS certificate");
+        SSL_CTX_free(ctx);
+        return false;
+    }
+
+    // 会话 ID 缓存在 SSL_CTX 内部加锁，所有工作线程共用
+    SSL_CTX_set_session_id_context(ctx, reinterpret_cast<const unsigned char*>(opts.session_id_context.data()),
+                                   opts.session_id_context.size());
+    if (opts.session_cache > 0) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, static_cast<long>(opts.session_cache));
+    }
+    else {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    }
+    SSL_CTX_set_timeout(ctx, opts.session_timeout);
+
+    if (!opts.ticket_key_file.empty()) {
+        std::ifstream in(opts.ticket_key_file, std::ios::binary);
+        char extra;
+        if (!in.read(reinterpret_cast<char*>(_ticket_key), sizeof(_ticket_key)) || in.read(&extra, 1)) {
+            std::cerr << "[ERROR] Session ticket key file must hold exactly " << sizeof(_ticket_key)
+                      << " bytes: " << opts.ticket_key_file << std::endl;
+            SSL_CTX_free(ctx);
+            return false;
+        }
+        SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticket_key_cb);
+    }
+
+    _ctx = ctx;
+    std::cout << "[INIT] TLS enabled, certificate " << opts.cert_file << ", session cache " << opts.session_cache
+              << ", session timeout " << opts.session_timeout << " s, ticket key "
+              << (opts.ticket_key_file.empty() ? "random" : opts.ticket_key_file)
+              << ", kTLS " << (opts.ktls ? "on" : "off") << std::endl;
+    return true;
+}
+
+SSL* TlsContext::accept(int fd) {
+    SSL* ssl = SSL_new(_ctx);
+    if (!ssl || SSL_set_fd(ssl, fd) != 1) {
+        fail(nullptr, "SSL_new");
+        if (ssl) SSL_free(ssl);
+        return nullptr;
+    }
+    SSL_set_accept_state(ssl);
+    return ssl;
+}
+
+void TlsContext::on_established(SSL* ssl, int fd) {
+    ++_handshakes;
+    bool resumed = SSL_session_reused(ssl);
+    if (resumed) ++_resumed;
+    std::cout << "[STATE] TLS established, fd: " << fd << ", " << SSL_get_version(ssl) << " " << SSL_get_cipher_name(ssl)
+              << (resumed ? ", resumed" : "") << ", kTLS send " << (kernel_send(ssl) ? "on" : "off")
+              << ", recv " << (kernel_recv(ssl) ? "on" : "off") << std::endl;
+}
+
+TlsStatus TlsContext::handshake(SSL* ssl) {
+    ERR_clear_error();
+    int ret = SSL_do_handshake(ssl);
+    if (ret == 1) return TlsStatus::DONE;
+    switch (SSL_get_error(ssl, ret)) {
+    case SSL_ERROR_WANT_READ:
+        return TlsStatus::WANT_READ;
+    case SSL_ERROR_WANT_WRITE:
+        return TlsStatus::WANT_WRITE;
+    default:
+        fail(ssl, "TLS handshake");
+        return TlsStatus::FAILED;
+    }
+}
+
+bool TlsContext::kernel_send(SSL* ssl) {
+    [[maybe_unused]] BIO* bio = SSL_get_wbio(ssl);
+    return BIO_get_ktls_send(bio);
+}
+
+bool TlsContext::kernel_recv(SSL* ssl) {
+    [[maybe_unused]] BIO* bio = SSL_get_rbio(ssl);
+    return BIO_get_ktls_recv(bio);
+}
+
+ssize_t TlsContext::read(SSL* ssl, char* buf, size_t len) {
+    ERR_clear_error();
+    size_t n = 0;
+    if (SSL_read_ex(ssl, buf, len, &n) == 1) return static_cast<ssize_t>(n);
+    switch (SSL_get_error(ssl, 0)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return -1;
+    case SSL_ERROR_ZERO_RETURN:
+        // 对端已关闭，不必再回 close_notify
+        SSL_set_quiet_shutdown(ssl, 1);
+        return 0;
+    case SSL_ERROR_SYSCALL:
+        SSL_set_quiet_shutdown(ssl, 1);
+        if (errno == 0) errno = ECONNRESET;
+        return -1;
+    default:
+        fail(ssl, "SSL_read");
+        errno = EPROTO;
+        return -1;
+    }
+}
+
+ssize_t TlsContext::write(SSL* ssl, const char* data, size_t len) {
+    ERR_clear_error();
+    size_t n = 0;
+    if (SSL_write_ex(ssl, data, len, &n) == 1) return static_cast<ssize_t>(n);
+    switch (SSL_get_error(ssl, 0)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return -1;
+    case SSL_ERROR_SYSCALL:
+        SSL_set_quiet_shutdown(ssl, 1);
+        if (errno == 0) errno = EPIPE;
+        return -1;
+    default:
+        fail(ssl, "SSL_write");
+        errno = EPROTO;
+        return -1;
+    }
+}
+
+void TlsContext::close(SSL* ssl) {
+    if (SSL_is_init_finished(ssl) && !SSL_get_quiet_shutdown(ssl)) {
+        ERR_clear_error();
+        SSL_shutdown(ssl);
+    }
+    SSL_free(ssl);
+}
+
+int TlsContext::ticket_key_cb(SSL*, unsigned char* name, unsigned char* iv, EVP_CIPHER_CTX* cipher,
+                              EVP_MAC_CTX* mac, int enc) {
+    const unsigned char* key = getInstance()->_ticket_key;
+    if (enc) {
+        memcpy(name, key, 16);
+        if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1 ||
+            EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key + 48, iv) != 1) {
+            return -1;
+        }
+    }
+    else {
+        // 不认识的票据退回完整握手
+        if (memcmp(name, key, 16) != 0) return 0;
+        if (EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key + 48, iv) != 1) return -1;
+    }
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, const_cast<unsigned char*>(key + 16), 32),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0),
+        OSSL_PARAM_construct_end(),
+    };
+    return EVP_MAC_CTX_set_params(mac, params) == 1 ? 1 : -1;
+}
+
+void TlsContext::fail(SSL* ssl, const char* what) {
+    if (ssl) SSL_set_quiet_shutdown(ssl, 1);
+    unsigned long err = ERR_get_error();
+    char msg[256] = "unknown error";
+    if (err != 0) ERR_error_string_n(err, msg, sizeof(msg));
+    std::cerr << "[ERROR] " << what << " failed: " << msg << std::endl;
+    ERR_clear_error();
+}
@@ -17,6 +17,10 @@
 #include "Singleton.h"
 #include "Buffer.h"
 #include "HTTPRequest.h"
+#include "TlsContext.h"
+#include "ConnSlab.h"
+#include "Strand.h"
+#include "Poller.h"
 
 struct ConnCtx {
     int client_fd = -1;
@@ -25,29 +29,55 @@ struct ConnCtx {
     Buffer out_buf;
     std::queue<HTTPRequest> pipeline;
     bool keep_alive = true;
+    SSL* ssl = nullptr;        // TLS 连接的 OpenSSL 对象，明文连接为空
+    bool handshaking = false;  // TLS 握手尚未完成
+    bool ktls_send = false;    // 内核已接管发送方向的加密，可以直接对 fd 写
+    Strand strand;             // 同一连接的事件不会同时在两个工作线程上处理
+    bool sending = false;      // 完成式收发：已有 send 在途，新的响应先留在 out_buf
+    bool closing = false;      // 完成式收发：最后的响应连同关闭已交给内核
 };
 
+// 连接表与正在处理事件的线程共同持有，最后一个持有者释放时销毁
+using ConnPtr = std::shared_ptr<ConnCtx>;
+
 class ConnectionManager : public Singleton<ConnectionManager> {
     friend class Singleton<ConnectionManager>;
 
 public:
     ~ConnectionManager();
-    // 注册一个连接
-    void register_conn(int listen_fd, ConnCtx* ctx);
-    // 查找连接上下文
-    ConnCtx* get_conn(int fd);
-    // 移除并释放连接上下文
+    // 注册一个连接；fd 超出连接表范围时返回 false，调用方负责关闭它
+    bool register_conn(int listen_fd, ConnPtr ctx);
+    // 按事件句柄查找连接上下文，fd 已解绑或已被复用时返回空
+    ConnPtr get_conn(uint64_t handle);
+    // 移除连接上下文，最后一个持有者释放时销毁
     void remove_conn(int fd);
+    // 同上，但 fd 已不归本连接所有（可能已关闭并被复用）时，只在句柄仍有效时移除
+    void remove_conn(uint64_t handle);
     // 清空全部连接
     void clear_all();
 
-    void accept_new_conn(int fd, int epfd);
-    void handle_io_event(int fd, uint32_t events, int epfd);
+    // 监听 socket 就绪：接受全部排队的连接
+    void accept_new_conn(int fd, Poller* poller);
+    // 事件循环已接受的新连接（io_uring 的多发 accept）
+    void accept_conn(int client_fd, Poller* poller);
+    // handle 为注册进事件循环时给出的句柄
+    void handle_io_event(uint64_t handle, uint32_t events, Poller* poller);
+    // 完成式收发的 RECV / SEND 事件
+    void handle_completion(const PollEvent& ev, Poller* poller);
     void handle_request(ConnCtx* ctx, HTTPRequest& req);
 private:
+    void add_conn(int client_fd, const sockaddr_storage& client_addr, Poller* poller);
+    // 在连接的执行权内处理一个事件
+    void dispatch_event(ConnCtx* ctx, uint64_t handle, uint32_t events, Poller* poller);
+    // 处理 in_buf 中全部完整的请求，响应追加到 out_buf
+    void process_requests(ConnCtx* ctx);
+    // 没有在途的 send 时把 out_buf 整体交给内核发送
+    void flush_send(ConnCtx* ctx, uint64_t handle, Poller* poller);
+    // 释放 TLS 状态、移除上下文并关闭 fd
+    void close_conn(int fd, ConnCtx* ctx, Poller* poller);
     std::string load_file(const std::string& path);
     bool is_valid_body(const std::string& body, const std::string& content_type);
-    std::string build_http_response(int status_code, const std::string& content_type, const std::string& body);
+    std::string build_http_response(int status_code, const std::string& content_type, const std::string& body, bool keep_alive);
     std::string get_status_text(int code);
     std::string get_mime_type(const std::string& path);
     std::string minify_json(const std::string& json);
@@ -57,6 +87,5 @@ private:
         return std::equal(suffix.rbegin(), suffix.rend(), str.rbegin());
     }
     
-    std::unordered_map<int, ConnCtx*> _connections;
-    std::mutex _mutex;  // 线程池场景下，必须加锁保护
+    ConnSlab<ConnPtr> _slab;  // fd -> 连接上下文
 };
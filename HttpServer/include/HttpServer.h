@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <thread>
 #include <getopt.h>
 #include <cstring>
 #include <cstdlib>
@@ -13,15 +14,22 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/epoll.h>
+#include <sys/un.h>
 #include <fcntl.h>
 #include "ThreadPool.h"
 #include "ConnectionManager.h"
+#include "TlsContext.h"
+#include "Poller.h"
 
 #define MAX_EVENTS 1024
 
 std::string c_ip;
 int c_port;
 int c_threads;
+int c_reactors = 0;       // 事件循环线程数，0 表示单个 epoll 线程 + 线程池
+std::string c_io_engine = "epoll";  // 反应堆线程的事件后端：epoll 或 uring
+std::string c_unix_path;  // 非空时额外监听该 Unix 域套接字
+TlsOptions c_tls_opts;    // 设置了证书时 TCP 监听端口改为 TLS
 
 int set_nonblocking(int fd){
     int flags = fcntl(fd, F_GETFL, 0);
@@ -29,11 +37,72 @@ int set_nonblocking(int fd){
     return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
+// 创建监听 TCP 端口的非阻塞socket，失败返回 -1；reuse_port 时多个socket可以绑定同一地址
+int create_listener(bool reuse_port){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)); // 设置复用socket
+    if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        perror("setsockopt(SO_REUSEPORT)");
+        close(fd);
+        return -1;
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(c_port);
+    inet_pton(AF_INET, c_ip.c_str(), &addr.sin_addr);
+
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        perror("bind/listen");
+        close(fd);
+        return -1;
+    }
+    set_nonblocking(fd); //非阻塞
+    return fd;
+}
+
+// 创建监听在 path 上的 Unix 域套接字，失败返回 -1
+int create_unix_listener(const std::string& path){
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket (unix)");
+        return -1;
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.data(), path.size());
+    unlink(path.c_str()); // 清理上次运行残留的套接字文件
+
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        perror("bind/listen (unix)");
+        close(fd);
+        return -1;
+    }
+    set_nonblocking(fd);
+    return fd;
+}
+
 void parse_args(int argc, char* argv[]){
     static struct option long_opts[] = {
         {"ip",      required_argument, nullptr, 'i'},
         {"port",    required_argument, nullptr, 'p'},
         {"threads", required_argument, nullptr, 't'},
+        {"reactors", required_argument, nullptr, 0 },
+        {"io-engine", required_argument, nullptr, 0 },
+        {"unix",    required_argument, nullptr,  0 },
+        {"tls-cert",            required_argument, nullptr, 0 },
+        {"tls-key",             required_argument, nullptr, 0 },
+        {"tls-session-cache",   required_argument, nullptr, 0 },
+        {"tls-session-timeout", required_argument, nullptr, 0 },
+        {"tls-ticket-key",      required_argument, nullptr, 0 },
+        {"ktls",                required_argument, nullptr, 0 },
         {0, 0, nullptr, 0}
     };
 
@@ -50,15 +119,66 @@ void parse_args(int argc, char* argv[]){
         case 't':
             c_threads = std::atoi(optarg);
             break;
-        case 0:
+        case 0: {
+            std::string name = long_opts[idx].name;
+            if (name == "unix") {
+                c_unix_path = optarg;
+            }
+            else if (name == "reactors") {
+                c_reactors = std::atoi(optarg);
+            }
+            else if (name == "io-engine") {
+                c_io_engine = optarg;
+                if (c_io_engine != "epoll" && c_io_engine != "uring") {
+                    std::cerr << "[ERROR] --io-engine must be epoll or uring" << std::endl;
+                    std::exit(EXIT_FAILURE);
+                }
+            }
+            else if (name == "tls-cert") {
+                c_tls_opts.cert_file = optarg;
+            }
+            else if (name == "tls-key") {
+                c_tls_opts.key_file = optarg;
+            }
+            else if (name == "tls-session-cache") {
+                c_tls_opts.session_cache = std::strtoul(optarg, nullptr, 10);
+            }
+            else if (name == "tls-session-timeout") {
+                c_tls_opts.session_timeout = std::atoi(optarg);
+            }
+            else if (name == "tls-ticket-key") {
+                c_tls_opts.ticket_key_file = optarg;
+            }
+            else if (name == "ktls") {
+                std::string value = optarg;
+                if (value != "on" && value != "off") {
+                    std::cerr << "[ERROR] --ktls must be on or off" << std::endl;
+                    std::exit(EXIT_FAILURE);
+                }
+                c_tls_opts.ktls = value == "on";
+            }
             break;
+        }
         default:
-            std::cerr << "[ERROR] Usage: " << argv[0] << " --ip <IP> --port <PORT> --threads <THREADS>" << std::endl;
+            std::cerr << "[ERROR] Usage: " << argv[0] << " --ip <IP> --port <PORT> --threads <THREADS>|--reactors <N> [--io-engine epoll|uring] [--unix <PATH>]"
+                      << " [--tls-cert <PEM>] [--tls-key <PEM>] [--tls-session-cache <N>] [--tls-session-timeout <SEC>]"
+                      << " [--tls-ticket-key <FILE>] [--ktls on|off]" << std::endl;
         }
     }
 
-    if (c_ip.empty() || c_port <= 0 || c_threads <= 0){
+    if (c_unix_path.size() >= sizeof(sockaddr_un::sun_path)){
+        std::cerr << "[ERROR] Unix socket path too long" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (c_ip.empty() || c_port <= 0 || c_reactors < 0 || (c_threads <= 0 && c_reactors == 0)){
         std::cerr << "[ERROR] Missing required parameters" << std::endl;
         std::exit(EXIT_FAILURE);
     }
+
+    // 环只由创建它的线程提交，线程池模式下各工作线程都要修改关注的事件，只能用 epoll
+    if (c_io_engine == "uring" && c_reactors == 0){
+        std::cerr << "[ERROR] --io-engine uring requires --reactors" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
 }
\ No newline at end of file
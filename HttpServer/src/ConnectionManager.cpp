@@ -4,38 +4,34 @@ ConnectionManager::~ConnectionManager(){
     clear_all();
 }
 
-void ConnectionManager::register_conn(int fd, ConnCtx* ctx){
-    std::lock_guard<std::mutex> lock(_mutex); // 保证线程安全
-    _connections[fd] = ctx;
+bool ConnectionManager::register_conn(int fd, ConnPtr ctx){
+    if (_slab.bind(fd, std::move(ctx)) == 0) {
+        std::cerr << "[ERROR] fd " << fd << " exceeds RLIMIT_NOFILE, not registered" << std::endl;
+        return false;
+    }
     std::cout << "Registered client_fd " << fd << " to epoll" << std::endl;
+    return true;
 }
 
-ConnCtx* ConnectionManager::get_conn(int fd){
-    std::lock_guard<std::mutex> lock(_mutex); // 保证线程安全
-    auto it = _connections.find(fd);
-    return it != _connections.end() ? it->second : nullptr;
+ConnPtr ConnectionManager::get_conn(uint64_t handle){
+    return _slab.get(handle);
 }
 
 void ConnectionManager::remove_conn(int fd){
-    std::lock_guard<std::mutex> lock(_mutex); // 保证线程安全
-    auto it = _connections.find(fd);
-    if (it != _connections.end()) {
-        delete it->second;
-        _connections.erase(it);
-    }
+    _slab.unbind(fd);
+}
+
+void ConnectionManager::remove_conn(uint64_t handle){
+    _slab.unbind(handle);
 }
 
 void ConnectionManager::clear_all(){
-    std::lock_guard<std::mutex> lock(_mutex); // 保证线程安全
-    for (auto& [fd, ctx] : _connections) {
-        delete ctx;
-    }
-    _connections.clear();
+    _slab.clear();
 }
 
-void ConnectionManager::accept_new_conn(int listen_fd, int epfd){
+void ConnectionManager::accept_new_conn(int listen_fd, Poller* poller){
     while(true){
-        sockaddr_in client_addr{};
+        sockaddr_storage client_addr{};
         socklen_t addrlen = sizeof(client_addr);
         int client_fd = accept4(listen_fd, reinterpret_cast<sockaddr*>(&client_addr), &addrlen, SOCK_NONBLOCK);
         if (client_fd < 0) {
@@ -48,114 +44,234 @@ void ConnectionManager::accept_new_conn(int listen_fd, int epfd){
                 break;
             }
         }
+        add_conn(client_fd, client_addr, poller);
+    }
+}
 
-        std::cout << "accept new conn, client_fd = " << client_fd << std::endl;
-
-        // 创建连接上下文 ConnCtx
-        ConnCtx* ctx = new ConnCtx();
-        ctx->client_fd = client_fd;
-        ctx->upstream_fd = -1; // 默认不启用上游
-        ctx->keep_alive = true; // 默认启用 keep-alive，可根据 header 再决定
-        // 注册到全局管理表（例如 map<int, ConnCtx*>）
-        register_conn(client_fd, ctx);
-
-        // 注册进 epoll 监听
-        epoll_event ev{};
-        ev.events = EPOLLIN | EPOLLET;
-        ev.data.fd = client_fd;
-        if (epoll_ctl(epfd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
-            perror("epoll_ctl (add client)");
+void ConnectionManager::accept_conn(int client_fd, Poller* poller){
+    // 多发 accept 不带回对端地址
+    sockaddr_storage client_addr{};
+    socklen_t addrlen = sizeof(client_addr);
+    getpeername(client_fd, reinterpret_cast<sockaddr*>(&client_addr), &addrlen);
+    add_conn(client_fd, client_addr, poller);
+}
+
+void ConnectionManager::add_conn(int client_fd, const sockaddr_storage& client_addr, Poller* poller){
+    std::cout << "accept new conn, client_fd = " << client_fd << std::endl;
+
+    // 创建连接上下文 ConnCtx
+    ConnPtr ctx = std::make_shared<ConnCtx>();
+    ctx->client_fd = client_fd;
+    ctx->upstream_fd = -1; // 默认不启用上游
+    ctx->keep_alive = true; // 默认启用 keep-alive，可根据 header 再决定
+    // Unix 域套接字只供同机的代理使用，始终是明文
+    auto tls = TlsContext::getInstance();
+    if (tls->enabled() && client_addr.ss_family != AF_UNIX) {
+        ctx->ssl = tls->accept(client_fd);
+        if (!ctx->ssl) {
             close(client_fd);
-            remove_conn(client_fd);
-            delete ctx;
-            continue;
+            return;
         }
+        ctx->handshaking = true;
+    }
+    // 注册到全局连接表，事件带着表中的句柄回来
+    if (!register_conn(client_fd, ctx)) {
+        close(client_fd);
+        return;
+    }
 
-        // 可以打印客户端信息（可选）
-        char ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
-        std::cout << "[STATE] New connection from ip: " << ip << ", port: " << ntohs(client_addr.sin_port) << ", fd: " << client_fd << std::endl;
+    // 明文连接在 io_uring 上由内核直接收发，TLS 连接仍按就绪通知经 OpenSSL 读写
+    uint64_t handle = _slab.handle(client_fd);
+    bool watched = poller->completion() && !ctx->ssl ? poller->recv(client_fd, handle)
+                                                     : poller->add(client_fd, handle, EPOLLIN | EPOLLET);
+    if (!watched) {
+        perror("poller add (client)");
+        remove_conn(client_fd);
+        close(client_fd);
+        return;
     }
-}
 
-void ConnectionManager::handle_io_event(int fd, uint32_t events, int epfd) {
-    ConnCtx* ctx = get_conn(fd);
-    if (!ctx){
-        std::cerr << "[ERROR] no context for fd" << std::endl;
+    // 可以打印客户端信息（可选）
+    if (client_addr.ss_family == AF_UNIX) {
+        std::cout << "[STATE] New connection from unix socket, fd: " << client_fd << std::endl;
         return;
-    };
+    }
+    const sockaddr_in* in = reinterpret_cast<const sockaddr_in*>(&client_addr);
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &in->sin_addr, ip, sizeof(ip));
+    std::cout << "[STATE] New connection from ip: " << ip << ", port: " << ntohs(in->sin_port) << ", fd: " << client_fd << std::endl;
+}
 
-    // 读事件
-    if (events & EPOLLIN) {
-        char buf[4096];
-        ssize_t n = read(fd, buf, sizeof(buf));
-        if (n <= 0) {
-            if (n < 0) perror("read");
-            close(fd);
-            remove_conn(fd);
+void ConnectionManager::handle_io_event(uint64_t handle, uint32_t events, Poller* poller) {
+    // fd 已关闭或已被新连接复用：旧句柄的事件直接丢弃
+    ConnPtr conn = get_conn(handle);
+    if (!conn) return;
+
+    // 边缘触发的读写事件可能同时落到不同工作线程：连接正忙时把事件留给正在处理它的线程
+    if (!conn->strand.enter(handle, events)) return;
+    do {
+        // 排队期间连接可能已关闭
+        if (get_conn(handle) != conn) continue;
+        dispatch_event(conn.get(), handle, events, poller);
+    } while (conn->strand.next(handle, events));
+}
+
+void ConnectionManager::handle_completion(const PollEvent& ev, Poller* poller) {
+    // 完成事件只在反应堆线程上处理，同一连接的事件不会并发，不必经过 strand
+    ConnPtr conn = get_conn(ev.handle);
+    if (!conn) return;
+    ConnCtx* ctx = conn.get();
+    int fd = ConnSlab<ConnPtr>::fd_of(ev.handle);
+
+    if (ev.kind == PollEvent::SEND) {
+        ctx->sending = false;
+        if (ctx->closing) {
+            // fd 已由内核接着关闭，可能已被其他线程的新连接复用：按句柄移除，不会误删新连接
+            remove_conn(ev.handle);
             return;
         }
+        if (ev.res < 0) {
+            errno = -ev.res;
+            perror("send");
+            close_conn(fd, ctx, poller);
+            return;
+        }
+        flush_send(ctx, ev.handle, poller);
+        return;
+    }
 
-        ctx->in_buf.append(buf, n);
-
-        // 解析 HTTP 请求
-        while (true) {
-            auto view = ctx->in_buf.peek();
-            if (view.empty()) break;
+    // 最后的响应已交出，之后收到的请求不再处理
+    if (ctx->closing) return;
+    if (ev.res <= 0) {
+        if (ev.res < 0) {
+            errno = -ev.res;
+            perror("recv");
+        }
+        close_conn(fd, ctx, poller);
+        return;
+    }
+    ctx->in_buf.append(ev.data, ev.res);
+    process_requests(ctx);
+    flush_send(ctx, ev.handle, poller);
+}
 
-            HTTPRequest req;
-            size_t consumed = 0;
-            if (!req.parse(view.data(), view.size(), consumed)) break;
+void ConnectionManager::dispatch_event(ConnCtx* ctx, uint64_t handle, uint32_t events, Poller* poller) {
+    int fd = ConnSlab<ConnPtr>::fd_of(handle);
 
-            ctx->in_buf.consume(consumed);
-            ctx->pipeline.push(req);
+    // TLS 握手未完成时只推进握手
+    if (ctx->handshaking) {
+        TlsStatus status = TlsContext::handshake(ctx->ssl);
+        if (status == TlsStatus::FAILED) {
+            close_conn(fd, ctx, poller);
+            return;
         }
+        if (status != TlsStatus::DONE) {
+            poller->mod(fd, handle, EPOLLIN | EPOLLET | (status == TlsStatus::WANT_WRITE ? EPOLLOUT : 0u));
+            return;
+        }
+        ctx->handshaking = false;
+        ctx->ktls_send = TlsContext::kernel_send(ctx->ssl);
+        TlsContext::getInstance()->on_established(ctx->ssl, fd);
+        // 客户端可能紧跟着握手就发来了请求，边缘触发不会再通知一次
+        events |= EPOLLIN;
+    }
 
-        // 每个解析成功的 HTTPRequest，生成对应响应
-        while (!ctx->pipeline.empty()) {
-            HTTPRequest& req = ctx->pipeline.front();
-            handle_request(ctx, req);  // 👈【重点!!!】本地处理，生成 out_buf
-            ctx->pipeline.pop();
+    // 读事件
+    if (events & EPOLLIN) {
+        char buf[4096];
+        // 边缘触发，必须读到 EAGAIN 为止
+        while (true) {
+            ssize_t n = ctx->ssl ? TlsContext::read(ctx->ssl, buf, sizeof(buf)) : read(fd, buf, sizeof(buf));
+            if (n > 0) {
+                ctx->in_buf.append(buf, n);
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n < 0) perror("read");
+            close_conn(fd, ctx, poller);
+            return;
         }
 
+        process_requests(ctx);
+
         // 注册可写
-        epoll_event ev{};
-        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
-        ev.data.fd = fd;
-        epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+        poller->mod(fd, handle, EPOLLIN | EPOLLOUT | EPOLLET);
     }
 
     // 写事件
     if (events & EPOLLOUT) {
         while (!ctx->out_buf.empty()) {
-            ssize_t n = write(fd, ctx->out_buf.data(), ctx->out_buf.size());
+            // 内核接管了加密时直接写 fd
+            ssize_t n = ctx->ssl && !ctx->ktls_send ? TlsContext::write(ctx->ssl, ctx->out_buf.data(), ctx->out_buf.size())
+                                                    : write(fd, ctx->out_buf.data(), ctx->out_buf.size());
             if (n < 0) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK) break;
                 perror("write");
-                close(fd);
-                remove_conn(fd);
+                close_conn(fd, ctx, poller);
                 return;
             }
             ctx->out_buf.consume(n);
         }
 
         if (ctx->out_buf.empty()) {
-            epoll_event ev{};
-            ev.events = EPOLLIN | EPOLLET;
-            ev.data.fd = fd;
-            epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+            poller->mod(fd, handle, EPOLLIN | EPOLLET);
 
             if (!ctx->keep_alive) {
-                close(fd);
-                remove_conn(fd);
+                close_conn(fd, ctx, poller);
+                return;
             }
         }
     }
 
     if (events & (EPOLLERR | EPOLLHUP)) {
-        close(fd);
-        remove_conn(fd);
+        close_conn(fd, ctx, poller);
+    }
+}
+
+void ConnectionManager::process_requests(ConnCtx* ctx) {
+    // 解析 HTTP 请求
+    while (true) {
+        auto view = ctx->in_buf.peek();
+        if (view.empty()) break;
+
+        HTTPRequest req;
+        size_t consumed = 0;
+        if (!req.parse(view.data(), view.size(), consumed)) break;
+
+        ctx->in_buf.consume(consumed);
+        ctx->pipeline.push(req);
+    }
+
+    // 每个解析成功的 HTTPRequest，生成对应响应
+    while (!ctx->pipeline.empty()) {
+        HTTPRequest& req = ctx->pipeline.front();
+        handle_request(ctx, req);  // 👈【重点!!!】本地处理，生成 out_buf
+        ctx->pipeline.pop();
+    }
+}
+
+void ConnectionManager::flush_send(ConnCtx* ctx, uint64_t handle, Poller* poller) {
+    if (ctx->sending || ctx->out_buf.empty()) return;
+    int fd = ConnSlab<ConnPtr>::fd_of(handle);
+    // 不保持连接时，最后的响应与关闭链接在一起，一次提交
+    ctx->closing = !ctx->keep_alive;
+    ctx->sending = true;
+    if (!poller->send(fd, handle, ctx->out_buf.read_all(), ctx->closing)) {
+        ctx->closing = false;
+        close_conn(fd, ctx, poller);
+    }
+}
+
+void ConnectionManager::close_conn(int fd, ConnCtx* ctx, Poller* poller) {
+    // close_notify 要在关闭 fd 之前发出
+    if (ctx->ssl) {
+        TlsContext::close(ctx->ssl);
+        ctx->ssl = nullptr;
     }
+    // 先解除映射再关闭，避免 fd 被新连接复用后误删新映射
+    remove_conn(fd);
+    poller->forget(fd);
+    close(fd);
 }
 
 void ConnectionManager::handle_request(ConnCtx* ctx, HTTPRequest& req) {
@@ -215,7 +331,9 @@ void ConnectionManager::handle_request(ConnCtx* ctx, HTTPRequest& req) {
         response_content_type = "text/html";
     }
 
-    std::string response = build_http_response(status_code, response_content_type, body);
+    // 客户端（如代理的连接池）要求保持连接时不主动关闭
+    if (!req.keep_alive()) ctx->keep_alive = false;
+    std::string response = build_http_response(status_code, response_content_type, body, ctx->keep_alive);
     ctx->out_buf.append(response.data(), response.size());
 }
 
@@ -238,12 +356,12 @@ bool ConnectionManager::is_valid_body(const std::string& body, const std::string
     return false;
 }
 
-std::string ConnectionManager::build_http_response(int status_code, const std::string& content_type, const std::string& body) {
+std::string ConnectionManager::build_http_response(int status_code, const std::string& content_type, const std::string& body, bool keep_alive) {
     std::ostringstream oss;
     oss << "HTTP/1.1 " << status_code << " " << get_status_text(status_code) << "\r\n"
         << "Content-Type: " << content_type << "\r\n"
         << "Content-Length: " << body.size() << "\r\n"
-        << "Connection: close\r\n"
+        << "Connection: " << (keep_alive ? "keep-alive" : "close") << "\r\n"
         << "\r\n"
         << body;
     return oss.str();
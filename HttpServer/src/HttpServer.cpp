@@ -1,61 +1,117 @@
 #include "HttpServer.h"
 
+// 反应堆线程：独占一个 TCP 监听socket和一个事件循环，接受的连接从头到尾都在本线程处理，事件不经线程池。
+// Unix 域套接字不支持 SO_REUSEPORT 分发，各线程共用一个，新连接只交给其中一个线程
+void run_reactor(int listen_fd, int unix_listen_fd){
+    // io_uring 的环只能由创建它的线程使用，在本线程内创建
+    std::unique_ptr<Poller> poller = Poller::create(c_io_engine, MAX_EVENTS);
+    if (!poller || !poller->add_listener(listen_fd) || (unix_listen_fd >= 0 && !poller->add_listener(unix_listen_fd, true))) {
+        std::cerr << "[ERROR] Failed to start " << c_io_engine << " event loop" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::shared_ptr<ConnectionManager> ConnMgr = ConnectionManager::getInstance();
+
+    std::vector<PollEvent> events;
+    while (true) {
+        int n = poller->wait(events);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("poller wait");
+            break;
+        }
+
+        for (const PollEvent& ev : events) {
+            uint64_t handle = ev.handle;
+            if (ev.kind == PollEvent::ACCEPT) {
+                if (ev.res >= 0) {
+                    ConnMgr->accept_conn(ev.res, poller.get());
+                }
+                else {
+                    errno = -ev.res;
+                    perror("accept");
+                }
+            }
+            else if (ev.kind != PollEvent::READY) {
+                ConnMgr->handle_completion(ev, poller.get());
+            }
+            else if (handle == static_cast<uint64_t>(listen_fd) || handle == static_cast<uint64_t>(unix_listen_fd)) {
+                ConnMgr->accept_new_conn(static_cast<int>(handle), poller.get());
+            }
+            else {
+                ConnMgr->handle_io_event(handle, ev.events, poller.get());
+            }
+        }
+    }
+}
+
 int main(int argc, char* argv[]){
     parse_args(argc, argv);
 
-    // 2.创建监听socket
-    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_fd < 0) {
-        perror("socket");
-        return EXIT_FAILURE;
+    // 2.创建监听socket：反应堆模式下每个事件循环线程各一个，由内核按连接分给它们
+    std::vector<int> listen_fds;
+    for (int i = 0; i < std::max(1, c_reactors); ++i) {
+        int listen_fd = create_listener(c_reactors > 0);
+        if (listen_fd < 0) return EXIT_FAILURE;
+        listen_fds.push_back(listen_fd);
     }
 
-    int reuse = 1;
-    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)); // 设置复用socket
-
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(c_port);
-    inet_pton(AF_INET, c_ip.c_str(), &addr.sin_addr);
+    // 可选的 Unix 域套接字监听，供同机的代理绕过 TCP 协议栈
+    int unix_listen_fd = -1;
+    if (!c_unix_path.empty()) {
+        unix_listen_fd = create_unix_listener(c_unix_path);
+        if (unix_listen_fd < 0) return EXIT_FAILURE;
+        std::cout << "[INIT] Listening on unix socket " << c_unix_path << std::endl;
+    }
 
-    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
-        perror("bind/listen");
-        close(listen_fd);
+    // 3.懒汉模式初始化
+    std::shared_ptr<ConnectionManager> ConnMgr = ConnectionManager::getInstance();
+    if (!ConnMgr){
+        std::cerr << "[ERROR] Failed to create ConnectionManager" << std::endl;
         return EXIT_FAILURE;
     }
-    set_nonblocking(listen_fd); //非阻塞
 
-    // 3.初始化epoll
-    int epfd = epoll_create1(0);
-    if (epfd < 0) {
-        perror("epoll_create1");
+    c_tls_opts.session_id_context = "http-server";
+    if (!c_tls_opts.cert_file.empty() && !TlsContext::getInstance()->start(c_tls_opts)) {
         return EXIT_FAILURE;
     }
 
-    epoll_event ev{};
-    ev.events = EPOLLIN | EPOLLET;
-    ev.data.fd = listen_fd;
-    epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev);
+    std::cout << "[INIT] ProxyServer has started, ip: " << c_ip << ", port: " << c_port << ", "
+              << (c_reactors > 0 ? "reactors: " : "thread nums: ") << (c_reactors > 0 ? c_reactors : c_threads)
+              << ", io engine: " << (c_reactors > 0 ? c_io_engine : "epoll") << std::endl;
 
-    // 4.懒汉模式初始化
-    std::shared_ptr<ThreadPool> pool = ThreadPool::getInstance();
-    if (!pool) {
-        std::cerr << "[ERROR] Failed to create thread pool" << std::endl;
-        return EXIT_FAILURE;
+    // 4.转起来了
+    if (c_reactors > 0) {
+        std::vector<std::thread> reactors;
+        for (int listen_fd : listen_fds) reactors.emplace_back(run_reactor, listen_fd, unix_listen_fd);
+        for (auto& reactor : reactors) reactor.join();
+        for (int listen_fd : listen_fds) close(listen_fd);
+        if (unix_listen_fd >= 0) {
+            close(unix_listen_fd);
+            unlink(c_unix_path.c_str());
+        }
+        return 0;
     }
 
-    std::shared_ptr<ConnectionManager> ConnMgr = ConnectionManager::getInstance();
-    if (!ConnMgr){
-        std::cerr << "[ERROR] Failed to create ConnectionManager" << std::endl;
+    int listen_fd = listen_fds.front();
+    std::unique_ptr<Poller> poller = Poller::create("epoll", MAX_EVENTS);
+    if (!poller || !poller->add_listener(listen_fd) || (unix_listen_fd >= 0 && !poller->add_listener(unix_listen_fd))) {
         return EXIT_FAILURE;
     }
 
-    std::cout << "[INIT] ProxyServer has started, ip: " << c_ip << ", port: " << c_port << ", thread nums: " << c_threads << std::endl;
+    std::shared_ptr<ThreadPool> pool = ThreadPool::getInstance();
+    if (!pool) {
+        std::cerr << "[ERROR] Failed to create thread pool" << std::endl;
+        return EXIT_FAILURE;
+    }
 
-    // 5.转起来了
-    std::vector<epoll_event> events(MAX_EVENTS);
+    // 任务只能捕获裸指针和整数，才放得进线程池的定长槽位；
+    // ConnectionManager 单例一直存活到进程退出，经静态指针引用，不占捕获
+    static ConnectionManager* mgr = ConnMgr.get();
+    Poller* p = poller.get();
+    std::vector<PollEvent> events;
     while (true) {
-        int n = epoll_wait(epfd, events.data(), MAX_EVENTS, -1);
+        int n = poller->wait(events);
         if (n < 0) {
             if (errno == EINTR) continue;
             perror("epoll_wait");
@@ -64,25 +120,29 @@ int main(int argc, char* argv[]){
         
         std::cout << "[STATE] epoll wait: got " << n << " events" << std::endl;
 
-        for (int i = 0; i < n; ++i) {
-            int fd = events[i].data.fd;
-            uint32_t evs = events[i].events;
+        for (const PollEvent& ev : events) {
+            uint64_t handle = ev.handle;
+            uint32_t evs = ev.events;
 
-            if (fd == listen_fd) { //新连接
-                pool->commit([ConnMgr, listen_fd, epfd]() {
-                    ConnMgr->accept_new_conn(listen_fd, epfd);
+            if (handle == static_cast<uint64_t>(listen_fd) || handle == static_cast<uint64_t>(unix_listen_fd)) { //新连接
+                int fd = static_cast<int>(handle);
+                pool->post([p, fd]() {
+                    mgr->accept_new_conn(fd, p);
                 });
             }
             else { //已有连接
-                pool->commit([ConnMgr, fd, evs, epfd]() {
-                    ConnMgr->handle_io_event(fd, evs, epfd);
+                pool->post([p, handle, evs]() {
+                    mgr->handle_io_event(handle, evs, p);
                 });
             }
         }
     }
 
-    // 6.清理
+    // 5.清理
     close(listen_fd);
-    close(epfd);
+    if (unix_listen_fd >= 0) {
+        close(unix_listen_fd);
+        unlink(c_unix_path.c_str());
+    }
     return 0;
-}
\ No newline at end of file
+}
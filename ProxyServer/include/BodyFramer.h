@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+/**
+ * 增量识别消息体的边界：字节可以分多次送入，不需要整个消息体都在内存中。
+ * 支持 Content-Length 与分块编码，分块编码的块头、块尾与尾部字段都计入消息体，
+ * 调用方按 used 原样转发即可。
+ */
+class BodyFramer {
+public:
+    // 按 Content-Length 分帧，长度为 0 时直接结束
+    void expect_length(size_t length);
+    // 按分块编码分帧
+    void expect_chunked();
+    /**
+     * 扫描 data[0..len)。
+     * @param used    输出属于本消息体的字节数，消息体结束后其余字节属于下一条消息
+     * @param payload 非空时追加消息体的实际内容（去掉块头、块尾与尾部字段）
+     * @return 分块编码格式错误时返回 false
+     */
+    bool feed(const char* data, size_t len, size_t& used, std::string* payload = nullptr);
+    bool done() const { return _state == State::DONE; }
+
+private:
+    enum class State { LENGTH, CHUNK_SIZE, CHUNK_DATA, CHUNK_CRLF, TRAILER, DONE };
+
+    State _state = State::DONE;
+    size_t _remaining = 0;  // LENGTH / CHUNK_DATA 剩余的字节数，CHUNK_CRLF 剩余的 CRLF 字节数
+    std::string _line;      // 尚未读到行尾的块大小行或尾部字段行
+};
@@ -9,6 +9,8 @@ public:
     void append(const char* data, size_t len);
     std::string read_until(const std::string& delimiter);
     std::string read_all();
+    // 不复制地取走全部字节，缓冲区随之清空
+    std::vector<char> take();
     void consume(size_t n);
     bool empty() const;
     size_t size() const;
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include "Singleton.h"
+#include "HTTPRequest.h"
+#include "HTTPResponse.h"
+
+// 响应压缩配置
+struct CompressOptions {
+    int level = 0;                  // 负载正常时的压缩级别（1-9），0 表示关闭压缩
+    size_t min_bytes = 1024;        // 消息体小于该字节数时不压缩
+    // 可压缩的 Content-Type，以 / 结尾的按前缀匹配；+json / +xml 结尾的类型总是可压缩
+    std::vector<std::string> types{"text/", "application/json", "application/javascript",
+                                   "application/xml", "image/svg+xml"};
+    bool pool_backlog = true;       // 把线程池的排队长度计入负载；反应堆模式下没有共享队列，只看 CPU
+};
+
+enum class Encoding { IDENTITY, GZIP, ZSTD };
+
+// 流式压缩器：输入消息体原文，输出压缩后的字节
+class StreamEncoder {
+public:
+    enum class Flush {
+        NONE,    // 允许压缩器攒数据
+        SYNC,    // 把已输入的数据全部输出，客户端可以立即解出
+        FINISH,  // 结束压缩流
+    };
+
+    // 创建指定编码的压缩器，不支持的编码返回 nullptr
+    static std::unique_ptr<StreamEncoder> create(Encoding encoding, int level);
+    virtual ~StreamEncoder() = default;
+    // 压缩 data[0..len) 并把产生的输出追加到 out；出错返回 false
+    virtual bool write(const char* data, size_t len, std::string& out, Flush flush) = 0;
+};
+
+/**
+ * 在代理中压缩上游发来的未压缩响应：按客户端的 Accept-Encoding 选择 zstd 或 gzip，
+ * 只压缩类型合适且不太小的消息体。压缩级别随线程池排队长度与进程 CPU 占用自动降低。
+ */
+class Compressor : public Singleton<Compressor> {
+    friend class Singleton<Compressor>;
+public:
+    void start(const CompressOptions& opts);
+    bool enabled() const { return _opts.level > 0; }
+
+    /**
+     * 选择响应使用的编码。
+     * @param body_size 消息体字节数，流式转发时取 Content-Length，未知时传 SIZE_MAX
+     * @return 不压缩时返回 IDENTITY
+     */
+    Encoding choose(const HTTPRequest& req, const HTTPResponse& resp, size_t body_size) const;
+    /**
+     * 压缩一条完整响应。
+     * @param raw 响应的原始字节，头部行取自这里
+     * @return 压缩后的响应写入 out；不需要压缩或压缩没有变小时返回 false
+     */
+    bool compress(const HTTPRequest& req, const HTTPResponse& resp, std::string_view raw, std::string& out);
+    /**
+     * 流式转发前调用：需要压缩时改写响应头（改为分块编码）并返回压缩器。
+     * @param head 原响应头（含结尾空行）
+     * @return 不压缩时返回 nullptr，out_head 不变
+     */
+    std::unique_ptr<StreamEncoder> start_stream(const HTTPRequest& req, const HTTPResponse& resp,
+                                                std::string_view head, std::string& out_head);
+
+private:
+    // 按负载调整后的压缩级别
+    int level();
+    // 至多每个采样周期更新一次负载与压缩级别
+    void sample_load();
+    // 去掉长度、分帧与编码相关的头部，加上 Content-Encoding、Vary 和新的分帧头
+    static std::string rewrite_head(std::string_view head, Encoding encoding, const std::string& framing);
+
+    CompressOptions _opts;
+    std::atomic<int> _level{0};
+    std::mutex _sample_mutex;
+    std::chrono::steady_clock::time_point _sampled_at;
+    int64_t _cpu_ns = 0;  // 上次采样时进程累计的 CPU 时间
+};
@@ -1,10 +1,13 @@
 #pragma once
 
 #include <iostream>
-#include <queue>
+#include <deque>
 #include <unordered_map>
+#include <unordered_set>
 #include <mutex>
 #include <memory>
+#include <chrono>
+#include <vector>
 #include <sys/socket.h>
 #include <sys/epoll.h>
 #include <sys/types.h>
@@ -13,37 +16,292 @@
 #include "Singleton.h"
 #include "Buffer.h"
 #include "HTTPRequest.h"
+#include "HTTPResponse.h"
+#include "UpstreamManager.h"
+#include "ResponseCache.h"
+#include "BodyFramer.h"
+#include "Compressor.h"
+#include "Router.h"
+#include "Mirror.h"
+#include "TlsContext.h"
+#include "ConnSlab.h"
+#include "Strand.h"
+#include "Poller.h"
 
-struct ConnCtx {
+// eventfd 唤醒器：所有持有者释放后才关闭，唤醒方不会写到已被复用的 fd
+struct Waker {
+    int fd = -1;
+    ~Waker() { if (fd >= 0) close(fd); }
+    void wake() const {
+        uint64_t one = 1;
+        if (write(fd, &one, sizeof(one)) < 0) {}
+    }
+};
+
+// 同一缓存键上并发未命中的请求合并为一次上游请求：领头请求取回响应并逐段发布，等待者各自复制
+struct Flight {
+    std::mutex mutex;
+    bool committed = false;   // 领头请求的最终响应头已到
+    bool shareable = false;   // 响应可以给其他客户端（与能否缓存同一标准）
+    bool done = false;        // 响应已完整发布
+    bool failed = false;      // 领头请求失败或被放弃
+    std::vector<std::pair<std::string, std::string>> vary;  // 领头请求中 Vary 所列请求头的值
+    std::string data;         // 已发布的响应字节
+    std::vector<std::shared_ptr<Waker>> waiters;
+};
+
+// 不经 out_buf 复制、直接从原处写给客户端的一段字节；owner 保证发送期间这段内存有效
+struct PinnedBytes {
+    std::shared_ptr<const void> owner;
+    std::string_view data;
+    explicit operator bool() const { return owner != nullptr; }
+};
+
+// 一组连续的零拷贝 send：内核按调用次数给每次 send 编号，全部完成通知到达后才释放 owner
+struct ZerocopySend {
+    uint32_t first = 0;    // 第一次 send 的编号
+    uint32_t count = 0;    // send 次数
+    uint32_t pending = 0;  // 尚未收到完成通知的次数
+    std::shared_ptr<const void> owner;
+};
+
+// 一条客户端请求及其上游交换的状态
+struct Exchange {
+    ~Exchange();
+
+    HTTPRequest req;
+    const Route* route = nullptr; // 路由选出的上游池与超时
+    int upstream_fd = -1;         // 从连接池借出的上游连接，未转发或已结束时为 -1
+    std::unique_ptr<ConnectRace> race;  // 多地址竞速中：候选 fd 都在事件循环里，胜出者成为 upstream_fd
+    Backend* backend = nullptr;   // 选中的后端
+    std::chrono::steady_clock::time_point start;  // 转发时刻
+    int attempts = 0;             // 已失败的上游尝试次数
+    Backend* failed_backend = nullptr;  // 上一次失败的后端，重试时尽量避开
+    bool dispatched = false;      // 已发往上游或已直接生成响应
+    bool done = false;            // 响应已完整，等待按请求顺序写回客户端
+    bool resolving = false;       // CONNECT 目标正在后台解析，解析结束后由唤醒器继续
+    bool header_checked = false;  // 已检查过响应头能否走 splice
+    bool splicing = false;        // 头部已写回客户端，消息体经管道在内核中转发
+    size_t body_remaining = 0;    // splice 模式下尚未从上游读出的消息体字节数
+    bool streaming = false;       // 头部已写回客户端，消息体边收边移入 out_buf
+    BodyFramer body;              // 流式模式下响应消息体的分帧状态
+    std::unique_ptr<StreamEncoder> encoder;  // 流式模式下压缩消息体，头部已改为分块编码
+    int status = 0;               // splice / 流式模式下的响应状态码
+    bool reusable = false;        // splice / 流式模式下消息体结束后上游连接能否复用
+    bool read_paused = false;     // 缓冲超过高水位，已停止读上游
+    size_t buffer_limit = 0;      // 要进缓存的响应可以缓冲到的字节数，0 表示按高水位
+    bool uploading = false;       // 请求消息体正从 in_buf 流式转发，尚未转发完
+    bool body_sent = false;       // 已有消息体字节发给上游，不能再重试
+    BodyFramer upload;            // 流式转发的请求消息体的分帧状态
+    Buffer upstream_in_buf;       // from upstream
+    std::string forward_head;     // 转发时追加的头部行（X-Forwarded-For、Via 等）
+    std::vector<iovec> upstream_iov;  // to upstream：指向 req 的原始字节与 forward_head
+    size_t upstream_iov_pos = 0;  // 已写完的 iovec 数，部分写出的项已原地前移
+    Buffer response;              // 完整响应，轮到它时整体移入 out_buf
+
+    // 到这一时刻上游仍未开始响应就发出对冲请求，max 表示不再对冲
+    std::chrono::steady_clock::time_point hedge_at = std::chrono::steady_clock::time_point::max();
+    // 到这一时刻上游仍未开始响应就回 504，max 表示不限
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    std::unique_ptr<Exchange> hedge;  // 发往另一个后端的对冲请求，与本请求竞速
+    Exchange* parent = nullptr;       // 对冲请求所属的原请求
+    CacheEntryPtr cached;             // 已过期的缓存条目，请求已带上它的校验器
+    PinnedBytes pinned;               // 缓存命中的大消息体（磁盘映射区或内存条目），response 只有头部
+
+    std::shared_ptr<Flight> flight;   // 所在的合并请求
+    bool leader = false;              // 由本请求向上游取响应
+    bool collapsed = false;           // 已参与过合并，重新转发时单独发往上游
+    size_t flight_offset = 0;         // 领头请求已发布 / 等待者已取走的字节数
+};
+
+// CONNECT 隧道一个方向的状态：src 读出的字节经管道写入 dst
+struct TunnelPipe {
+    int fds[2] = {-1, -1};
+    size_t pending = 0;   // 管道中尚未写给 dst 的字节数
+    bool eof = false;     // src 已读到 EOF
+    bool shut = false;    // 已把 EOF 以 shutdown(SHUT_WR) 传给 dst
+};
+
+// 一个客户端连接的上下文，客户端 fd 与其借出的上游 fd 共享同一个上下文
+struct ConnCtx : std::enable_shared_from_this<ConnCtx> {
+    Strand strand;            // 串行化同一连接上各 fd 的事件处理
+    bool closed = false;      // 已关闭，排队中的旧事件直接丢弃
     int client_fd = -1;
-    int upstream_fd = -1;
+    std::string client_ip;    // 用于 X-Forwarded-For
+    SSL* ssl = nullptr;       // TLS 连接的 OpenSSL 对象，明文连接为空
+    bool handshaking = false; // TLS 握手尚未完成
+    bool ktls_send = false;   // 内核已接管发送方向的加密，可以直接对 client_fd 写与 splice
+    bool ktls_recv = false;   // 内核已接管接收方向的解密，隧道可以直接 splice 客户端的数据
+    bool completion = false;  // 客户端 fd 走完成式收发（io_uring 上的明文连接），不 splice 也不零拷贝
+    bool sending = false;     // 完成式收发：已有 send 在途，新的字节先留在 out_buf
+    bool recv_stopped = false;  // 完成式收发：因 read_paused 已停止接收
     Buffer in_buf;
     Buffer out_buf;
-    Buffer upstream_in_buf;   // from upstream
-    Buffer upstream_out_buf;  // to upstream
-    std::queue<HTTPRequest> pipeline;
+    bool read_paused = false;     // in_buf 或 out_buf 超过高水位，已停止读客户端
+    Exchange* upload = nullptr;   // 正在流式转发消息体的请求（总在管线末尾），转发完之前不解析后续请求
+    size_t upload_scanned = 0;    // in_buf 开头已确认属于上传消息体、尚未写给上游的字节数
+    std::deque<std::unique_ptr<Exchange>> pipeline;  // 按请求顺序排列，队首最先写回
     bool keep_alive = true;
+    int timer_fd = -1;            // 对冲、竞速与上游超时共用的定时器，首次需要时创建
+    std::chrono::steady_clock::time_point timer_at = std::chrono::steady_clock::time_point::max();
+    int pipe_fds[2] = {-1, -1};   // splice 用的管道，首次使用时创建
+    size_t pipe_pending = 0;      // 管道中尚未写给客户端的字节数
+    int tunnel_fd = -1;           // CONNECT 隧道的上游 fd，建立后连接只做字节转发
+    TunnelPipe to_upstream;
+    TunnelPipe to_client;
+    std::shared_ptr<Waker> waker; // 合并请求有新数据或隧道目标解析结束时唤醒本连接，首次等待时创建
+    PinnedBytes pinned;           // out_buf 写完后直接发送的字节：缓存命中的消息体或大的缓冲响应
+    size_t pinned_sent = 0;
+    bool zerocopy = false;        // 已在客户端 fd 上开启 SO_ZEROCOPY
+    bool zerocopy_off = false;    // 不再用零拷贝发送：内核不支持或已退回复制
+    uint32_t zerocopy_seq = 0;    // 下一次零拷贝 send 的编号
+    std::deque<ZerocopySend> zerocopy_sends;  // 内核仍在引用的内存
+    bool lingering = false;       // 已关闭但零拷贝发送未完成：client_fd 留到完成通知全部到达
 };
 
+using ConnPtr = std::shared_ptr<ConnCtx>;
+
 class ConnectionManager : public Singleton<ConnectionManager> {
     friend class Singleton<ConnectionManager>;
 
 public:
     ~ConnectionManager();
-    // 注册一个连接
-    void register_conn(int listen_fd, ConnCtx* ctx);
-    // 查找连接上下文
-    ConnCtx* get_conn(int fd);
-    // 移除并释放连接上下文
+    // 注册一个连接；fd 超出连接表范围时返回 false，调用方负责关闭它
+    bool register_conn(int listen_fd, ConnPtr ctx);
+    // 按事件句柄查找连接上下文，fd 已解绑或已被复用时返回空
+    ConnPtr get_conn(uint64_t handle);
+    // 解除 fd 与上下文的映射，上下文在最后一个持有者释放时销毁
     void remove_conn(int fd);
     // 清空全部连接
     void clear_all();
 
-    void accept_new_conn(int fd, int epfd);
-    void handle_io_event(int fd, uint32_t events, int epfd);
-    int connect_to_upstream(const std::string& ip, int port);
+    // 同一客户端连接上最多同时在途的管线请求数
+    void set_pipeline_depth(size_t depth);
+    // 剩余消息体不小于该字节数时改用 splice 转发，0 表示关闭
+    void set_splice_threshold(size_t bytes);
+    /**
+     * 不小于该字节数的缓存消息体与缓冲响应直接从原处以 MSG_ZEROCOPY 发送，
+     * 内存保留到内核的完成通知到达；0 表示关闭。
+     */
+    void set_zerocopy_threshold(size_t bytes);
+    /**
+     * 设置缓冲的高低水位：请求或响应缓冲超过 high 时改为边收边转发，
+     * 对端的输出缓冲超过 high 时停止读来源，降到 low 以下再恢复。
+     */
+    void set_watermarks(size_t high, size_t low);
+    /**
+     * 设置允许 CONNECT 的目标端口。
+     * @param spec 逗号分隔的端口列表，"*" 表示不限制，空串表示禁用 CONNECT。
+     * @return 端口无法解析时返回 false。
+     */
+    bool set_connect_ports(const std::string& spec);
+
+    // 监听 socket 就绪：接受全部排队的连接
+    void accept_new_conn(int fd, Poller* poller);
+    // 事件循环已接受的新连接（io_uring 的多发 accept）
+    void accept_conn(int client_fd, Poller* poller);
+    // handle 为注册进事件循环时给出的句柄
+    void handle_io_event(uint64_t handle, uint32_t events, Poller* poller);
+    // 完成式收发的 RECV / SEND 事件
+    void handle_completion(const PollEvent& ev, Poller* poller);
 
 private:
-    std::unordered_map<int, ConnCtx*> _connections;
-    std::mutex _mutex;  // 线程池场景下，必须加锁保护
+    void add_conn(int client_fd, const sockaddr_in& client_addr, Poller* poller);
+    // 在连接的执行权内按 fd 分派一个事件
+    void dispatch_event(ConnCtx* ctx, int fd, uint32_t events, Poller* poller);
+    void handle_client_event(ConnCtx* ctx, uint32_t events, Poller* poller);
+    // 推进 TLS 握手；握手完成时返回 true，未完成或失败（已关闭连接）时返回 false
+    bool advance_handshake(ConnCtx* ctx, Poller* poller);
+    void handle_upstream_event(ConnCtx* ctx, Exchange* ex, uint32_t events, Poller* poller);
+    Exchange* find_exchange(ConnCtx* ctx, int upstream_fd);
+    // 从 in_buf 解析请求放入管线；不完整的请求超过高水位时只解析头部，消息体改为流式转发
+    void parse_requests(ConnCtx* ctx, Poller* poller);
+    // 把 in_buf 中已到达的上传消息体写给上游；写上游出错返回 false
+    bool pump_upload(ConnCtx* ctx, Poller* poller);
+    // 按 in_buf 与 out_buf 的水位暂停或恢复读客户端
+    void throttle_client(ConnCtx* ctx, Poller* poller);
+    void update_client_events(ConnCtx* ctx, Poller* poller, bool want_write);
+    // 完成式收发：没有在途的 send 时把 out_buf 整体交给内核发送
+    void flush_send(ConnCtx* ctx, Poller* poller);
+    /**
+     * 未完成的响应缓冲超过上限时调用：轮到它写回客户端就提交为流式转发，
+     * 否则暂停读上游，等它排到队首再恢复。
+     */
+    void throttle_response(ConnCtx* ctx, Exchange* ex, const HTTPResponse& resp, Poller* poller);
+    // 流式模式：读上游、按分帧移入 out_buf 并写给客户端，out_buf 超过高水位时暂停读上游
+    void stream_response(ConnCtx* ctx, Exchange* ex, Poller* poller);
+    void resume_upstream(Exchange* ex, Poller* poller);
+    // 队首响应头已完整且消息体够大时，把头部移入 out_buf 并切换到 splice 模式
+    bool start_splice(ConnCtx* ctx, Exchange* ex, Poller* poller);
+    // 上游 -> 管道 -> 客户端搬运消息体，直到两边都无法继续
+    void relay_body(ConnCtx* ctx, Exchange* ex, Poller* poller);
+
+    // 按顺序为尚未转发的请求借出上游连接，幂等请求并行发出，非幂等请求前后串行
+    void dispatch_pending(ConnCtx* ctx, Poller* poller);
+    // 为一条请求选择后端并发送，所有尝试都失败则生成 502
+    void dispatch(ConnCtx* ctx, Exchange* ex, Poller* poller);
+    // 缓存可直接作答时生成响应并返回 true；需要校验时给请求加上条件头
+    bool serve_from_cache(Exchange* ex);
+    // 同键已有在途的领头请求时加入等待并返回 true；否则本请求可能成为领头请求
+    bool join_flight(ConnCtx* ctx, Exchange* ex, Poller* poller);
+    // 领头请求把最终响应已读到的字节发布给等待者
+    void publish_flight(Exchange* ex, const HTTPResponse& resp, std::string_view bytes, bool complete);
+    // 等待者复制新发布的字节；领头请求失败时尚未发出字节的等待者自行转发
+    void on_flight_event(ConnCtx* ctx, Poller* poller);
+    // 按需创建本连接的唤醒器并注册到 poller
+    bool ensure_waker(ConnCtx* ctx, Poller* poller);
+    // 唤醒器可读：继续解析结束的隧道，再处理合并请求
+    void on_wake(ConnCtx* ctx, Poller* poller);
+    // CONNECT：校验目标并发起连接，连接建立后由 establish_tunnel 回复 200
+    void dispatch_tunnel(ConnCtx* ctx, Exchange* ex, Poller* poller);
+    void establish_tunnel(ConnCtx* ctx, Exchange* ex, uint32_t events, Poller* poller);
+    // 两个方向各自经管道 splice，直到都无法继续；两个方向都结束后关闭连接
+    void pump_tunnel(ConnCtx* ctx, Poller* poller);
+    // 完成式收发的隧道：上行字节经 in_buf 写给上游，下行字节读进 out_buf 交给内核发送
+    void relay_tunnel(ConnCtx* ctx, Poller* poller);
+    // 上游连接失败或提前关闭：幂等请求稍后换后端重试，否则回 502
+    void fail_exchange(ConnCtx* ctx, Exchange* ex, Poller* poller);
+    // 接手 acquire / connect_tunnel 留下的竞速：候选 fd 注册进事件循环，追加地址与总时限由定时器驱动
+    void start_race(ConnCtx* ctx, Exchange* ex, ConnectRace& race, Poller* poller);
+    // 候选 fd 可写或出错：连上的胜出，其余候选关闭后照常处理事件；候选全部失败时按上游失败处理
+    void on_race_event(ConnCtx* ctx, Exchange* ex, int fd, uint32_t events, Poller* poller);
+    // 没有候选或到了追加时刻就让下一个地址参与竞速；超过总时限或已无候选可等时返回 false
+    bool advance_race(ConnCtx* ctx, Exchange* ex, Poller* poller);
+    // 竞速没有胜出者：CONNECT 回 502，其余按上游失败处理
+    void lose_race(ConnCtx* ctx, Exchange* ex, Poller* poller);
+    void drop_candidate(Exchange* ex, int fd, Poller* poller);
+    // 登记候选 fd 并监听可写，登记失败时放弃这个候选
+    void watch_candidate(ConnCtx* ctx, Exchange* ex, int fd, Poller* poller);
+    // 把定时器设到管线中最早的对冲时刻、上游超时时刻或竞速追加时刻与总时限
+    void arm_timer(ConnCtx* ctx, Poller* poller);
+    void on_timer(ConnCtx* ctx, Poller* poller);
+    // 一次尝试拿到完整响应：对冲双方先完成者胜出，另一方按取消处理
+    void complete_exchange(Exchange* ex, Poller* poller);
+    void send_hedge(ConnCtx* ctx, Exchange* ex, Poller* poller);
+    // 上游超过路由的时限仍未开始响应：放弃上游连接，回 504
+    void expire_exchange(Exchange* ex, Poller* poller);
+    void reply_bad_gateway(Exchange* ex);
+    void reply_error(Exchange* ex, int status, const std::string& reason);
+    // 归还上游连接；ok 表示响应正常（非 5xx），cancelled 表示被客户端放弃，不计入后端统计
+    void finish_upstream(Exchange* ex, Poller* poller, bool reusable, bool ok, bool cancelled = false);
+    // 把队首已完成的响应按序移入 out_buf
+    void flush_ready(ConnCtx* ctx, Poller* poller);
+    // out_buf 写完后写 pinned 中的字节，够大时零拷贝发送，发完再放行后面的响应；出错返回 false
+    bool write_pinned(ConnCtx* ctx, Poller* poller);
+    // 关闭客户端及其借出的上游连接，并释放上下文
+    void close_conn(ConnCtx* ctx, Poller* poller);
+    // 关闭 client_fd；零拷贝发送未完成时连同内存一起保留，收齐完成通知后再关闭
+    void release_client(ConnCtx* ctx, Poller* poller);
+    void update_events(Poller* poller, int fd, uint32_t events, int op = EPOLL_CTL_MOD);
+
+    ConnSlab<ConnPtr> _slab;  // fd -> 连接上下文，客户端与其上游、定时器等 fd 指向同一个上下文
+    size_t _pipeline_depth = 8;
+    size_t _splice_threshold = 16384;
+    size_t _zerocopy_threshold = 0;
+    size_t _high_watermark = 256 << 10;
+    size_t _low_watermark = 64 << 10;
+    std::unordered_set<int> _connect_ports{443};
+    bool _connect_any_port = false;
+    std::unordered_map<std::string, std::weak_ptr<Flight>> _flights;  // 缓存键 -> 在途的合并请求
+    std::mutex _flights_mutex;
 };
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+// 磁盘记录的新鲜度，均为 Unix 毫秒时间，重启后仍然有效
+struct DiskFreshness {
+    int64_t stored_ms = 0;
+    int64_t fresh_until_ms = 0;
+    int64_t stale_until_ms = 0;
+};
+
+class DiskCache;
+struct DiskIndexEntry;
+
+// 一次命中，指向映射区中的记录；存活期间该记录所在的块不会被淘汰或覆盖
+struct DiskHit {
+    ~DiskHit();
+    DiskCache* cache = nullptr;
+    uint32_t slot = 0;
+    int status = 0;
+    std::string_view head;   // 状态行与头部（每行带 CRLF），不含结尾空行
+    std::string_view body;
+    DiskFreshness freshness;
+};
+
+using DiskHitPtr = std::shared_ptr<const DiskHit>;
+
+/**
+ * 文件映射的 slab 缓存，作为内存缓存之下的第二层：
+ * 文件按 1MB 切成 slab，每个 slab 只放一种块大小（4KB 起按 2 倍递增到 1MB），一条记录占一个块；
+ * 每 4KB 对应一个 16 字节的索引项，启动时扫描索引即可重建内存中的查找表。
+ * 同一块大小的记录之间按 LRU 淘汰，被命中引用的块暂不回收。
+ */
+class DiskCache {
+public:
+    ~DiskCache();
+    /**
+     * 打开或创建缓存文件，已有文件的格式或容量不符时清空重建。
+     * @param bytes slab 区的容量，向下取整到 1MB
+     * @return 失败时返回 false，磁盘层不启用
+     */
+    bool open(const std::string& path, size_t bytes);
+    void close();
+    bool is_open() const { return _base != nullptr; }
+
+    DiskHitPtr lookup(const std::string& key);
+    // 写入或替换一条记录；没有可用的块时放弃
+    void store(const std::string& key, int status, std::string_view head, std::string_view body, const DiskFreshness& freshness);
+    // 原地更新新鲜度（304 校验之后）
+    void set_freshness(const std::string& key, const DiskFreshness& freshness);
+    void erase(const std::string& key);
+
+private:
+    friend struct DiskHit;
+
+    struct Slot {
+        std::list<uint32_t>::iterator lru;
+        int cls = 0;             // 块大小等级
+        uint32_t pins = 0;       // 正在被发送的命中数
+        bool verified = false;   // 已校验过内容，重启后首次命中时校验
+        bool dead = false;       // 已被替换或删除，最后一个命中释放后回收
+    };
+
+    char* record(uint32_t slot) const;
+    // 分配一个块，必要时淘汰同一块大小中最久未用的记录；调用方持有锁，失败返回 UINT32_MAX
+    uint32_t allocate(int cls);
+    // 把记录从查找表移除，没有命中引用时立即回收块；调用方持有锁
+    void release(uint32_t slot);
+    void free_slot(uint32_t slot);
+    void unpin(uint32_t slot);
+    void load();
+
+    int _fd = -1;
+    char* _base = nullptr;
+    size_t _size = 0;
+    size_t _slab_count = 0;
+    DiskIndexEntry* _index = nullptr;
+    char* _slabs = nullptr;
+
+    std::mutex _mutex;
+    std::unordered_map<uint64_t, uint32_t> _by_hash;      // 键哈希 -> 块号
+    std::unordered_map<uint32_t, Slot> _slots;            // 已占用的块
+    std::vector<int> _slab_class;                          // 每个 slab 的块大小等级，-1 表示未分配
+    std::vector<uint32_t> _free_slabs;
+    std::vector<std::vector<uint32_t>> _free_chunks;      // 每个等级的空闲块
+    std::vector<std::list<uint32_t>> _lru;                 // 每个等级的 LRU，队首最近使用
+};
@@ -1,6 +1,8 @@
 #pragma once
 #include <string>
+#include <vector>
 #include <unordered_map>
+#include <sys/uio.h>
 #include <sstream>
 #include <algorithm>
 #include <cctype>
@@ -20,6 +22,12 @@ public:
      * @return 完整解析一条请求时返回 true，数据不够或出错返回 false。
      */
     bool parse(const char* data, size_t len, size_t& out_consumed);
+    /**
+     * 只解析请求行与头部，消息体由调用方流式转发。
+     * @param out_consumed 成功时输出头部（含结尾空行）的字节数。
+     * @return 头部完整时返回 true。
+     */
+    bool parse_head(const char* data, size_t len, size_t& out_consumed);
 
     bool is_complete() const;
     bool keep_alive()  const;
@@ -29,7 +37,22 @@ public:
     const std::string& body()    const;
     const std::unordered_map<std::string, std::string>& headers() const;
     ParseState state() const;
+    // 头部解析完成后有效
+    size_t content_length() const;
+    bool is_chunked() const;
     std::string raw();
+    // 设置或覆盖一个请求头，name 须为小写
+    void set_header(const std::string& name, const std::string& value);
+    /**
+     * 生成转发给上游的 iovec：原样引用解析时的字节，只跳过逐跳头部、set_header 覆盖的头部
+     * 和 drop 中列出的头部，并在空行前插入 set_header 设置的头部与 extra。
+     * @param drop  另外要去掉的头部名（小写），通常是调用方要在 extra 里改写的头部
+     * @param extra 调用方追加的头部行（每行带 CRLF）；set_header 设置的头部也会追加到这里
+     * @param out   指向本对象与 extra 的内存，发送完成前二者都不能修改
+     */
+    void forward_iov(const std::vector<std::string>& drop, std::string& extra, std::vector<iovec>& out) const;
+    // 转发时追加的 X-Forwarded-For 与 Via 头部行，调用 forward_iov 时应 drop 掉原有的这两个头部
+    std::string forward_headers(const std::string& client_ip) const;
 
     void reset();
 
@@ -51,4 +74,16 @@ private:
     std::string _version;
     std::unordered_map<std::string, std::string> _headers;
     std::string _body;
+
+    // 一行头部在 _raw 中的位置，end 含 CRLF
+    struct HeaderLine {
+        size_t begin;
+        size_t end;
+        size_t name_len;
+    };
+    std::string _raw;                    // 解析完成的整条请求的原始字节
+    size_t _head_end = 0;                // 结尾空行在 _raw 中的偏移
+    size_t _headers_start = 0;           // 第一行头部在 _raw 中的偏移
+    std::vector<HeaderLine> _lines;
+    std::vector<std::string> _overrides; // set_header 改过的头部名
 };
@@ -22,12 +22,20 @@ public:
      */
     bool parse(const char* data, size_t len, size_t& out_consumed);
 
+    // 对应 HEAD 请求的响应只有头部，Content-Length 不代表后续字节
+    void set_no_body(bool no_body);
+
     bool is_complete() const;
     const std::string& version() const;
     int status_code() const;
     const std::string& reason_phrase() const;
     const std::unordered_map<std::string, std::string>& headers() const;
     const std::string& body() const;
+    ResponseParseState state() const;
+    // 状态行加头部的字节数，头部解析完成后有效
+    size_t header_size() const;
+    size_t content_length() const;
+    bool is_chunked() const;
 
 private:
     bool parse_status_line(const char* data, size_t len, size_t& used);
@@ -38,7 +46,9 @@ private:
 
     ResponseParseState _state;
     bool _chunked;
+    bool _no_body;
     size_t _content_length;
+    size_t _header_size;
 
     std::string _version;
     int         _status_code;
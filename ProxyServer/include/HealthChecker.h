@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include "Singleton.h"
+#include "LoadBalancer.h"
+
+// 主动健康检查配置
+struct HealthOptions {
+    std::string path = "/";   // 探测请求的路径
+    int interval_ms = 5000;   // 探测间隔，0 表示关闭主动检查
+    int timeout_ms = 1000;    // 单次探测的连接+响应超时
+    int rise = 2;             // 连续成功多少次后恢复为健康
+    int fall = 3;             // 连续失败多少次后标记为不健康
+};
+
+// 后台线程周期性地向每个后端发送 GET 探测，结果写回 LoadBalancer
+class HealthChecker : public Singleton<HealthChecker> {
+    friend class Singleton<HealthChecker>;
+public:
+    ~HealthChecker();
+    void start(const HealthOptions& opts);
+    void stop();
+
+private:
+    struct Probe;
+
+    void run();
+    /**
+     * 并发探测一轮：各后端的非阻塞连接共用一个 poll 循环，一个后端卡住不拖慢其他后端。
+     * 地址连不上或在分到的时间内没连上就换下一个地址；在超时内收到 2xx/3xx 响应即为成功。
+     */
+    void probe_all(std::vector<Probe>& probes);
+    // 放弃当前地址，对下一个地址发起连接，它分到剩余时间的均分份额；没有地址可试时探测失败
+    static void connect_next(Probe& p, std::chrono::steady_clock::time_point deadline);
+    // fd 就绪：完成连接、写请求、读响应，能推进多少推进多少
+    static void step(Probe& p, std::chrono::steady_clock::time_point deadline);
+    static void finish(Probe& p, bool ok);
+
+    HealthOptions _opts;
+    std::thread _thread;
+    std::atomic_bool _stop{false};
+    std::mutex _mutex;
+    std::condition_variable _cv;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// 对冲请求配置
+struct HedgeOptions {
+    int    delay_ms = 0;        // 固定对冲延迟；启用百分位时作为下限
+    double percentile = 0;      // 按近期上游延迟的该百分位对冲，0 表示只用固定延迟
+    int    budget_percent = 10; // 对冲请求数占原请求数的上限百分比
+};
+
+/**
+ * 对冲策略：GET/HEAD 请求在延迟内没有开始响应时，向另一个后端再发一份，
+ * 先完成的胜出。对冲额度按原请求数累积，保证对冲不会成倍放大上游负载。
+ */
+class HedgePolicy {
+public:
+    void set_options(const HedgeOptions& opts);
+    bool enabled() const { return _enabled; }
+
+    // 一条可对冲的请求发出时调用：累积对冲额度，返回本次的对冲延迟
+    std::chrono::microseconds on_request();
+    // 消耗一次对冲额度，额度不足返回 false
+    bool try_acquire();
+    // 记录一次成功的上游延迟，用于估计百分位
+    void record_latency(std::chrono::microseconds latency);
+
+private:
+    // 近期延迟样本数，环形覆盖
+    static constexpr size_t SAMPLES = 1024;
+    // 每积累这么多新样本重新计算一次百分位
+    static constexpr size_t RECOMPUTE_EVERY = 64;
+    // 额度以千分之一次对冲为单位，最多攒够这么多次，限制突发
+    static constexpr int64_t MAX_TOKENS = 100 * 1000;
+
+    void recompute();
+
+    HedgeOptions _opts;
+    bool _enabled = false;
+    std::atomic<int64_t> _tokens{0};
+    std::array<std::atomic<uint32_t>, SAMPLES> _samples{};  // 微秒
+    std::atomic<size_t> _next_sample{0};
+    std::atomic<int64_t> _percentile_us{0};                  // 最近一次算出的百分位，样本不足时为 0
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "HTTPRequest.h"
+
+// 一个上游后端实例
+struct Backend {
+    std::string host;
+    int port = 80;
+    int weight = 1;
+    std::atomic<int> outstanding{0};   // 在途请求数
+    std::atomic<double> ewma_us{0.0};  // 响应延迟的指数移动平均（微秒）
+
+    // 健康状态：主动探测与被动摘除共同决定后端是否可用
+    std::atomic<bool> healthy{true};              // 主动探测结果
+    std::atomic<int> consecutive_failures{0};     // 连续连接失败或 5xx 次数
+    std::atomic<int64_t> ejected_until_ms{0};     // 被动摘除的截止时刻
+    std::atomic<int64_t> recovered_ms{0};         // 最近一次恢复可用的时刻，用于慢启动
+    int probe_streak = 0;                         // 连续探测成功(>0)/失败(<0)次数，仅由健康检查线程访问
+
+    std::string key() const { return port ? host + ":" + std::to_string(port) : host; }
+};
+
+// 被动异常摘除配置
+struct OutlierOptions {
+    int consecutive_failures = 5;  // 连续失败多少次后摘除，0 表示关闭
+    int ejection_ms = 10000;       // 摘除时长
+    int slow_start_ms = 10000;     // 恢复后权重从低到满的爬升时长，0 表示关闭
+};
+
+// 负载均衡策略
+enum class LbPolicy { ROUND_ROBIN, LEAST_REQUEST, P2C_EWMA, CONSISTENT_HASH };
+
+class LoadBalancer {
+public:
+    // 解析策略名：rr / least / p2c / hash
+    static bool parse_policy(const std::string& name, LbPolicy& policy);
+
+    void set_backends(std::vector<std::shared_ptr<Backend>> backends);
+    void set_policy(LbPolicy policy);
+    // 一致性哈希的键：path 或 header:<name>（头部缺失时退回 path）
+    void set_hash_key(const std::string& spec);
+    void set_outlier_options(const OutlierOptions& opts);
+
+    /**
+     * 为一条请求选择后端，并把该后端的在途请求数加一。
+     * 优先选择健康且未被摘除的后端；全部不可用时退化为忽略健康状态选择。
+     * @return 没有配置后端时返回 nullptr。
+     */
+    Backend* select(const HTTPRequest& req);
+    // 请求结束：在途数减一，成功时用本次延迟更新 EWMA，失败（连接失败或 5xx）计入被动摘除
+    void on_request_done(Backend* backend, std::chrono::microseconds latency, bool ok);
+    // 请求被客户端取消：只减少在途数，不计入延迟与失败统计
+    void on_request_cancelled(Backend* backend);
+    // 主动健康检查把后端标记为健康/不健康
+    void set_healthy(Backend* backend, bool healthy);
+
+    static int64_t now_ms();
+
+    const std::vector<std::shared_ptr<Backend>>& backends() const { return _backends; }
+
+private:
+    bool available(const Backend* backend, int64_t now) const;
+    // 慢启动期间的权重系数，取值 (0, 1]
+    double weight_factor(const Backend* backend, int64_t now) const;
+    Backend* select_round_robin();
+    Backend* select_least_request();
+    Backend* select_p2c();
+    Backend* select_hash(const HTTPRequest& req);
+    void build_schedule();
+    void build_ring();
+
+    LbPolicy _policy = LbPolicy::ROUND_ROBIN;
+    OutlierOptions _outlier;
+    std::string _hash_header;  // 为空表示按 path 哈希
+    std::vector<std::shared_ptr<Backend>> _backends;
+    std::vector<size_t> _schedule;                     // 平滑加权轮询的预计算序列
+    std::vector<std::pair<uint64_t, size_t>> _ring;    // 哈希环：虚拟节点哈希 -> 后端下标
+    std::atomic<uint64_t> _rr_counter{0};
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "Singleton.h"
+#include "HTTPRequest.h"
+#include "LoadBalancer.h"
+#include "Router.h"
+
+// 流量镜像配置
+struct MirrorOptions {
+    size_t queue_size = 1024;  // 待发送的镜像请求上限，队列满时丢弃
+    int threads = 2;           // 发送镜像请求的后台线程数
+    int timeout_ms = 1000;     // 单个镜像请求从发送到读完响应的时限
+};
+
+/**
+ * 把路由按比例采样的请求复制一份发给影子上游池，响应读完即丢弃。
+ * 主路径只做采样和入队，不等待也不阻塞；发送由后台线程完成，
+ * 队列满时直接丢弃并计数。
+ */
+class Mirror : public Singleton<Mirror> {
+    friend class Singleton<Mirror>;
+public:
+    ~Mirror();
+    void start(const MirrorOptions& opts);
+    void stop();
+
+    /**
+     * 请求解析完成后调用：路由配置了镜像且命中采样时复制请求入队。
+     * @param client_ip 用于镜像请求的 X-Forwarded-For
+     */
+    void submit(const Route& route, const HTTPRequest& req, const std::string& client_ip);
+
+    uint64_t sent() const { return _sent.load(); }
+    uint64_t failed() const { return _failed.load(); }
+    uint64_t dropped() const { return _dropped.load(); }
+
+private:
+    struct Job {
+        LoadBalancer* balancer = nullptr;  // 影子上游池
+        HTTPRequest req;
+        std::string client_ip;
+    };
+
+    void run();
+    // 阻塞发送一个镜像请求并读完响应，成功返回 true
+    bool send(Job& job);
+
+    MirrorOptions _opts;
+    std::deque<Job> _queue;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::vector<std::thread> _threads;
+    std::atomic_bool _stop{false};
+    std::atomic<uint64_t> _sent{0};
+    std::atomic<uint64_t> _failed{0};
+    std::atomic<uint64_t> _dropped{0};
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <sys/socket.h>
+#include "Singleton.h"
+
+// 域名解析缓存配置
+struct ResolverOptions {
+    int default_ttl_ms = 30000;   // 查询不到 DNS TTL（如 /etc/hosts）时使用的有效期
+    int min_ttl_ms = 1000;        // TTL 下限，避免 TTL=0 的记录把后台线程打满
+    int max_ttl_ms = 300000;      // TTL 上限
+};
+
+struct ResolvedAddr {
+    sockaddr_storage addr;
+    socklen_t len;
+};
+
+// "unix:/path/to.sock" 形式的主机名表示 Unix 域套接字，端口固定为 0
+inline bool is_unix_host(const std::string& host) {
+    return host.compare(0, 5, "unix:") == 0;
+}
+
+// 带 TTL 的域名解析缓存：热路径只读缓存，解析与刷新全部在后台线程完成
+class Resolver : public Singleton<Resolver> {
+    friend class Singleton<Resolver>;
+public:
+    ~Resolver();
+    void start(const ResolverOptions& opts);
+    void stop();
+
+    /**
+     * 非阻塞地查询 host:port 的地址列表（已按 IPv6/IPv4 交替排列）。
+     * 数字地址和 Unix 套接字路径直接就地解析；缓存过期时仍返回旧结果并交给后台刷新；
+     * 未命中时交给后台解析并返回 false。
+     */
+    bool lookup(const std::string& host, int port, std::vector<ResolvedAddr>& out);
+    // 同上；未命中时后台解析结束（不论成败）后在后台线程调用 done，调用方据此重新查询
+    bool lookup(const std::string& host, int port, std::vector<ResolvedAddr>& out, std::function<void()> done);
+    // 阻塞解析并写入缓存，用于启动阶段预热；预热过的条目是配置的后端，闲置也不淘汰，到期前照常刷新
+    bool prefetch(const std::string& host, int port);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::string host;
+        int port = 0;
+        std::vector<ResolvedAddr> addrs;
+        Clock::time_point expires;
+        std::atomic<int64_t> last_used_ms{0};  // 热路径在读锁下更新
+    };
+
+    // 阻塞解析：地址来自 getaddrinfo，TTL 来自 DNS 应答
+    bool resolve(const std::string& host, int port, Entry& entry);
+    int query_ttl_ms(const std::string& host);
+    void enqueue(const std::string& key, const std::string& host, int port, std::function<void()> done = nullptr);
+    void run();
+
+    ResolverOptions _opts;
+    std::unordered_map<std::string, std::shared_ptr<Entry>> _cache;  // "host:port" -> 解析结果
+    std::unordered_set<std::string> _pinned;  // prefetch 过的 key，受 _cache_mutex 保护
+    std::shared_mutex _cache_mutex;
+
+    std::deque<std::pair<std::string, int>> _queue;  // 待解析的 host, port
+    std::unordered_set<std::string> _queued;         // 已在队列中的 key，避免重复
+    std::unordered_map<std::string, std::vector<std::function<void()>>> _waiters;  // key -> 等这次解析结束的回调
+    std::mutex _queue_mutex;
+    std::condition_variable _cv;
+    std::thread _thread;
+    std::atomic_bool _stop{false};
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <list>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include "Singleton.h"
+#include "HTTPRequest.h"
+#include "HTTPResponse.h"
+#include "DiskCache.h"
+
+// 响应缓存配置
+struct CacheOptions {
+    size_t max_bytes = 0;                 // 缓存总容量，0 表示关闭缓存
+    size_t shards = 16;                   // 分片数，每片独立加锁
+    size_t max_object_bytes = 1 << 20;    // 单个响应的上限，超过的不缓存
+    int    default_ttl_ms = 0;            // 响应没有任何新鲜度信息时的有效期，0 表示这类响应不缓存
+    std::string disk_path;                // 磁盘缓存文件，空表示只用内存
+    size_t disk_bytes = 256 << 20;        // 磁盘缓存容量
+};
+
+// 一条缓存的响应，构造后不再修改；刷新时生成新条目，消息体在新旧条目间共享
+struct CacheEntry {
+    using Clock = std::chrono::steady_clock;
+
+    std::string key;
+    std::string base;                          // 不含 Vary 部分的键
+    std::vector<std::string> vary;             // Vary 指定的请求头名（小写）
+    int status = 0;
+    std::string head;                          // 状态行与头部（每行带 CRLF），不含结尾空行
+    std::shared_ptr<const std::string> body;   // 原样的消息体字节（分块编码保持不变）
+    std::unordered_map<std::string, std::string> headers;  // 小写头部，用于重新计算新鲜度
+    std::string etag;
+    std::string last_modified;
+    Clock::time_point stored;       // 视为响应生成的时刻（已扣除上游 Age）
+    Clock::time_point fresh_until;  // 此前直接命中
+    Clock::time_point stale_until;  // 此前可先返回旧响应并在后台刷新（stale-while-revalidate）
+
+    size_t size() const { return key.size() + head.size() + body->size() + 256; }
+};
+
+using CacheEntryPtr = std::shared_ptr<const CacheEntry>;
+
+enum class CacheResult {
+    MISS,        // 未命中或不可使用缓存
+    FRESH,       // 新鲜命中
+    STALE,       // 已过期但在 stale-while-revalidate 窗口内：先返回旧响应，后台刷新
+    REVALIDATE,  // 已过期但有校验器：需要向上游发条件请求
+};
+
+/**
+ * 分片的内存响应缓存：每片一个 LRU 链表，淘汰时用 TinyLFU 频率草图做准入，
+ * 防止一次性访问的对象把热点挤出去。键为 host + path 加上 Vary 指定的请求头。
+ */
+class ResponseCache : public Singleton<ResponseCache> {
+    friend class Singleton<ResponseCache>;
+public:
+    ~ResponseCache();
+    void start(const CacheOptions& opts);
+    void stop();
+    bool enabled() const { return _opts.max_bytes > 0; }
+    size_t max_object_bytes() const { return _opts.max_object_bytes; }
+
+    /**
+     * 查找可用于该请求的缓存条目，内存未命中时再查磁盘。STALE 时已把后台刷新排入队列。
+     * @param out    命中（含 STALE/REVALIDATE）时输出条目
+     * @param mapped 磁盘层新鲜命中时输出映射区中的记录，此时 out 为空
+     */
+    CacheResult lookup(const HTTPRequest& req, CacheEntryPtr& out, DiskHitPtr& mapped);
+    // 响应能否缓存（只看请求与响应头），用于决定是否绕开 splice
+    bool storable(const HTTPRequest& req, const HTTPResponse& resp) const;
+    // 缓存一条完整响应；raw 为该响应的原始字节
+    void store(const HTTPRequest& req, const HTTPResponse& resp, const char* raw, size_t len);
+    // 上游对条件请求回了 304：用新头部更新新鲜度，返回更新后的条目
+    CacheEntryPtr freshen(const HTTPRequest& req, const CacheEntryPtr& entry, const HTTPResponse& resp);
+    /**
+     * 计算并发未命中时用于合并请求的键。
+     * @return 缓存关闭或请求不能走缓存时返回 false
+     */
+    bool collapse_key(const HTTPRequest& req, std::string& key);
+    // 响应 Vary 头列出的请求头名（小写）
+    static std::vector<std::string> vary_names(const HTTPResponse& resp);
+    // 把条目渲染成发给客户端的响应，附带 Age 与 X-Cache 头
+    static std::string render(const CacheEntry& entry, bool head_only, const char* tag);
+    // 磁盘命中只渲染头部，消息体直接从映射区发送
+    static std::string render_head(const DiskHit& hit);
+    // 给转发的请求加上 If-None-Match / If-Modified-Since
+    static void add_validators(HTTPRequest& req, const CacheEntry& entry);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // 每行 4 个 4 位计数器的 Count-Min 草图，计数总量达到阈值后整体减半以淡化旧访问
+    class FrequencySketch {
+    public:
+        explicit FrequencySketch(size_t width = 4096);
+        void increment(uint64_t hash);
+        int estimate(uint64_t hash) const;
+    private:
+        size_t index(uint64_t hash, int row) const;
+        std::vector<uint8_t> _counters;
+        size_t _mask;
+        size_t _additions = 0;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<std::shared_ptr<const CacheEntry>> lru;  // 队首最近使用
+        std::unordered_map<std::string, std::list<std::shared_ptr<const CacheEntry>>::iterator> index;
+        std::unordered_map<std::string, std::vector<std::string>> vary;  // 基础键 -> Vary 头名
+        std::unordered_map<std::string, size_t> variants;  // 基础键 -> 内存中的 Vary 变体数
+        FrequencySketch sketch;
+        size_t bytes = 0;
+    };
+
+    struct Freshness {
+        bool storable = false;
+        Clock::duration lifetime{0};
+        Clock::duration stale_while_revalidate{0};
+    };
+
+    // 请求本身要求绕过缓存
+    static bool bypass(const HTTPRequest& req);
+    static std::string base_key(const HTTPRequest& req);
+    static std::string full_key(const std::string& base, const std::vector<std::string>& vary, const HTTPRequest& req);
+    Shard& shard_for(const std::string& base);
+    Freshness freshness(const std::unordered_map<std::string, std::string>& headers, int status) const;
+    // 放入或替换条目，空间不足时按 LRU 淘汰；调用方持有分片锁
+    void insert(Shard& shard, CacheEntryPtr entry);
+    // 移出一个条目，基础键的最后一个 Vary 变体离开时才删除 Vary 映射；调用方持有分片锁
+    void remove(Shard& shard, std::list<std::shared_ptr<const CacheEntry>>::iterator it);
+    // 把过期的磁盘记录复制进内存层
+    CacheEntryPtr promote(const std::string& key, const DiskHit& hit);
+    void enqueue_refresh(const HTTPRequest& req, const CacheEntryPtr& entry);
+    // 后台线程：向上游同步发出条件请求并更新缓存
+    void refresh(HTTPRequest req, CacheEntryPtr entry);
+    void run();
+
+    CacheOptions _opts;
+    std::vector<std::unique_ptr<Shard>> _shards;
+    DiskCache _disk;
+
+    std::deque<std::pair<HTTPRequest, CacheEntryPtr>> _queue;  // 待后台刷新的请求
+    std::unordered_set<std::string> _queued;                    // 已在队列中的键，避免重复刷新
+    std::mutex _queue_mutex;
+    std::condition_variable _cv;
+    std::thread _thread;
+    std::atomic_bool _stop{false};
+};
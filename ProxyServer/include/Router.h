@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include "Singleton.h"
+#include "HTTPRequest.h"
+#include "LoadBalancer.h"
+
+// 一条路由：Host 与路径前缀匹配的请求发往指定的上游池
+struct Route {
+    std::string host;             // 小写、不含端口，空表示任意 Host
+    std::string prefix;           // 路径前缀，按字节匹配
+    std::string pool;             // 上游池名，"default" 为 --proxy 配置的池
+    int timeout_ms = 0;           // 请求发完到上游开始响应的时限，超时回 504；0 表示不限
+    std::string mirror_pool;      // 镜像流量的影子上游池，空表示不镜像
+    double mirror_percent = 100;  // 镜像的请求百分比
+    LoadBalancer* balancer = nullptr;  // start() 时按池名绑定
+    LoadBalancer* mirror = nullptr;
+};
+
+/**
+ * 路由表：先按 Host 选出该主机的基数树，在树上找最长的路径前缀；
+ * 该主机没有匹配的路由时再查不限 Host 的路由，都没有则走默认路由。
+ * 配置在启动时完成，之后只读，查找不加锁也不分配内存。
+ */
+class Router : public Singleton<Router> {
+    friend class Singleton<Router>;
+public:
+    /**
+     * 添加一条路由。
+     * @param spec [HOST]/PREFIX=POOL[;timeout=MS][;mirror=POOL][;mirror-percent=P]，
+     *             HOST 为空或 * 表示任意 Host，例如
+     *             "api.example.com/v1/=api;timeout=2000"、"/static/=assets;mirror=canary;mirror-percent=5"
+     * @return 格式错误或与已有路由重复时返回 false
+     */
+    bool add_route(const std::string& spec);
+    // 未匹配任何路由的请求以及未指定 timeout 的路由使用的超时
+    void set_default_timeout(int ms);
+    // 把各路由的池名绑定到 UpstreamManager 中的池，引用了不存在的池时返回 false
+    bool start();
+    // 是否有路由配置了镜像
+    bool mirroring() const;
+
+    // 为请求选择路由，总会返回一条（兜底为默认路由）
+    const Route& match(const HTTPRequest& req) const;
+
+private:
+    // 基数树节点：边上的标签为一段路径字节，子节点的标签首字节互不相同
+    struct Node {
+        std::string label;
+        int route = -1;  // 在本节点结束的路由下标，-1 表示无
+        std::vector<std::unique_ptr<Node>> children;
+    };
+
+    // Host 不区分大小写
+    struct HostHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view host) const;
+    };
+    struct HostEqual {
+        using is_transparent = void;
+        bool operator()(std::string_view a, std::string_view b) const;
+    };
+
+    // 插入前缀，返回该前缀原有的路由下标（无则为 -1）
+    static int insert(Node& root, std::string_view prefix, int route);
+    // 返回最长匹配前缀的路由下标，没有匹配时为 -1
+    static int longest_prefix(const Node& root, std::string_view path);
+
+    std::vector<Route> _routes;
+    std::unordered_map<std::string, Node, HostHash, HostEqual> _hosts;  // 指定了 Host 的路由
+    Node _any;                      // 不限 Host 的路由
+    Route _default;                 // 未匹配任何路由时使用，发往默认池
+    int _default_timeout_ms = 0;
+};
@@ -3,13 +3,46 @@
 #include <string>
 #include <string.h>
 #include <unordered_map>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <chrono>
 #include <sys/socket.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #include <mutex>
 #include <iostream>
 #include "Singleton.h"
+#include "LoadBalancer.h"
+#include "HedgePolicy.h"
+#include "Resolver.h"
+
+// 上游连接池配置
+struct PoolOptions {
+    size_t max_idle = 32;            // 每个 host:port 最多保留的空闲连接数
+    int    max_lifetime_ms = 60000;  // 连接最长存活时间，超过后不再复用
+    size_t prewarm = 0;              // 启动时为每个上游预建立的连接数
+    int    attempt_delay_ms = 250;   // 多地址竞速时，启动下一个地址前等待的时间
+    int    connect_timeout_ms = 1000; // 多地址竞速的总超时
+    int    source_port_min = 0;       // 上游连接的本地端口范围（IP_LOCAL_PORT_RANGE），0 表示系统默认
+    int    source_port_max = 0;
+};
+
+/**
+ * 一次多地址连接竞速（happy eyeballs）：按间隔依次对各地址发起非阻塞连接，最先连上的胜出。
+ * 发起连接的线程不等待，候选 fd 由调用方的事件循环关注可写，追加地址与总时限由调用方的定时器驱动。
+ */
+struct ConnectRace {
+    std::string key;                  // "host:port"；隧道为空，胜出的连接不纳入连接池管理
+    std::vector<ResolvedAddr> addrs;  // 已按地址族交替排列
+    size_t next = 0;                  // 下一个要发起连接的地址
+    std::vector<int> fds;             // 连接中的候选
+    // 到这一时刻仍没有胜出者就追加下一个地址，max 表示没有地址可追加
+    std::chrono::steady_clock::time_point next_at = std::chrono::steady_clock::time_point::max();
+    std::chrono::steady_clock::time_point deadline;  // 竞速的总时限
+};
 
 class UpstreamManager : public Singleton<UpstreamManager> {
     friend class Singleton<UpstreamManager>;
@@ -18,11 +51,104 @@ public:
     // 根据 URL 创建到上游服务器的连接，返回 upstream_fd
     int get_upstream_fd(const std::string& url);
 
+    /**
+     * 配置上游后端列表。
+     * @param spec 逗号分隔的后端，每项为 URL 或 unix:/path/to.sock，可带 ;weight=N，例如
+     *             "http://10.0.0.1:8888;weight=3,unix:/run/http.sock"
+     * @return 任一项解析失败返回 false。
+     */
+    bool set_backends(const std::string& spec);
+    /**
+     * 定义一个命名的上游池，供路由引用。
+     * @param spec NAME=后端列表，后端列表格式同 set_backends
+     * @return 名字重复、为 default 或后端解析失败时返回 false。
+     */
+    bool add_pool(const std::string& spec);
+    // 按名字查找上游池，"default" 为 set_backends 配置的池；不存在时返回 nullptr
+    LoadBalancer* pool(const std::string& name);
+    // 全部上游池，默认池在最前
+    std::vector<LoadBalancer*> pools();
+    // 默认池
+    LoadBalancer& balancer() { return _balancer; }
+    HedgePolicy& hedging() { return _hedging; }
+
+    void set_pool_options(const PoolOptions& opts);
+    // 启动时预建立 opts.prewarm 条到 host:port 的连接并放入空闲池
+    void prewarm(const std::string& host, int port);
+    /**
+     * 借出一条到 host:port 的连接：优先复用空闲连接，没有则新建。
+     * 给出 race 时不阻塞：目标有多个地址且第一个地址没能立即连上时返回 -1，竞速的候选留在 race 中由调用方推进；
+     * 不给 race 时在当前线程等待竞速结束，只用于后台线程。
+     */
+    int acquire(const std::string& host, int port, ConnectRace* race = nullptr);
+    // 归还连接：reusable 为 false 或池已满/连接过期时直接关闭
+    void release(int fd, bool reusable);
+    // 为 CONNECT 隧道新建到已解析地址的连接，不进连接池，由调用方关闭；多个地址时同 acquire 一样交给 race
+    int connect_tunnel(const std::vector<ResolvedAddr>& addrs, ConnectRace& race);
+    // 竞速追加下一个地址，返回新的候选 fd；没有地址可试时返回 -1
+    int race_next(ConnectRace& race);
+    // 候选 fd 连上了，从 race 中取出并纳入管理，之后与借出的连接一样归还（隧道除外）；其余候选由调用方关闭
+    void race_won(ConnectRace& race, int fd);
+
+    /**
+     * 配置连接上游时轮流绑定的本地源地址，突破单个源地址到同一后端的端口上限。
+     * @param spec 逗号分隔的 IPv4/IPv6 地址，只用于同一地址族的目标
+     * @return 任一地址无法解析时返回 false。
+     */
+    bool set_source_addresses(const std::string& spec);
+    // 因本地端口耗尽（EADDRNOTAVAIL）失败的连接次数
+    uint64_t addr_not_avail_count() const { return _addr_not_avail.load(); }
+
 private:
+    using Clock = std::chrono::steady_clock;
+
+    struct ConnInfo {
+        std::string key;           // "host:port"
+        Clock::time_point created;
+    };
+
     bool parse_url(const std::string& url, std::string& host, int& port);
-    int connect_to_upstream(const std::string& host, int port);
+    bool parse_backends(const std::string& spec, std::vector<std::shared_ptr<Backend>>& backends);
+    int connect_to_upstream(const std::string& host, int port, ConnectRace* race);
+    /**
+     * 对 addrs 发起竞速：第一个地址立即连上或只剩它一个候选时直接返回它；
+     * 否则给出 race 时返回 -1 交给调用方，不给 race 时阻塞等到竞速结束。
+     */
+    int start_race(const std::string& key, const std::vector<ResolvedAddr>& addrs, ConnectRace* race);
+    // 后台线程阻塞等待竞速结果，败者全部关闭
+    int wait_race(ConnectRace& race);
+    int race_next(ConnectRace& race, bool& connected);
+    /**
+     * 对一个地址发起非阻塞连接；配置了源地址时轮流绑定，端口耗尽时换下一个源地址重试。
+     * @param connected 输出是否已立即连上
+     * @return 已连上或连接中的 fd，失败返回 -1
+     */
+    int open_connection(const ResolvedAddr& addr, int port_min, int port_max, bool& connected);
+    bool expired(const ConnInfo& info, Clock::time_point now) const;
+    static bool is_alive(int fd);
+    void close_locked(int fd);
+
+    // 一个本地源地址及其统计
+    struct SourceAddr {
+        ResolvedAddr addr;
+        std::string name;
+        std::atomic<uint64_t> connects{0};
+        std::atomic<uint64_t> addr_not_avail{0};
+    };
+    // 按轮转选一个与 family 匹配的源地址并绑定，没有可用源地址时返回 nullptr
+    SourceAddr* bind_source(int fd, int family);
+
+    std::vector<std::unique_ptr<SourceAddr>> _sources;  // 启动时配置，之后只读
+    std::atomic<size_t> _next_source{0};
+    std::atomic<uint64_t> _addr_not_avail{0};
 
-    // 维护所有活跃的上游连接（可选：用于资源回收）
-    std::unordered_map<int, std::string> _active_connections; // fd -> "host:port"
+    LoadBalancer _balancer;
+    std::vector<std::pair<std::string, std::unique_ptr<LoadBalancer>>> _pools;  // 命名池，启动时配置，之后只读
+    HedgePolicy _hedging;
+    PoolOptions _opts;
+    // 维护所有由本管理器创建的上游连接（借出的和空闲的）
+    std::unordered_map<int, ConnInfo> _active_connections; // fd -> info
+    // 每个 "host:port" 的空闲连接，队尾为最近归还的连接
+    std::unordered_map<std::string, std::deque<int>> _idle;
     std::mutex _mutex;
 };
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <poll.h>
+
+// 代理内部各模块共用的小工具
+
+// 去掉首尾的空格与制表符
+inline std::string trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t");
+    if (b == std::string::npos) return "";
+    size_t e = s.find_last_not_of(" \t");
+    return s.substr(b, e - b + 1);
+}
+
+inline std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+// 在截止时间前等待 fd 就绪，返回 false 表示超时或出错
+inline bool wait_fd(int fd, short events, std::chrono::steady_clock::time_point deadline) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    if (left.count() <= 0) return false;
+    pollfd pfd{fd, events, 0};
+    return poll(&pfd, 1, static_cast<int>(left.count())) == 1 && !(pfd.revents & POLLNVAL);
+}
@@ -0,0 +1,93 @@
+#include "BodyFramer.h"
+#include <algorithm>
+#include <cstring>
+
+// 块大小行与尾部字段行的长度上限，防止畸形数据无限累积
+constexpr size_t MAX_LINE = 8192;
+
+void BodyFramer::expect_length(size_t length) {
+    _state = length > 0 ? State::LENGTH : State::DONE;
+    _remaining = length;
+    _line.clear();
+}
+
+void BodyFramer::expect_chunked() {
+    _state = State::CHUNK_SIZE;
+    _remaining = 0;
+    _line.clear();
+}
+
+bool BodyFramer::feed(const char* data, size_t len, size_t& used, std::string* payload) {
+    size_t pos = 0;
+    while (pos < len && _state != State::DONE) {
+        switch (_state) {
+            case State::LENGTH:
+            case State::CHUNK_DATA: {
+                size_t n = std::min(_remaining, len - pos);
+                if (payload) payload->append(data + pos, n);
+                pos += n;
+                _remaining -= n;
+                if (_remaining > 0) break;
+                if (_state == State::LENGTH) {
+                    _state = State::DONE;
+                }
+                else {
+                    _state = State::CHUNK_CRLF;
+                    _remaining = 2;
+                }
+                break;
+            }
+            case State::CHUNK_CRLF: {
+                // 每块数据之后紧跟 CRLF
+                if (data[pos] != (_remaining == 2 ? '\r' : '\n')) return false;
+                ++pos;
+                if (--_remaining == 0) _state = State::CHUNK_SIZE;
+                break;
+            }
+            case State::CHUNK_SIZE:
+            case State::TRAILER: {
+                const char* nl = static_cast<const char*>(std::memchr(data + pos, '\n', len - pos));
+                size_t end = nl ? static_cast<size_t>(nl - data) + 1 : len;
+                _line.append(data + pos, end - pos);
+                pos = end;
+                if (!nl) {
+                    if (_line.size() > MAX_LINE) return false;
+                    break;
+                }
+
+                // 去掉行尾 CRLF
+                _line.pop_back();
+                if (!_line.empty() && _line.back() == '\r') _line.pop_back();
+                if (_state == State::TRAILER) {
+                    // 空行结束尾部字段
+                    if (_line.empty()) _state = State::DONE;
+                    _line.clear();
+                    break;
+                }
+
+                // 块大小之后可能带 ;ext
+                size_t chunk_size = 0;
+                try {
+                    size_t idx = 0;
+                    chunk_size = std::stoul(_line, &idx, 16);
+                    if (idx < _line.size() && _line[idx] != ';' && _line[idx] != ' ' && _line[idx] != '\t') return false;
+                } catch (...) {
+                    return false;
+                }
+                _line.clear();
+                if (chunk_size == 0) {
+                    _state = State::TRAILER;
+                }
+                else {
+                    _state = State::CHUNK_DATA;
+                    _remaining = chunk_size;
+                }
+                break;
+            }
+            case State::DONE:
+                break;
+        }
+    }
+    used = pos;
+    return true;
+}
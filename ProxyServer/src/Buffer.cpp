@@ -29,6 +29,12 @@ std::string Buffer::read_all(){
     return result;
 }
 
+std::vector<char> Buffer::take() {
+    std::vector<char> result;
+    result.swap(_buffer);
+    return result;
+}
+
 void Buffer::consume(size_t n) {
     if (!_buffer.empty()) _buffer.erase(_buffer.begin(), _buffer.begin() + n);
 }
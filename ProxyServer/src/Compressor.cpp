@@ -0,0 +1,301 @@
+#include "Compressor.h"
+#include "ThreadPool.h"
+#include "Util.h"
+#include <zlib.h>
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+
+// 负载采样周期
+constexpr auto SAMPLE_INTERVAL = std::chrono::milliseconds(200);
+// 压缩输出的缓冲块大小
+constexpr size_t ENCODE_BUFFER = 16384;
+
+namespace {
+
+class GzipEncoder : public StreamEncoder {
+public:
+    explicit GzipEncoder(int level) {
+        // windowBits 加 16 输出 gzip 格式的头尾
+        _ok = deflateInit2(&_zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+    ~GzipEncoder() override {
+        if (_ok) deflateEnd(&_zs);
+    }
+    bool ok() const { return _ok; }
+
+    bool write(const char* data, size_t len, std::string& out, Flush flush) override {
+        int mode = flush == Flush::FINISH ? Z_FINISH : flush == Flush::SYNC ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+        _zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        _zs.avail_in = static_cast<uInt>(len);
+        char buf[ENCODE_BUFFER];
+        while (true) {
+            _zs.next_out = reinterpret_cast<Bytef*>(buf);
+            _zs.avail_out = sizeof(buf);
+            int rc = deflate(&_zs, mode);
+            if (rc == Z_STREAM_ERROR) return false;
+            out.append(buf, sizeof(buf) - _zs.avail_out);
+            if (rc == Z_STREAM_END) return true;
+            // 输出缓冲没被填满说明已输入的数据都处理完了；Z_BUF_ERROR 表示没有可做的事
+            if (rc == Z_BUF_ERROR || (_zs.avail_in == 0 && _zs.avail_out != 0 && mode != Z_FINISH)) return true;
+        }
+    }
+
+private:
+    z_stream _zs{};
+    bool _ok = false;
+};
+
+#ifdef WITH_ZSTD
+class ZstdEncoder : public StreamEncoder {
+public:
+    explicit ZstdEncoder(int level) : _cctx(ZSTD_createCCtx()) {
+        if (_cctx) ZSTD_CCtx_setParameter(_cctx, ZSTD_c_compressionLevel, level);
+    }
+    ~ZstdEncoder() override {
+        ZSTD_freeCCtx(_cctx);
+    }
+    bool ok() const { return _cctx != nullptr; }
+
+    bool write(const char* data, size_t len, std::string& out, Flush flush) override {
+        ZSTD_EndDirective mode = flush == Flush::FINISH ? ZSTD_e_end : flush == Flush::SYNC ? ZSTD_e_flush : ZSTD_e_continue;
+        ZSTD_inBuffer in{data, len, 0};
+        char buf[ENCODE_BUFFER];
+        while (true) {
+            ZSTD_outBuffer o{buf, sizeof(buf), 0};
+            size_t remaining = ZSTD_compressStream2(_cctx, &o, &in, mode);
+            if (ZSTD_isError(remaining)) return false;
+            out.append(buf, o.pos);
+            // continue 模式只需吃完输入；flush / end 要等内部缓冲全部输出
+            if (mode == ZSTD_e_continue ? in.pos == in.size : remaining == 0) return true;
+        }
+    }
+
+private:
+    ZSTD_CCtx* _cctx;
+};
+#endif
+
+/**
+ * Accept-Encoding 中某个编码的 q 值。
+ * @param star 未列出该编码时是否按 * 的 q 值
+ * @return 不接受时返回 0
+ */
+double accept_q(const std::string& accept, const std::string& coding, bool star) {
+    double q_star = 0, q_coding = -1;
+    std::istringstream iss(accept);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        size_t semi = item.find(';');
+        std::string name = lower(trim(item.substr(0, semi)));
+        double q = 1;
+        if (semi != std::string::npos) {
+            size_t qpos = item.find("q=", semi);
+            if (qpos != std::string::npos) q = std::strtod(item.c_str() + qpos + 2, nullptr);
+        }
+        if (name == coding) q_coding = q;
+        else if (name == "*") q_star = q;
+    }
+    if (q_coding >= 0) return q_coding;
+    return star ? q_star : 0;
+}
+
+bool compressible_type(const std::vector<std::string>& types, const std::string& content_type) {
+    std::string type = lower(trim(content_type.substr(0, content_type.find(';'))));
+    if (type.empty()) return false;
+    auto ends_with = [&type](const char* suffix) {
+        size_t n = std::char_traits<char>::length(suffix);
+        return type.size() > n && type.compare(type.size() - n, n, suffix) == 0;
+    };
+    if (ends_with("+json") || ends_with("+xml")) return true;
+    for (const auto& t : types) {
+        if (t.back() == '/' ? type.compare(0, t.size(), t) == 0 : type == t) return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+std::unique_ptr<StreamEncoder> StreamEncoder::create(Encoding encoding, int level) {
+    if (encoding == Encoding::GZIP) {
+        auto encoder = std::make_unique<GzipEncoder>(level);
+        if (encoder->ok()) return encoder;
+    }
+#ifdef WITH_ZSTD
+    if (encoding == Encoding::ZSTD) {
+        auto encoder = std::make_unique<ZstdEncoder>(level);
+        if (encoder->ok()) return encoder;
+    }
+#endif
+    return nullptr;
+}
+
+void Compressor::start(const CompressOptions& opts) {
+    _opts = opts;
+    for (auto& type : _opts.types) type = lower(trim(type));
+    _opts.types.erase(std::remove(_opts.types.begin(), _opts.types.end(), std::string()), _opts.types.end());
+    _level = opts.level;
+    if (!enabled()) return;
+
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    _cpu_ns = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    _sampled_at = std::chrono::steady_clock::now();
+    std::cout << "[INIT] Response compression enabled, level " << _opts.level << ", min size " << _opts.min_bytes
+#ifdef WITH_ZSTD
+              << ", gzip/zstd"
+#else
+              << ", gzip"
+#endif
+              << std::endl;
+}
+
+Encoding Compressor::choose(const HTTPRequest& req, const HTTPResponse& resp, size_t body_size) const {
+    if (!enabled() || req.method() == "HEAD" || body_size < _opts.min_bytes) return Encoding::IDENTITY;
+    // 字节范围对应的是原始表示，部分内容不压缩
+    if (resp.status_code() == 206 || req.headers().count("range")) return Encoding::IDENTITY;
+
+    const auto& headers = resp.headers();
+    auto encoding = headers.find("content-encoding");
+    if (encoding != headers.end() && lower(encoding->second) != "identity") return Encoding::IDENTITY;
+    auto cache_control = headers.find("cache-control");
+    if (cache_control != headers.end() && lower(cache_control->second).find("no-transform") != std::string::npos) {
+        return Encoding::IDENTITY;
+    }
+    auto type = headers.find("content-type");
+    if (type == headers.end() || !compressible_type(_opts.types, type->second)) return Encoding::IDENTITY;
+
+    auto accept = req.headers().find("accept-encoding");
+    if (accept == req.headers().end()) return Encoding::IDENTITY;
+    double gzip = accept_q(accept->second, "gzip", true);
+#ifdef WITH_ZSTD
+    // zstd 要客户端明确列出，* 只当作 gzip
+    double zstd = accept_q(accept->second, "zstd", false);
+    if (zstd > 0 && zstd >= gzip) return Encoding::ZSTD;
+#endif
+    return gzip > 0 ? Encoding::GZIP : Encoding::IDENTITY;
+}
+
+bool Compressor::compress(const HTTPRequest& req, const HTTPResponse& resp, std::string_view raw, std::string& out) {
+    const std::string& body = resp.body();
+    Encoding encoding = choose(req, resp, body.size());
+    if (encoding == Encoding::IDENTITY) return false;
+
+    auto encoder = StreamEncoder::create(encoding, level());
+    std::string data;
+    if (!encoder || !encoder->write(body.data(), body.size(), data, StreamEncoder::Flush::FINISH)) return false;
+    // 压缩后没有变小就原样转发
+    if (data.size() >= body.size()) return false;
+
+    out = rewrite_head(raw.substr(0, resp.header_size()), encoding, "Content-Length: " + std::to_string(data.size()));
+    out += data;
+    return true;
+}
+
+std::unique_ptr<StreamEncoder> Compressor::start_stream(const HTTPRequest& req, const HTTPResponse& resp,
+                                                        std::string_view head, std::string& out_head) {
+    // 压缩后的长度未知只能分块传输，HTTP/1.0 客户端不支持
+    if (req.version() != "HTTP/1.1") return nullptr;
+    Encoding encoding = choose(req, resp, resp.is_chunked() ? SIZE_MAX : resp.content_length());
+    if (encoding == Encoding::IDENTITY) return nullptr;
+
+    auto encoder = StreamEncoder::create(encoding, level());
+    if (encoder) out_head = rewrite_head(head, encoding, "Transfer-Encoding: chunked");
+    return encoder;
+}
+
+int Compressor::level() {
+    sample_load();
+    return _level.load(std::memory_order_relaxed);
+}
+
+void Compressor::sample_load() {
+    auto now = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(_sample_mutex, std::try_to_lock);
+    if (!lock.owns_lock() || now - _sampled_at < SAMPLE_INTERVAL) return;
+
+    // 进程 CPU 占用按全部核数归一化
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    int64_t cpu_ns = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    double wall_ns = std::chrono::duration<double, std::nano>(now - _sampled_at).count();
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    double cpu = (cpu_ns - _cpu_ns) / (wall_ns * cores);
+    _cpu_ns = cpu_ns;
+    _sampled_at = now;
+
+    size_t queued = 0;
+    double backlog = 0;
+    if (_opts.pool_backlog) {
+        auto pool = ThreadPool::getInstance();
+        queued = pool->queueDepth();
+        backlog = static_cast<double>(queued) / std::max(1, pool->threadCount());
+    }
+
+    // 排队超过线程数或 CPU 超过 70% 时级别减半，排队超过线程数 4 倍或 CPU 超过 90% 时用最快的级别
+    int level = _opts.level;
+    if (backlog >= 4 || cpu >= 0.9) level = 1;
+    else if (backlog >= 1 || cpu >= 0.7) level = std::max(1, level / 2);
+
+    int old = _level.exchange(level);
+    if (old != level) {
+        std::cout << "[STATE] Compression level " << old << " -> " << level << " (queued " << queued
+                  << ", cpu " << static_cast<int>(cpu * 100) << "%)" << std::endl;
+    }
+}
+
+std::string Compressor::rewrite_head(std::string_view head, Encoding encoding, const std::string& framing) {
+    std::string out;
+    out.reserve(head.size() + 96);
+    bool status_line = true;
+    bool vary = false;
+    size_t pos = 0;
+    while (pos < head.size()) {
+        size_t eol = head.find("\r\n", pos);
+        if (eol == std::string_view::npos) eol = head.size();
+        std::string_view line = head.substr(pos, eol - pos);
+        pos = eol + 2;
+        if (line.empty()) break;
+        if (status_line) {
+            out.append(line);
+            out += "\r\n";
+            status_line = false;
+            continue;
+        }
+
+        size_t colon = line.find(':');
+        std::string name = lower(std::string(line.substr(0, colon)));
+        // 长度、分帧和编码由我们重新给出；压缩后字节范围没有意义
+        if (name == "content-length" || name == "transfer-encoding" || name == "content-encoding" || name == "accept-ranges") {
+            continue;
+        }
+        std::string value = colon == std::string_view::npos ? std::string() : trim(std::string(line.substr(colon + 1)));
+        if (name == "etag") {
+            // 压缩后的字节与原响应不同，强校验器降为弱校验器
+            out.append(line.substr(0, colon));
+            out += ": ";
+            if (value.compare(0, 2, "W/") != 0) out += "W/";
+            out += value;
+            out += "\r\n";
+            continue;
+        }
+        out.append(line);
+        if (name == "vary") {
+            vary = true;
+            std::string names = lower(value);
+            if (names != "*" && names.find("accept-encoding") == std::string::npos) out += ", Accept-Encoding";
+        }
+        out += "\r\n";
+    }
+    if (!vary) out += "Vary: Accept-Encoding\r\n";
+    out += encoding == Encoding::ZSTD ? "Content-Encoding: zstd\r\n" : "Content-Encoding: gzip\r\n";
+    out += framing;
+    out += "\r\n\r\n";
+    return out;
+}
@@ -1,39 +1,416 @@
 #include "ConnectionManager.h"
+#include <cstdlib>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
+#include <climits>
+
+// 单条请求最多尝试的上游次数（含首次）
+constexpr int MAX_UPSTREAM_ATTEMPTS = 2;
+// splice 管道容量，超过 /proc/sys/fs/pipe-max-size 时沿用默认的 64KB
+constexpr int SPLICE_PIPE_SIZE = 1 << 20;
+// 合并请求表超过该大小时清理已结束的条目
+constexpr size_t FLIGHT_SWEEP_THRESHOLD = 1024;
+// 关闭时零拷贝发送尚未完成的连接，对端最多这么久不确认就中止，内核随之发出剩余的完成通知
+constexpr int ZEROCOPY_LINGER_MS = 30000;
+
+// 上游响应结束后连接是否还能放回连接池
+static bool upstream_reusable(const HTTPResponse& resp) {
+    auto it = resp.headers().find("connection");
+    if (resp.version() == "HTTP/1.1") return it == resp.headers().end() || it->second != "close";
+    return it != resp.headers().end() && it->second == "keep-alive";
+}
+
+// 幂等请求可以并行转发，失败后也可以安全重试
+static bool idempotent(const HTTPRequest& req) {
+    const std::string& m = req.method();
+    return m == "GET" || m == "HEAD" || m == "OPTIONS";
+}
+
+// 只对 GET/HEAD 对冲
+static bool hedgeable(const HTTPRequest& req) {
+    return req.method() == "GET" || req.method() == "HEAD";
+}
+
+// 领头请求不再发布数据：响应未完整时标记失败并唤醒等待者
+static void abandon_flight(Exchange& ex) {
+    Flight& f = *ex.flight;
+    {
+        std::lock_guard<std::mutex> lock(f.mutex);
+        if (!f.done && !f.failed) {
+            f.failed = true;
+            for (auto& waiter : f.waiters) waiter->wake();
+        }
+    }
+    ex.flight.reset();
+    ex.leader = false;
+}
+
+// 等待者的请求在 Vary 所列请求头上与领头请求一致，才能共用它的响应
+static bool vary_matches(const Flight& f, const HTTPRequest& req) {
+    for (const auto& [name, value] : f.vary) {
+        auto it = req.headers().find(name);
+        if ((it == req.headers().end() ? std::string() : it->second) != value) return false;
+    }
+    return true;
+}
+
+Exchange::~Exchange() {
+    if (leader) abandon_flight(*this);
+}
+
+// 边缘触发，必须读到 EAGAIN 为止；缓冲达到 limit 时提前停下，由调用方暂停读并在恢复时重新注册
+// 返回 false 表示对端关闭或出错
+static bool read_into(int fd, Buffer& in, size_t limit) {
+    char buf[4096];
+    while (in.size() < limit) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n > 0) {
+            in.append(buf, n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (n < 0) perror("read");
+        return false;
+    }
+    return true;
+}
+
+// 读客户端，TLS 连接经 OpenSSL 取明文；返回 false 表示连接出错或已关闭
+static bool read_client(ConnCtx& ctx, size_t limit) {
+    if (!ctx.ssl) return read_into(ctx.client_fd, ctx.in_buf, limit);
+    char buf[16384];
+    // 已解密的记录必须取完：暂停读之后它不会再触发可读事件
+    while (ctx.in_buf.size() < limit || SSL_pending(ctx.ssl) > 0) {
+        ssize_t n = TlsContext::read(ctx.ssl, buf, sizeof(buf));
+        if (n > 0) {
+            ctx.in_buf.append(buf, n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (n < 0) perror("SSL_read");
+        return false;
+    }
+    return true;
+}
+
+// 上游 fd 关注的事件：背压时不读；请求没写完或消息体还在上传时关注可写
+static uint32_t upstream_events(const Exchange& ex) {
+    uint32_t events = EPOLLET;
+    if (!ex.read_paused) events |= EPOLLIN;
+    if (ex.upstream_iov_pos < ex.upstream_iov.size() || ex.uploading) events |= EPOLLOUT;
+    return events;
+}
+
+// 竞速的候选关注的事件：CONNECT 只等连接建立，普通请求连上后直接写请求、读响应
+static uint32_t race_events(const Exchange& ex) {
+    uint32_t events = EPOLLOUT | EPOLLET;
+    if (ex.req.method() != "CONNECT") events |= EPOLLIN;
+    return events;
+}
+
+// 创建非阻塞管道并尽量调大容量
+static bool open_pipe(int fds[2]) {
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        perror("pipe2");
+        return false;
+    }
+    fcntl(fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+    return true;
+}
+
+static void close_pipe(int fds[2]) {
+    for (int i = 0; i < 2; ++i) {
+        if (fds[i] >= 0) close(fds[i]);
+        fds[i] = -1;
+    }
+}
+
+// 解析 CONNECT 的 authority-form 目标 host:port，IPv6 地址带方括号
+static bool parse_authority(const std::string& target, std::string& host, int& port) {
+    size_t colon = target.rfind(':');
+    if (colon == std::string::npos || colon == 0) return false;
+    host = target.substr(0, colon);
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+    else if (host.find(':') != std::string::npos) return false;
+
+    char* end = nullptr;
+    long p = std::strtol(target.c_str() + colon + 1, &end, 10);
+    if (end == target.c_str() + colon + 1 || *end != '\0' || p <= 0 || p > 65535) return false;
+    port = static_cast<int>(p);
+    return true;
+}
+
+/**
+ * 隧道单方向搬运：src -> 管道 -> dst，src 读到 EOF 且管道排空后对 dst 半关闭。
+ * @param can_write dst 前面是否还有数据排队，没有时才能写 dst
+ * @return 出错返回 -1，有进展返回 1，否则返回 0
+ */
+static int pump(int src, int dst, TunnelPipe& p, bool can_write) {
+    int progress = 0;
+    if (!p.eof) {
+        ssize_t n = splice(src, nullptr, p.fds[1], nullptr, SPLICE_PIPE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            p.pending += n;
+            progress = 1;
+        }
+        else if (n == 0) {
+            p.eof = true;
+            progress = 1;
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return -1;
+        }
+    }
+    if (can_write && p.pending > 0) {
+        ssize_t n = splice(p.fds[0], nullptr, dst, nullptr, p.pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            p.pending -= n;
+            progress = 1;
+        }
+        else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return -1;
+        }
+    }
+    if (p.eof && p.pending == 0 && !p.shut) {
+        shutdown(dst, SHUT_WR);
+        p.shut = true;
+    }
+    return progress;
+}
+
+// 尽量写空 buf；返回 false 表示连接出错
+static bool write_from(int fd, Buffer& buf) {
+    while (!buf.empty()) {
+        ssize_t n = write(fd, buf.data(), buf.size());
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            perror("write");
+            return false;
+        }
+        buf.consume(n);
+    }
+    return true;
+}
+
+// 尽量写空 out_buf；内核没有接管加密的 TLS 连接经 SSL_write；完成式收发的连接只由 flush_send 交给内核
+static bool write_client(ConnCtx& ctx) {
+    if (ctx.completion) return true;
+    if (!ctx.ssl || ctx.ktls_send) return write_from(ctx.client_fd, ctx.out_buf);
+    while (!ctx.out_buf.empty()) {
+        ssize_t n = TlsContext::write(ctx.ssl, ctx.out_buf.data(), ctx.out_buf.size());
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            perror("SSL_write");
+            return false;
+        }
+        ctx.out_buf.consume(n);
+    }
+    return true;
+}
+
+// 尽量写完 iov[pos..)；部分写出的项原地前移，返回 false 表示连接出错
+static bool write_iov(int fd, std::vector<iovec>& iov, size_t& pos) {
+    while (pos < iov.size()) {
+        int count = static_cast<int>(std::min<size_t>(iov.size() - pos, IOV_MAX));
+        ssize_t n = writev(fd, iov.data() + pos, count);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            perror("writev");
+            return false;
+        }
+        size_t left = static_cast<size_t>(n);
+        while (left > 0 && left >= iov[pos].iov_len) {
+            left -= iov[pos].iov_len;
+            ++pos;
+        }
+        if (left > 0) {
+            iov[pos].iov_base = static_cast<char*>(iov[pos].iov_base) + left;
+            iov[pos].iov_len -= left;
+        }
+    }
+    return true;
+}
+
+// 记下一次成功的零拷贝 send；与上一组同属一段内存且编号连续时合并
+static void track_zerocopy(ConnCtx& ctx, const std::shared_ptr<const void>& owner) {
+    uint32_t id = ctx.zerocopy_seq++;
+    if (!ctx.zerocopy_sends.empty()) {
+        ZerocopySend& last = ctx.zerocopy_sends.back();
+        if (last.owner == owner && last.first + last.count == id) {
+            ++last.count;
+            ++last.pending;
+            return;
+        }
+    }
+    ctx.zerocopy_sends.push_back(ZerocopySend{id, 1, 1, owner});
+}
+
+// 完成通知覆盖编号 [lo, lo + n)，按模 2^32 计算与各组的交集
+static void complete_zerocopy(ConnCtx& ctx, uint32_t lo, uint32_t n) {
+    for (auto& send : ctx.zerocopy_sends) {
+        uint32_t overlap = 0;
+        if (lo - send.first < send.count) overlap = std::min(send.count - (lo - send.first), n);
+        else if (send.first - lo < n) overlap = std::min(n - (send.first - lo), send.count);
+        send.pending -= std::min(overlap, send.pending);
+    }
+    auto& sends = ctx.zerocopy_sends;
+    sends.erase(std::remove_if(sends.begin(), sends.end(), [](const ZerocopySend& s) { return s.pending == 0; }), sends.end());
+}
+
+// 读完错误队列中的零拷贝完成通知并释放内核不再引用的内存；套接字本身出错时返回 false
+static bool reap_zerocopy(ConnCtx& ctx) {
+    while (true) {
+        char control[128];
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(ctx.client_fd, &msg, MSG_ERRQUEUE) < 0) break;
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            bool recverr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                           (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!recverr) continue;
+            auto* err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cm));
+            if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            // 内核退回了复制（如回环或网卡不支持分散聚合），零拷贝只剩额外开销
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) ctx.zerocopy_off = true;
+            complete_zerocopy(ctx, err->ee_info, err->ee_data - err->ee_info + 1);
+        }
+    }
+    int err = 0;
+    socklen_t len = sizeof(err);
+    return getsockopt(ctx.client_fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0;
+}
+
+// 请求所属路由的上游池
+static LoadBalancer& balancer_of(const Exchange& ex) {
+    return ex.route ? *ex.route->balancer : UpstreamManager::getInstance()->balancer();
+}
+
+// 上游已开始响应（含 1xx 临时响应），不再计超时
+static bool responding(const Exchange& ex) {
+    if (!ex.upstream_in_buf.empty() || !ex.response.empty() || ex.splicing || ex.streaming) return true;
+    return ex.hedge && responding(*ex.hedge);
+}
+
+// 完整响应移入 ex.response，需要时先压缩
+static void deliver(Exchange& ex, const HTTPResponse& resp, std::string_view raw) {
+    std::string compressed;
+    if (Compressor::getInstance()->compress(ex.req, resp, raw, compressed)) {
+        ex.response.append(compressed.data(), compressed.size());
+        return;
+    }
+    ex.response.append(raw.data(), raw.size());
+}
+
+// 由缓存生成的响应：只在开启压缩时才重新解析
+static void deliver(Exchange& ex, const std::string& raw) {
+    if (Compressor::getInstance()->enabled()) {
+        HTTPResponse resp;
+        resp.set_no_body(ex.req.method() == "HEAD");
+        size_t consumed = 0;
+        if (resp.parse(raw.data(), raw.size(), consumed)) {
+            deliver(ex, resp, raw);
+            return;
+        }
+    }
+    ex.response.append(raw.data(), raw.size());
+}
+
+// 压缩一段消息体，输出作为一个块追加到 out；FINISH 时补上结尾的空块
+static bool encode_chunk(StreamEncoder& encoder, const std::string& data, StreamEncoder::Flush flush, Buffer& out) {
+    std::string encoded;
+    if (!encoder.write(data.data(), data.size(), encoded, flush)) return false;
+    if (!encoded.empty()) {
+        char size[32];
+        int n = snprintf(size, sizeof(size), "%zx\r\n", encoded.size());
+        out.append(size, n);
+        out.append(encoded.data(), encoded.size());
+        out.append("\r\n", 2);
+    }
+    if (flush == StreamEncoder::Flush::FINISH) out.append("0\r\n\r\n", 5);
+    return true;
+}
+
+// 准备发往上游的字节：原样引用客户端发来的请求，只补上 X-Forwarded-For 与 Via
+static void prepare_forward(Exchange& ex, const std::string& client_ip) {
+    ex.forward_head = ex.req.forward_headers(client_ip);
+    ex.upstream_iov.clear();
+    ex.upstream_iov_pos = 0;
+    ex.req.forward_iov({"x-forwarded-for", "via"}, ex.forward_head, ex.upstream_iov);
+}
 
 ConnectionManager::~ConnectionManager(){
     clear_all();
 }
 
-void ConnectionManager::register_conn(int fd, ConnCtx* ctx){
-    std::lock_guard<std::mutex> lock(_mutex); // 保证线程安全
-    _connections[fd] = ctx;
+bool ConnectionManager::register_conn(int fd, ConnPtr ctx){
+    if (_slab.bind(fd, std::move(ctx)) == 0) {
+        std::cerr << "[ERROR] fd " << fd << " exceeds RLIMIT_NOFILE, not registered" << std::endl;
+        return false;
+    }
     std::cout << "Registered client_fd " << fd << " to epoll" << std::endl;
+    return true;
 }
 
-ConnCtx* ConnectionManager::get_conn(int fd){
-    std::lock_guard<std::mutex> lock(_mutex); // 保证线程安全
-    auto it = _connections.find(fd);
-    return it != _connections.end() ? it->second : nullptr;
+ConnPtr ConnectionManager::get_conn(uint64_t handle){
+    return _slab.get(handle);
 }
 
 void ConnectionManager::remove_conn(int fd){
-    std::lock_guard<std::mutex> lock(_mutex); // 保证线程安全
-    auto it = _connections.find(fd);
-    if (it != _connections.end()) {
-        delete it->second;
-        _connections.erase(it);
+    _slab.unbind(fd);
+}
+
+void ConnectionManager::set_pipeline_depth(size_t depth){
+    _pipeline_depth = depth > 0 ? depth : 1;
+}
+
+void ConnectionManager::set_splice_threshold(size_t bytes){
+    _splice_threshold = bytes;
+}
+
+void ConnectionManager::set_zerocopy_threshold(size_t bytes){
+    _zerocopy_threshold = bytes;
+}
+
+void ConnectionManager::set_watermarks(size_t high, size_t low){
+    _high_watermark = high;
+    _low_watermark = low;
+}
+
+bool ConnectionManager::set_connect_ports(const std::string& spec){
+    _connect_ports.clear();
+    _connect_any_port = spec == "*";
+    if (_connect_any_port) return true;
+
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) end = spec.size();
+        std::string item = spec.substr(start, end - start);
+        start = end + 1;
+        if (item.empty()) continue;
+
+        int port = std::atoi(item.c_str());
+        if (port <= 0 || port > 65535) {
+            std::cerr << "[ERROR] Invalid CONNECT port: " << item << std::endl;
+            return false;
+        }
+        _connect_ports.insert(port);
     }
+    return true;
 }
 
 void ConnectionManager::clear_all(){
-    std::lock_guard<std::mutex> lock(_mutex); // 保证线程安全
-    for (auto& [fd, ctx] : _connections) {
-        delete ctx;
-    }
-    _connections.clear();
+    _slab.clear();
 }
 
-void ConnectionManager::accept_new_conn(int listen_fd, int epfd){
+void ConnectionManager::accept_new_conn(int listen_fd, Poller* poller){
     while(true){
         sockaddr_in client_addr{};
         socklen_t addrlen = sizeof(client_addr);
@@ -48,161 +425,1661 @@ void ConnectionManager::accept_new_conn(int listen_fd, int epfd){
                 break;
             }
         }
+        add_conn(client_fd, client_addr, poller);
+    }
+}
 
-        std::cout << "accept new conn, client_fd = " << client_fd << std::endl;
+void ConnectionManager::accept_conn(int client_fd, Poller* poller){
+    // 多发 accept 不带回对端地址
+    sockaddr_in client_addr{};
+    socklen_t addrlen = sizeof(client_addr);
+    getpeername(client_fd, reinterpret_cast<sockaddr*>(&client_addr), &addrlen);
+    add_conn(client_fd, client_addr, poller);
+}
 
-        // 创建连接上下文 ConnCtx
-        ConnCtx* ctx = new ConnCtx();
-        ctx->client_fd = client_fd;
-        ctx->upstream_fd = -1; // 默认不启用上游
-        ctx->keep_alive = true; // 默认启用 keep-alive，可根据 header 再决定
-        // 注册到全局管理表（例如 map<int, ConnCtx*>）
-        register_conn(client_fd, ctx);
+void ConnectionManager::add_conn(int client_fd, const sockaddr_in& client_addr, Poller* poller){
+    std::cout << "accept new conn, client_fd = " << client_fd << std::endl;
 
-        // 注册进 epoll 监听
-        epoll_event ev{};
-        ev.events = EPOLLIN | EPOLLET;
-        ev.data.fd = client_fd;
-        if (epoll_ctl(epfd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
-            perror("epoll_ctl (add client)");
+    // 创建连接上下文 ConnCtx
+    ConnPtr ctx = std::make_shared<ConnCtx>();
+    ctx->client_fd = client_fd;
+    ctx->keep_alive = true; // 默认启用 keep-alive，可根据 header 再决定
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
+    ctx->client_ip = ip;
+    auto tls = TlsContext::getInstance();
+    if (tls->enabled()) {
+        ctx->ssl = tls->accept(client_fd);
+        if (!ctx->ssl) {
             close(client_fd);
-            remove_conn(client_fd);
-            delete ctx;
+            return;
+        }
+        ctx->handshaking = true;
+        // kTLS 不支持 MSG_ZEROCOPY，用户态加密时更无从谈起
+        ctx->zerocopy_off = true;
+    }
+    // 注册到全局连接表，事件带着表中的句柄回来
+    if (!register_conn(client_fd, ctx)) {
+        close(client_fd);
+        return;
+    }
+
+    // 明文连接在 io_uring 上由内核直接收发，TLS 连接仍按就绪通知经 OpenSSL 读写
+    ctx->completion = poller->completion() && !ctx->ssl;
+    uint64_t handle = _slab.handle(client_fd);
+    bool watched = ctx->completion ? poller->recv(client_fd, handle) : poller->add(client_fd, handle, EPOLLIN | EPOLLET);
+    if (!watched) {
+        perror("poller add (client)");
+        close(client_fd);
+        remove_conn(client_fd);
+        return;
+    }
+
+    // 可以打印客户端信息（可选）
+    std::cout << "[STATE] New connection from ip: " << ip << ", port: " << ntohs(client_addr.sin_port) << ", fd: " << client_fd << std::endl;
+}
+
+void ConnectionManager::handle_io_event(uint64_t handle, uint32_t events, Poller* poller) {
+    // fd 已关闭或已被新连接复用：旧句柄的事件直接丢弃
+    ConnPtr conn = get_conn(handle);
+    if (!conn) return;
+
+    // 客户端与各上游 fd 的事件可能同时落到不同工作线程：连接正忙时把事件留给正在处理它的线程
+    if (!conn->strand.enter(handle, events)) return;
+    do {
+        // 排队期间连接可能已关闭，fd 也可能已被释放或复用
+        if (get_conn(handle) != conn) continue;
+        // 已关闭的连接只剩零拷贝完成通知要收
+        if (conn->closed) {
+            if (conn->lingering) release_client(conn.get(), poller);
             continue;
         }
+        dispatch_event(conn.get(), ConnSlab<ConnPtr>::fd_of(handle), events, poller);
+    } while (conn->strand.next(handle, events));
+}
+
+void ConnectionManager::handle_completion(const PollEvent& ev, Poller* poller) {
+    // 完成事件只在反应堆线程上处理，同一连接的事件不会并发，不必经过 strand
+    ConnPtr conn = get_conn(ev.handle);
+    if (!conn || conn->closed) return;
+    ConnCtx* ctx = conn.get();
+
+    if (ev.kind == PollEvent::SEND) {
+        ctx->sending = false;
+        if (ev.res < 0) {
+            errno = -ev.res;
+            perror("send");
+            close_conn(ctx, poller);
+            return;
+        }
+        if (ctx->tunnel_fd >= 0) {
+            relay_tunnel(ctx, poller);
+            return;
+        }
+        flush_send(ctx, poller);
+        if (ctx->closed) return;
+        // 流式转发的响应在 out_buf 交给内核后恢复读上游
+        if (!ctx->pipeline.empty()) {
+            Exchange* front = ctx->pipeline.front().get();
+            if (front->streaming && front->read_paused && ctx->out_buf.size() < _low_watermark) resume_upstream(front, poller);
+        }
+        if (!ctx->sending && !ctx->keep_alive && ctx->pipeline.empty()) {
+            close_conn(ctx, poller);
+            return;
+        }
+        throttle_client(ctx, poller);
+        return;
+    }
 
-        // 可以打印客户端信息（可选）
-        char ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
-        std::cout << "[STATE] New connection from ip: " << ip << ", port: " << ntohs(client_addr.sin_port) << ", fd: " << client_fd << std::endl;
+    if (ev.res <= 0) {
+        if (ev.res < 0) {
+            errno = -ev.res;
+            perror("recv");
+        }
+        // 隧道上客户端的 EOF 只结束上行方向
+        else if (ctx->tunnel_fd >= 0) {
+            ctx->to_upstream.eof = true;
+            relay_tunnel(ctx, poller);
+            return;
+        }
+        close_conn(ctx, poller);
+        return;
+    }
+    ctx->in_buf.append(ev.data, ev.res);
+    if (ctx->tunnel_fd >= 0) {
+        relay_tunnel(ctx, poller);
+        return;
     }
+    parse_requests(ctx, poller);
+    if (ctx->closed) return;
+    dispatch_pending(ctx, poller);
+    flush_ready(ctx, poller);
+    throttle_client(ctx, poller);
 }
 
-void ConnectionManager::handle_io_event(int fd, uint32_t events, int epfd) {
-    ConnCtx* ctx = get_conn(fd);
-    if (!ctx){
-        std::cerr << "[ERROR] no context for fd" << std::endl;
+void ConnectionManager::dispatch_event(ConnCtx* ctx, int fd, uint32_t events, Poller* poller) {
+    if (fd == ctx->timer_fd) {
+        on_timer(ctx, poller);
         return;
-    };
+    }
+    if (ctx->waker && fd == ctx->waker->fd) {
+        on_wake(ctx, poller);
+        return;
+    }
+
+    // 隧道建立后两个 fd 只做字节转发，不再经过 HTTP 解析；套接字错误由 pump_tunnel 写客户端时发现
+    if (ctx->tunnel_fd >= 0) {
+        if (ctx->completion) {
+            relay_tunnel(ctx, poller);
+            return;
+        }
+        if (fd == ctx->client_fd && (events & EPOLLERR) && ctx->zerocopy) reap_zerocopy(*ctx);
+        pump_tunnel(ctx, poller);
+        return;
+    }
 
-    bool is_client = (fd == ctx->client_fd);
-    bool is_upstream = (fd == ctx->upstream_fd);
-    if (!is_client && !is_upstream) {
+    if (fd == ctx->client_fd) {
+        handle_client_event(ctx, events, poller);
+        return;
+    }
+
+    Exchange* ex = find_exchange(ctx, fd);
+    if (!ex) {
         std::cerr << "[ERROR] cant distinguish is_client or is_upstream" << std::endl;
         return;
     }
+    if (ex->race) {
+        on_race_event(ctx, ex, fd, events, poller);
+        return;
+    }
+    handle_upstream_event(ctx, ex, events, poller);
+}
+
+void ConnectionManager::handle_client_event(ConnCtx* ctx, uint32_t events, Poller* poller) {
+    int fd = ctx->client_fd;
+
+    // ---------- TLS 握手 ----------
+    if (ctx->handshaking) {
+        if (!advance_handshake(ctx, poller)) return;
+        // 客户端可能紧跟着握手就发来了请求，边缘触发不会再通知一次
+        events |= EPOLLIN;
+    }
+
+    // ---------- 零拷贝完成通知 ----------
+    // 通知经错误队列送达并以 EPOLLERR 报告，读完后套接字本身没有错误就不算出错
+    if ((events & EPOLLERR) && ctx->zerocopy) {
+        if (!reap_zerocopy(*ctx)) {
+            close_conn(ctx, poller);
+            return;
+        }
+        events &= ~EPOLLERR;
+        // 不再保持的连接响应早已写完，只在等最后的完成通知
+        if (!ctx->keep_alive && ctx->pipeline.empty() && ctx->out_buf.empty() && !ctx->pinned && ctx->zerocopy_sends.empty()) {
+            close_conn(ctx, poller);
+            return;
+        }
+    }
 
     // ---------- 可读事件 ----------
-    if (events & EPOLLIN) {
-        char buf[4096];
-        ssize_t n = read(fd, buf, sizeof(buf));
-        if (n <= 0) {
-            if (n < 0) perror("read");
-            close(fd);
-            remove_conn(fd);
-            return;
-        }
-
-        if (is_client) {
-            ctx->in_buf.append(buf, n);
-            // 尝试解析请求
-            while (true) {
-                auto view = ctx->in_buf.peek();
-                if (view.empty()) break;
-
-                HTTPRequest req;
-                size_t consumed = 0;
-                if (!req.parse(view.data(), view.size(), consumed)) break;
-
-                ctx->in_buf.consume(consumed);
-                ctx->pipeline.push(req);
-
-                if (ctx->upstream_fd == -1) {
-                    ctx->upstream_fd = connect_to_upstream("127.0.0.1", 8888);
-                    if (ctx->upstream_fd < 0) {
-                        std::cerr << "[ERROR] connect upstream failed" << std::endl;
-                        close(fd);
-                        remove_conn(fd);
-                        return;
-                    }
-
-                    register_conn(ctx->upstream_fd, ctx);
-                    epoll_event ev{};
-                    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
-                    ev.data.fd = ctx->upstream_fd;
-                    epoll_ctl(epfd, EPOLL_CTL_ADD, ctx->upstream_fd, &ev);
-                }
+    // 暂停期间排队的旧事件直接忽略，恢复时重新注册会再触发
+    if ((events & EPOLLIN) && !ctx->read_paused) {
+        if (!read_client(*ctx, _high_watermark)) {
+            close_conn(ctx, poller);
+            return;
+        }
+        // 读到上限时套接字里可能还有数据，按暂停处理，恢复时重新注册才会再触发可读事件
+        if (ctx->in_buf.size() >= _high_watermark) ctx->read_paused = true;
+
+        parse_requests(ctx, poller);
+        if (ctx->closed) return;
+        dispatch_pending(ctx, poller);
+        flush_ready(ctx, poller);
+    }
 
-                std::string raw_req = req.raw();
-                ctx->upstream_out_buf.append(raw_req.data(), raw_req.size());
+    // ---------- 可写事件 ----------
+    if (events & EPOLLOUT) {
+        if (!write_client(*ctx) || !write_pinned(ctx, poller)) {
+            close_conn(ctx, poller);
+            return;
+        }
+
+        // 队首响应正在 splice，客户端可写后继续搬运消息体
+        if (!ctx->pipeline.empty() && ctx->pipeline.front()->splicing) {
+            relay_body(ctx, ctx->pipeline.front().get(), poller);
+            if (ctx->closed) return;
+        }
+
+        // 流式转发的响应在 out_buf 降到低水位以下后恢复读上游
+        if (!ctx->pipeline.empty()) {
+            Exchange* front = ctx->pipeline.front().get();
+            if (front->streaming && front->read_paused && ctx->out_buf.size() < _low_watermark) resume_upstream(front, poller);
+        }
+
+        bool splicing = !ctx->pipeline.empty() && ctx->pipeline.front()->splicing;
+        if (ctx->out_buf.empty() && !ctx->pinned && !splicing) {
+            // 零拷贝发送的内存还被内核引用时先不关闭，等完成通知
+            if (!ctx->keep_alive && ctx->pipeline.empty() && ctx->zerocopy_sends.empty()) {
+                close_conn(ctx, poller);
+                return;
             }
+            update_client_events(ctx, poller, false);
+        }
+    }
+
+    // ---------- 错误事件 ----------
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        std::cerr << "epoll error/hup on fd " << fd << std::endl;
+        close_conn(ctx, poller);
+        return;
+    }
+    throttle_client(ctx, poller);
+}
+
+bool ConnectionManager::advance_handshake(ConnCtx* ctx, Poller* poller) {
+    TlsStatus status = TlsContext::handshake(ctx->ssl);
+    if (status == TlsStatus::FAILED) {
+        close_conn(ctx, poller);
+        return false;
+    }
+    if (status != TlsStatus::DONE) {
+        // 握手消息写不出去时才关注可写
+        update_client_events(ctx, poller, status == TlsStatus::WANT_WRITE);
+        return false;
+    }
+    ctx->handshaking = false;
+    ctx->ktls_send = TlsContext::kernel_send(ctx->ssl);
+    ctx->ktls_recv = TlsContext::kernel_recv(ctx->ssl);
+    TlsContext::getInstance()->on_established(ctx->ssl, ctx->client_fd);
+    update_client_events(ctx, poller, false);
+    return true;
+}
+
+void ConnectionManager::parse_requests(ConnCtx* ctx, Poller* poller) {
+    while (true) {
+        // 上传的消息体转发完之前，in_buf 开头的字节都属于它
+        if (ctx->upload) {
+            if (!pump_upload(ctx, poller)) fail_exchange(ctx, ctx->upload, poller);
+            if (ctx->closed || ctx->upload) return;
+        }
+        // 客户端要求关闭后不再接受后续请求
+        if (!ctx->keep_alive) return;
+
+        auto view = ctx->in_buf.peek();
+        if (view.empty()) return;
 
-            // 注册上游为可写
-            epoll_event ev{};
-            ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
-            ev.data.fd = ctx->upstream_fd;
-            epoll_ctl(epfd, EPOLL_CTL_MOD, ctx->upstream_fd, &ev);
+        auto ex = std::make_unique<Exchange>();
+        size_t consumed = 0;
+        if (ex->req.parse(view.data(), view.size(), consumed)) {
+            ctx->in_buf.consume(consumed);
         }
         else {
-            // 是 upstream 返回的响应
-            ctx->upstream_in_buf.append(buf, n);
-            // 将 upstream 的响应全部塞进 client 的 out_buf
-            ctx->out_buf.append(ctx->upstream_in_buf.data(), ctx->upstream_in_buf.size());
-            ctx->upstream_in_buf.read_all();
+            // 不完整的请求已超过高水位：头部完整就改为流式转发消息体，否则是头部过大
+            if (view.size() < _high_watermark || ex->req.state() == ParseState::ERROR) return;
+            ex = std::make_unique<Exchange>();
+            if (!ex->req.parse_head(view.data(), view.size(), consumed)) {
+                std::cerr << "[ERROR] request header too large" << std::endl;
+                reply_error(ex.get(), 431, "Request Header Fields Too Large");
+                ctx->in_buf.read_all();
+                ctx->keep_alive = false;
+                ctx->pipeline.push_back(std::move(ex));
+                return;
+            }
+            ctx->in_buf.consume(consumed);
+            if (ex->req.is_chunked()) ex->upload.expect_chunked();
+            else ex->upload.expect_length(ex->req.content_length());
+            ex->uploading = true;
+            ctx->upload = ex.get();
+            ctx->upload_scanned = 0;
+        }
+        ex->route = &Router::getInstance()->match(ex->req);
+        // 流式上传的消息体不在内存中，不镜像
+        if (ex->route->mirror && !ex->uploading && ex->req.method() != "CONNECT") {
+            Mirror::getInstance()->submit(*ex->route, ex->req, ctx->client_ip);
+        }
+        // CONNECT 之后的字节属于隧道，不再当作请求解析；隧道建立失败时回完错误就关闭
+        if (!ex->req.keep_alive() || ex->req.method() == "CONNECT") ctx->keep_alive = false;
+        ctx->pipeline.push_back(std::move(ex));
+    }
+}
 
-            epoll_event ev{};
-            ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
-            ev.data.fd = ctx->client_fd;
-            epoll_ctl(epfd, EPOLL_CTL_MOD, ctx->client_fd, &ev);
+bool ConnectionManager::pump_upload(ConnCtx* ctx, Poller* poller) {
+    Exchange* ex = ctx->upload;
+    auto view = ctx->in_buf.peek();
+    // 新到达的字节先分帧，确认哪些属于消息体
+    if (!ex->upload.done() && ctx->upload_scanned < view.size()) {
+        size_t used = 0;
+        if (!ex->upload.feed(view.data() + ctx->upload_scanned, view.size() - ctx->upload_scanned, used)) {
+            std::cerr << "[ERROR] malformed chunked request body" << std::endl;
+            close_conn(ctx, poller);
+            return true;
         }
+        ctx->upload_scanned += used;
     }
 
-    // ---------- 可写事件 ----------
-    if (events & EPOLLOUT) {
-        Buffer& buf = is_client ? ctx->out_buf : ctx->upstream_out_buf;
-        while (!buf.empty()) {
-            ssize_t n = write(fd, buf.data(), buf.size());
+    // 请求头写完之后才能接着写消息体
+    if (ex->upstream_fd >= 0 && ex->upstream_iov_pos == ex->upstream_iov.size()) {
+        while (ctx->upload_scanned > 0) {
+            ssize_t n = write(ex->upstream_fd, view.data(), ctx->upload_scanned);
             if (n < 0) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK) break;
                 perror("write");
-                close(fd);
-                remove_conn(fd);
-                return;
+                return false;
             }
-            
-            buf.consume(n);
+            ex->body_sent = true;
+            ctx->in_buf.consume(n);
+            ctx->upload_scanned -= n;
+            view = ctx->in_buf.peek();
         }
+    }
 
-        if (buf.empty()) {
-            epoll_event ev{};
-            ev.events = EPOLLIN | EPOLLET;
-            ev.data.fd = fd;
-            epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+    if (ex->upload.done() && ctx->upload_scanned == 0) {
+        ex->uploading = false;
+        ctx->upload = nullptr;
+        // 上游超时从消息体发完时算起
+        if (ex->route && ex->route->timeout_ms > 0) {
+            ex->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ex->route->timeout_ms);
+            arm_timer(ctx, poller);
         }
     }
+    return true;
+}
 
-    // ---------- 错误事件 ----------
-    if (events & (EPOLLERR | EPOLLHUP)) {
-        std::cerr << "epoll error/hup on fd " << fd << std::endl;
-        close(fd);
-        remove_conn(fd);
+void ConnectionManager::throttle_client(ConnCtx* ctx, Poller* poller) {
+    if (ctx->closed || ctx->tunnel_fd >= 0) return;
+    size_t level = std::max(ctx->in_buf.size(), ctx->out_buf.size());
+    bool paused = level >= (ctx->read_paused ? _low_watermark : _high_watermark);
+    if (paused == ctx->read_paused) return;
+
+    ctx->read_paused = paused;
+    bool splicing = !ctx->pipeline.empty() && ctx->pipeline.front()->splicing;
+    update_client_events(ctx, poller, !ctx->out_buf.empty() || ctx->pinned || splicing);
+}
+
+void ConnectionManager::update_client_events(ConnCtx* ctx, Poller* poller, bool want_write) {
+    // 完成式收发：暂停读即停止接收，可写即把 out_buf 交给内核
+    if (ctx->completion) {
+        if (ctx->read_paused != ctx->recv_stopped) {
+            if (ctx->read_paused) poller->stop_recv(ctx->client_fd);
+            else poller->recv(ctx->client_fd, _slab.handle(ctx->client_fd));
+            ctx->recv_stopped = ctx->read_paused;
+        }
+        if (want_write) flush_send(ctx, poller);
+        return;
     }
+    uint32_t events = EPOLLET;
+    if (!ctx->read_paused) events |= EPOLLIN;
+    if (want_write) events |= EPOLLOUT;
+    update_events(poller, ctx->client_fd, events);
 }
 
-int ConnectionManager::connect_to_upstream(const std::string& ip, int port) {
-    int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
-    if (sock < 0) return -1;
+void ConnectionManager::flush_send(ConnCtx* ctx, Poller* poller) {
+    if (ctx->sending || ctx->out_buf.empty()) return;
+    int fd = ctx->client_fd;
+    ctx->sending = true;
+    if (!poller->send(fd, _slab.handle(fd), ctx->out_buf.read_all(), false)) {
+        ctx->sending = false;
+        close_conn(ctx, poller);
+    }
+}
 
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
+void ConnectionManager::handle_upstream_event(ConnCtx* ctx, Exchange* ex, uint32_t events, Poller* poller) {
+    int fd = ex->upstream_fd;
 
-    if (connect(sock, (sockaddr*)&addr, sizeof(addr)) < 0) {
-        if (errno != EINPROGRESS) {
-            close(sock);
-            return -1;
+    // 消息体在内核中转发，上游的读事件、EOF 和错误都由 relay_body 处理
+    if (ex->splicing) {
+        relay_body(ctx, ex, poller);
+        return;
+    }
+
+    if (ex->req.method() == "CONNECT") {
+        establish_tunnel(ctx, ex, events, poller);
+        return;
+    }
+
+    // 上游连接出错（含非阻塞 connect 失败）优先处理
+    if (events & EPOLLERR) {
+        fail_exchange(ctx, ex, poller);
+        return;
+    }
+
+    // ---------- 可写事件 ----------
+    // 先写后读：读到完整响应后上游连接就归还了
+    if (events & EPOLLOUT) {
+        if (!write_iov(fd, ex->upstream_iov, ex->upstream_iov_pos)) {
+            fail_exchange(ctx, ex, poller);
+            return;
+        }
+        if (ex->uploading) {
+            if (!pump_upload(ctx, poller)) {
+                fail_exchange(ctx, ex, poller);
+                return;
+            }
+            if (ctx->closed) return;
+            // 上传转发完，继续解析之后的请求
+            if (!ex->uploading) {
+                parse_requests(ctx, poller);
+                if (ctx->closed) return;
+                dispatch_pending(ctx, poller);
+            }
+            throttle_client(ctx, poller);
+        }
+        if (ex->upstream_iov_pos == ex->upstream_iov.size() && !ex->uploading) {
+            update_events(poller, fd, upstream_events(*ex));
         }
     }
-    return sock;
+
+    // ---------- 可读事件 ----------
+    if (events & EPOLLIN) {
+        if (ex->streaming) {
+            stream_response(ctx, ex, poller);
+            return;
+        }
+
+        // 逐块读取，队首响应头一到齐就尝试切换到 splice，消息体不再经过用户态；
+        // 缓冲到上限时停下，由 throttle_response 决定改为流式转发还是暂停
+        size_t limit = std::max(_high_watermark, ex->buffer_limit);
+        bool eof = false;
+        char buf[4096];
+        while (ex->upstream_in_buf.size() < limit) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n > 0) {
+                ex->upstream_in_buf.append(buf, n);
+                if (start_splice(ctx, ex, poller)) {
+                    relay_body(ctx, ex, poller);
+                    return;
+                }
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n < 0) perror("read");
+            eof = true;
+            break;
+        }
+
+        // 按 HTTPResponse 分帧：1xx 临时响应之后还有最终响应
+        while (true) {
+            auto view = ex->upstream_in_buf.peek();
+            HTTPResponse resp;
+            resp.set_no_body(ex->req.method() == "HEAD");
+            size_t consumed = 0;
+            if (view.empty() || !resp.parse(view.data(), view.size(), consumed)) {
+                // 上游在响应完整前关闭，或响应无法解析
+                if (eof || resp.state() == ResponseParseState::ERROR) {
+                    fail_exchange(ctx, ex, poller);
+                    return;
+                }
+                if (resp.state() == ResponseParseState::BODY) publish_flight(ex, resp, view, false);
+                if (view.size() >= limit) {
+                    throttle_response(ctx, ex, resp, poller);
+                    return;
+                }
+                break;
+            }
+
+            int status = resp.status_code();
+            bool interim = status >= 100 && status < 200 && status != 101;
+            if (!interim && ex->cached && status == 304) {
+                // 我们替客户端发的条件请求：用更新后的缓存条目作答
+                CacheEntryPtr entry = ResponseCache::getInstance()->freshen(ex->req, ex->cached, resp);
+                deliver(*ex, ResponseCache::render(*entry, ex->req.method() == "HEAD", "REVALIDATED"));
+            }
+            else if (interim) {
+                ex->response.append(view.data(), consumed);
+            }
+            else {
+                // 缓存与合并请求保存的是上游的原始字节，压缩只作用于发给本客户端的副本
+                publish_flight(ex, resp, view.substr(0, consumed), true);
+                ResponseCache::getInstance()->store(ex->req, resp, view.data(), consumed);
+                deliver(*ex, resp, view.substr(0, consumed));
+            }
+            ex->upstream_in_buf.consume(consumed);
+            if (interim) continue;
+
+            bool reusable = !eof && upstream_reusable(resp) && ex->upstream_in_buf.empty();
+            // 5xx 计为后端失败，参与被动摘除
+            finish_upstream(ex, poller, reusable, status < 500);
+            complete_exchange(ex, poller);
+            flush_ready(ctx, poller);
+            dispatch_pending(ctx, poller);
+            // 上游连接已归还连接池，不能再操作该 fd
+            return;
+        }
+    }
+
+    if (events & EPOLLHUP) {
+        fail_exchange(ctx, ex, poller);
+    }
+}
+
+// fd 是 ex 的上游连接或竞速中的候选
+static bool owns_upstream(const Exchange& ex, int fd) {
+    if (ex.upstream_fd == fd) return true;
+    return ex.race && std::find(ex.race->fds.begin(), ex.race->fds.end(), fd) != ex.race->fds.end();
+}
+
+Exchange* ConnectionManager::find_exchange(ConnCtx* ctx, int upstream_fd) {
+    for (auto& ex : ctx->pipeline) {
+        if (owns_upstream(*ex, upstream_fd)) return ex.get();
+        if (ex->hedge && owns_upstream(*ex->hedge, upstream_fd)) return ex->hedge.get();
+    }
+    return nullptr;
+}
+
+void ConnectionManager::throttle_response(ConnCtx* ctx, Exchange* ex, const HTTPResponse& resp, Poller* poller) {
+    if (resp.state() != ResponseParseState::BODY) {
+        std::cerr << "[ERROR] upstream response header too large" << std::endl;
+        fail_exchange(ctx, ex, poller);
+        return;
+    }
+
+    // 要进缓存的响应需要完整的字节，在单个对象的上限以内继续缓冲
+    auto cache = ResponseCache::getInstance();
+    size_t cacheable = resp.header_size() + cache->max_object_bytes() + 1;
+    if (ex->buffer_limit < cacheable && cache->storable(ex->req, resp)) {
+        ex->buffer_limit = cacheable;
+        // 重新注册，套接字中剩余的数据会再触发可读事件
+        update_events(poller, ex->upstream_fd, upstream_events(*ex));
+        return;
+    }
+
+    // 前面的响应还没写完：停止读上游，排到队首后再恢复
+    Exchange* owner = ex->parent ? ex->parent : ex;
+    if (ctx->pinned || ctx->pipeline.front().get() != owner) {
+        ex->read_paused = true;
+        update_events(poller, ex->upstream_fd, upstream_events(*ex));
+        return;
+    }
+
+    // 头部一旦写给客户端就没有回头路：对冲请求先到则接管它的上游连接，否则作废对冲请求
+    if (ex->parent) {
+        finish_upstream(owner, poller, false, false, true);
+        owner->upstream_fd = ex->upstream_fd;
+        owner->backend = ex->backend;
+        owner->start = ex->start;
+        owner->upstream_in_buf = std::move(ex->upstream_in_buf);
+        owner->response = std::move(ex->response);
+        ex->upstream_fd = -1;
+        ex->backend = nullptr;
+        owner->hedge.reset();
+        ex = owner;
+    }
+    else if (ex->hedge) {
+        finish_upstream(ex->hedge.get(), poller, false, false, true);
+        ex->hedge.reset();
+    }
+    // 不能共享的响应由等待者各自转发
+    if (ex->leader) abandon_flight(*ex);
+
+    ex->streaming = true;
+    ex->status = resp.status_code();
+    ex->reusable = upstream_reusable(resp);
+    if (resp.is_chunked()) ex->body.expect_chunked();
+    else ex->body.expect_length(resp.content_length());
+    // 之前的 1xx 临时响应和本响应的头部先进 out_buf，消息体交给 stream_response 分帧；
+    // 需要压缩时头部改为分块编码
+    ctx->out_buf.append(ex->response.data(), ex->response.size());
+    ex->response.read_all();
+    std::string_view head(ex->upstream_in_buf.data(), resp.header_size());
+    std::string compressed_head;
+    ex->encoder = Compressor::getInstance()->start_stream(ex->req, resp, head, compressed_head);
+    if (ex->encoder) ctx->out_buf.append(compressed_head.data(), compressed_head.size());
+    else ctx->out_buf.append(head.data(), head.size());
+    ex->upstream_in_buf.consume(resp.header_size());
+    stream_response(ctx, ex, poller);
+}
+
+void ConnectionManager::stream_response(ConnCtx* ctx, Exchange* ex, Poller* poller) {
+    bool eof = false;
+    char buf[4096];
+    while (true) {
+        auto view = ex->upstream_in_buf.peek();
+        if (!view.empty()) {
+            size_t used = 0;
+            std::string payload;
+            if (!ex->body.feed(view.data(), view.size(), used, ex->encoder ? &payload : nullptr)) {
+                std::cerr << "[ERROR] malformed chunked response from upstream" << std::endl;
+                fail_exchange(ctx, ex, poller);
+                return;
+            }
+            if (!ex->encoder) {
+                ctx->out_buf.append(view.data(), used);
+            }
+            else if (!encode_chunk(*ex->encoder, payload, ex->body.done() ? StreamEncoder::Flush::FINISH
+                                                                          : StreamEncoder::Flush::NONE, ctx->out_buf)) {
+                std::cerr << "[ERROR] response compression failed" << std::endl;
+                close_conn(ctx, poller);
+                return;
+            }
+            ex->upstream_in_buf.consume(used);
+        }
+        if (ex->body.done()) break;
+        // 上游在消息体结束前关闭，客户端已收到头部，只能断开
+        if (eof) {
+            fail_exchange(ctx, ex, poller);
+            return;
+        }
+        // out_buf 超过高水位：先尽量写给客户端，仍写不下就停止读上游
+        if (ctx->out_buf.size() >= _high_watermark) {
+            if (!write_client(*ctx)) {
+                close_conn(ctx, poller);
+                return;
+            }
+            if (ctx->out_buf.size() >= _high_watermark) {
+                ex->read_paused = true;
+                update_events(poller, ex->upstream_fd, upstream_events(*ex));
+                break;
+            }
+        }
+
+        ssize_t n = read(ex->upstream_fd, buf, sizeof(buf));
+        if (n > 0) {
+            ex->upstream_in_buf.append(buf, n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n < 0) perror("read");
+        eof = true;
+    }
+
+    // 等待上游期间把压缩器攒下的数据先发出去，客户端不必等到下一批数据
+    if (ex->encoder && !ex->body.done() && !ex->read_paused &&
+        !encode_chunk(*ex->encoder, std::string(), StreamEncoder::Flush::SYNC, ctx->out_buf)) {
+        std::cerr << "[ERROR] response compression failed" << std::endl;
+        close_conn(ctx, poller);
+        return;
+    }
+    if (!write_client(*ctx)) {
+        close_conn(ctx, poller);
+        return;
+    }
+    if (ex->body.done()) {
+        // 消息体之后还有多余字节的上游连接不能复用
+        ex->streaming = false;
+        finish_upstream(ex, poller, ex->reusable && ex->upstream_in_buf.empty(), ex->status < 500);
+        ex->done = true;
+        flush_ready(ctx, poller);
+        dispatch_pending(ctx, poller);
+    }
+    if (!ctx->out_buf.empty()) update_client_events(ctx, poller, true);
+    throttle_client(ctx, poller);
+}
+
+void ConnectionManager::resume_upstream(Exchange* ex, Poller* poller) {
+    ex->read_paused = false;
+    // 重新注册，暂停期间积压的数据会再触发可读事件
+    update_events(poller, ex->upstream_fd, upstream_events(*ex));
+}
+
+bool ConnectionManager::start_splice(ConnCtx* ctx, Exchange* ex, Poller* poller) {
+    if (_splice_threshold == 0 || ex->header_checked || ctx->pinned || ctx->pipeline.front().get() != ex) return false;
+    // 用户态加密的 TLS 连接不能把明文直接 splice 给客户端，完成式收发的连接由内核从 out_buf 发送
+    if ((ctx->ssl && !ctx->ktls_send) || ctx->completion) return false;
+
+    auto view = ex->upstream_in_buf.peek();
+    HTTPResponse resp;
+    resp.set_no_body(ex->req.method() == "HEAD");
+    size_t consumed = 0;
+    resp.parse(view.data(), view.size(), consumed);
+    if (resp.state() == ResponseParseState::STATUS_LINE || resp.state() == ResponseParseState::HEADERS) return false;
+
+    // 头部只检查一次；已完整、出错、分块编码或消息体太小的响应走常规路径
+    ex->header_checked = true;
+    size_t buffered = view.size() - resp.header_size();
+    if (resp.state() != ResponseParseState::BODY || resp.is_chunked() ||
+        resp.content_length() < buffered + _splice_threshold) {
+        return false;
+    }
+    // 要进缓存的响应需要完整的字节，要压缩的响应要经过用户态，都不走 splice
+    if (ResponseCache::getInstance()->storable(ex->req, resp)) return false;
+    if (Compressor::getInstance()->choose(ex->req, resp, resp.content_length()) != Encoding::IDENTITY) return false;
+    // 太大而不能共享的响应由等待者各自转发
+    if (ex->leader) abandon_flight(*ex);
+
+    if (ctx->pipe_fds[0] < 0 && !open_pipe(ctx->pipe_fds)) return false;
+
+    // 头部一旦写给客户端就没有回头路，对冲请求作废
+    if (ex->hedge) {
+        finish_upstream(ex->hedge.get(), poller, false, false, true);
+        ex->hedge.reset();
+    }
+    ex->splicing = true;
+    ex->status = resp.status_code();
+    ex->reusable = upstream_reusable(resp);
+    ex->body_remaining = resp.content_length() - buffered;
+    // 队首之前的响应都已移入 out_buf，头部和已读到的部分消息体直接排在后面
+    ctx->out_buf.append(view.data(), view.size());
+    ex->upstream_in_buf.read_all();
+    update_client_events(ctx, poller, true);
+    return true;
+}
+
+void ConnectionManager::relay_body(ConnCtx* ctx, Exchange* ex, Poller* poller) {
+    // 管道里的消息体必须排在 out_buf 之后写给客户端
+    if (!write_client(*ctx)) {
+        close_conn(ctx, poller);
+        return;
+    }
+
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        if (ex->body_remaining > 0) {
+            ssize_t n = splice(ex->upstream_fd, nullptr, ctx->pipe_fds[1], nullptr, ex->body_remaining,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                ex->body_remaining -= n;
+                ctx->pipe_pending += n;
+                progress = true;
+            }
+            else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                fail_exchange(ctx, ex, poller);
+                return;
+            }
+        }
+        if (ctx->pipe_pending > 0 && ctx->out_buf.empty()) {
+            ssize_t n = splice(ctx->pipe_fds[0], nullptr, ctx->client_fd, nullptr, ctx->pipe_pending,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                ctx->pipe_pending -= n;
+                progress = true;
+            }
+            else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("splice");
+                close_conn(ctx, poller);
+                return;
+            }
+        }
+    }
+    if (ex->body_remaining > 0 || ctx->pipe_pending > 0) return;
+
+    ex->splicing = false;
+    finish_upstream(ex, poller, ex->reusable, ex->status < 500);
+    ex->done = true;
+    flush_ready(ctx, poller);
+    dispatch_pending(ctx, poller);
+}
+
+void ConnectionManager::dispatch_pending(ConnCtx* ctx, Poller* poller) {
+    size_t in_flight = 0;
+    bool earlier_pending = false;
+    for (auto& ex : ctx->pipeline) {
+        if (ex->done) continue;
+
+        bool idem = idempotent(ex->req);
+        if (!ex->dispatched) {
+            // 非幂等请求要等前面的请求全部完成，保证上游看到的顺序与客户端一致
+            if ((!idem && earlier_pending) || in_flight >= _pipeline_depth) break;
+            dispatch(ctx, ex.get(), poller);
+            if (ex->done) continue;
+        }
+
+        ++in_flight;
+        earlier_pending = true;
+        // 在途的非幂等请求之后的请求都要等它完成
+        if (!idem) break;
+    }
+    arm_timer(ctx, poller);
+}
+
+void ConnectionManager::dispatch(ConnCtx* ctx, Exchange* ex, Poller* poller) {
+    if (ex->req.method() == "CONNECT") {
+        dispatch_tunnel(ctx, ex, poller);
+        return;
+    }
+
+    // 流式上传的请求不走缓存和合并
+    if (!ex->uploading && (serve_from_cache(ex) || join_flight(ctx, ex, poller))) return;
+
+    auto upstreams = UpstreamManager::getInstance();
+    while (true) {
+        LoadBalancer& balancer = balancer_of(*ex);
+        Backend* backend = balancer.select(ex->req);
+        if (backend && backend == ex->failed_backend && balancer.backends().size() > 1) {
+            balancer.on_request_cancelled(backend);
+            backend = balancer.select(ex->req);
+        }
+        // 目标有多个地址时不在这里等待竞速，候选交给事件循环，连上后照常写请求
+        ConnectRace race;
+        int up = backend ? upstreams->acquire(backend->host, backend->port, &race) : -1;
+        // 登记不进连接表的 fd 收不到事件，按连接失败处理
+        if (up >= 0 && !register_conn(up, ctx->shared_from_this())) {
+            upstreams->release(up, false);
+            up = -1;
+        }
+        if (up >= 0 || !race.fds.empty()) {
+            ex->upstream_fd = up;
+            ex->backend = backend;
+            ex->start = std::chrono::steady_clock::now();
+            ex->dispatched = true;
+            prepare_forward(*ex, ctx->client_ip);
+            if (up >= 0) update_events(poller, up, EPOLLIN | EPOLLOUT | EPOLLET, EPOLL_CTL_ADD);
+            else start_race(ctx, ex, race, poller);
+
+            if (ex->route && ex->route->timeout_ms > 0 && !ex->uploading) {
+                ex->deadline = ex->start + std::chrono::milliseconds(ex->route->timeout_ms);
+            }
+            HedgePolicy& hedging = upstreams->hedging();
+            if (hedging.enabled() && hedgeable(ex->req) && !ex->leader && !ex->uploading) ex->hedge_at = ex->start + hedging.on_request();
+            return;
+        }
+
+        if (!backend) {
+            std::cerr << "[ERROR] no upstream backend available" << std::endl;
+        }
+        else {
+            std::cerr << "[ERROR] connect upstream " << backend->key() << " failed" << std::endl;
+            balancer.on_request_done(backend, std::chrono::microseconds(0), false);
+            ex->failed_backend = backend;
+            if (++ex->attempts < MAX_UPSTREAM_ATTEMPTS) continue;
+        }
+        reply_bad_gateway(ex);
+        return;
+    }
+}
+
+bool ConnectionManager::serve_from_cache(Exchange* ex) {
+    auto cache = ResponseCache::getInstance();
+    // 重试时已经查过缓存
+    if (!cache->enabled() || ex->attempts > 0) return false;
+
+    CacheEntryPtr entry;
+    DiskHitPtr mapped;
+    CacheResult result = cache->lookup(ex->req, entry, mapped);
+    if (mapped) {
+        std::string head = ResponseCache::render_head(*mapped);
+        ex->response.append(head.data(), head.size());
+        if (ex->req.method() != "HEAD") ex->pinned = PinnedBytes{mapped, mapped->body};
+        ex->dispatched = true;
+        ex->done = true;
+        return true;
+    }
+    if (result == CacheResult::FRESH || result == CacheResult::STALE) {
+        const char* tag = result == CacheResult::FRESH ? "HIT" : "STALE";
+        bool head_only = ex->req.method() == "HEAD";
+        // 大的消息体直接从缓存条目发送；开启压缩时可能要改写，仍整体生成
+        if (!head_only && _zerocopy_threshold > 0 && entry->body->size() >= _zerocopy_threshold &&
+            !Compressor::getInstance()->enabled()) {
+            std::string head = ResponseCache::render(*entry, true, tag);
+            ex->response.append(head.data(), head.size());
+            ex->pinned = PinnedBytes{entry->body, *entry->body};
+        }
+        else {
+            deliver(*ex, ResponseCache::render(*entry, head_only, tag));
+        }
+        ex->dispatched = true;
+        ex->done = true;
+        return true;
+    }
+    if (result == CacheResult::REVALIDATE) {
+        ResponseCache::add_validators(ex->req, *entry);
+        ex->cached = entry;
+    }
+    return false;
+}
+
+bool ConnectionManager::join_flight(ConnCtx* ctx, Exchange* ex, Poller* poller) {
+    std::string key;
+    if (ex->collapsed || ex->cached || !ResponseCache::getInstance()->collapse_key(ex->req, key)) return false;
+
+    std::lock_guard<std::mutex> lock(_flights_mutex);
+    if (_flights.size() > FLIGHT_SWEEP_THRESHOLD) {
+        for (auto it = _flights.begin(); it != _flights.end();) {
+            it = it->second.expired() ? _flights.erase(it) : std::next(it);
+        }
+    }
+
+    std::weak_ptr<Flight>& slot = _flights[key];
+    std::shared_ptr<Flight> flight = slot.lock();
+    if (flight) {
+        std::lock_guard<std::mutex> flight_lock(flight->mutex);
+        if (!flight->failed && !flight->done) {
+            // 响应头已到但不能共享或 Vary 不匹配：单独转发
+            if (flight->committed && !(flight->shareable && vary_matches(*flight, ex->req))) return false;
+
+            if (!ensure_waker(ctx, poller)) return false;
+            if (std::find(flight->waiters.begin(), flight->waiters.end(), ctx->waker) == flight->waiters.end()) {
+                flight->waiters.push_back(ctx->waker);
+            }
+            // 已有发布的数据时立即唤醒自己去取
+            if (!flight->data.empty()) ctx->waker->wake();
+            ex->flight = flight;
+            ex->collapsed = true;
+            ex->dispatched = true;
+            return true;
+        }
+    }
+
+    // 成为领头请求，照常转发
+    flight = std::make_shared<Flight>();
+    slot = flight;
+    ex->flight = flight;
+    ex->leader = true;
+    ex->collapsed = true;
+    return false;
+}
+
+void ConnectionManager::publish_flight(Exchange* ex, const HTTPResponse& resp, std::string_view bytes, bool complete) {
+    if (!ex->leader) return;
+    Flight& f = *ex->flight;
+    std::lock_guard<std::mutex> lock(f.mutex);
+    bool changed = complete;
+    if (!f.committed) {
+        f.committed = true;
+        f.shareable = ResponseCache::getInstance()->storable(ex->req, resp);
+        for (const auto& name : ResponseCache::vary_names(resp)) {
+            auto it = ex->req.headers().find(name);
+            f.vary.emplace_back(name, it == ex->req.headers().end() ? std::string() : it->second);
+        }
+        changed = true;
+    }
+    if (f.shareable && bytes.size() > ex->flight_offset) {
+        f.data.append(bytes.data() + ex->flight_offset, bytes.size() - ex->flight_offset);
+        changed = true;
+    }
+    ex->flight_offset = bytes.size();
+    f.done = complete;
+    if (changed) {
+        for (auto& waiter : f.waiters) waiter->wake();
+    }
+}
+
+bool ConnectionManager::ensure_waker(ConnCtx* ctx, Poller* poller) {
+    if (ctx->waker) return true;
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        perror("eventfd");
+        return false;
+    }
+    ctx->waker = std::make_shared<Waker>();
+    ctx->waker->fd = fd;
+    if (!register_conn(fd, ctx->shared_from_this())) {
+        ctx->waker.reset();
+        return false;
+    }
+    update_events(poller, fd, EPOLLIN | EPOLLET, EPOLL_CTL_ADD);
+    return true;
+}
+
+void ConnectionManager::on_wake(ConnCtx* ctx, Poller* poller) {
+    uint64_t count;
+    while (read(ctx->waker->fd, &count, sizeof(count)) > 0) {}
+
+    bool resumed = false;
+    for (auto& ex : ctx->pipeline) {
+        if (!ex->resolving) continue;
+        dispatch_tunnel(ctx, ex.get(), poller);
+        resumed = true;
+    }
+    if (resumed) arm_timer(ctx, poller);
+    on_flight_event(ctx, poller);
+}
+
+void ConnectionManager::on_flight_event(ConnCtx* ctx, Poller* poller) {
+    bool redispatch = false;
+    for (auto& ex : ctx->pipeline) {
+        if (!ex->flight || ex->leader || ex->done) continue;
+
+        Flight& f = *ex->flight;
+        std::unique_lock<std::mutex> lock(f.mutex);
+        if (f.failed || (f.committed && !(f.shareable && vary_matches(f, ex->req)))) {
+            lock.unlock();
+            // 已有字节写给了客户端，响应无法补全，只能断开
+            if (ex->flight_offset > ex->response.size()) {
+                close_conn(ctx, poller);
+                return;
+            }
+            ex->response.read_all();
+            ex->flight.reset();
+            ex->flight_offset = 0;
+            ex->dispatched = false;
+            redispatch = true;
+            continue;
+        }
+        if (f.data.size() > ex->flight_offset) {
+            ex->response.append(f.data.data() + ex->flight_offset, f.data.size() - ex->flight_offset);
+            ex->flight_offset = f.data.size();
+        }
+        if (f.done) {
+            ex->done = true;
+            lock.unlock();
+            ex->flight.reset();
+        }
+    }
+    flush_ready(ctx, poller);
+    if (redispatch) dispatch_pending(ctx, poller);
+}
+
+void ConnectionManager::dispatch_tunnel(ConnCtx* ctx, Exchange* ex, Poller* poller) {
+    std::string host;
+    int port = 0;
+    if (!parse_authority(ex->req.path(), host, port)) {
+        reply_error(ex, 400, "Bad Request");
+        return;
+    }
+    if (!_connect_any_port && _connect_ports.count(port) == 0) {
+        std::cerr << "[ERROR] CONNECT to port " << port << " is not allowed" << std::endl;
+        reply_error(ex, 403, "Forbidden");
+        return;
+    }
+    // 隧道两个方向都在内核中 splice，TLS 连接要求内核接管了两个方向的加解密
+    if (ctx->ssl && !(ctx->ktls_send && ctx->ktls_recv)) {
+        std::cerr << "[ERROR] CONNECT over TLS requires kernel TLS in both directions" << std::endl;
+        reply_error(ex, 501, "Not Implemented");
+        return;
+    }
+
+    // 目标通常不在后端列表里：缓存未命中时交给后台线程解析，不在事件线程上等 DNS；
+    // 解析结束后由唤醒器重新进入这里，仍未命中说明解析失败
+    std::vector<ResolvedAddr> addrs;
+    std::shared_ptr<Resolver> resolver = Resolver::getInstance();
+    bool waited = ex->resolving;
+    ex->resolving = false;
+    if (!resolver->lookup(host, port, addrs)) {
+        if (!waited && ensure_waker(ctx, poller) &&
+            !resolver->lookup(host, port, addrs, [waker = ctx->waker]() { waker->wake(); })) {
+            ex->resolving = true;
+            ex->dispatched = true;
+            return;
+        }
+        if (addrs.empty()) {
+            std::cerr << "[ERROR] Failed to resolve " << host << std::endl;
+            reply_bad_gateway(ex);
+            return;
+        }
+    }
+
+    ConnectRace race;
+    int up = UpstreamManager::getInstance()->connect_tunnel(addrs, race);
+    if (up >= 0 && !register_conn(up, ctx->shared_from_this())) {
+        close(up);
+        up = -1;
+    }
+    if (up < 0 && race.fds.empty()) {
+        std::cerr << "[ERROR] CONNECT " << ex->req.path() << " failed" << std::endl;
+        reply_bad_gateway(ex);
+        return;
+    }
+    ex->upstream_fd = up;
+    ex->start = std::chrono::steady_clock::now();
+    ex->dispatched = true;
+    if (up < 0) {
+        start_race(ctx, ex, race, poller);
+        return;
+    }
+    // 非阻塞 connect 完成时可写
+    update_events(poller, up, EPOLLOUT | EPOLLET, EPOLL_CTL_ADD);
+}
+
+void ConnectionManager::establish_tunnel(ConnCtx* ctx, Exchange* ex, uint32_t events, Poller* poller) {
+    int fd = ex->upstream_fd;
+    if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) return;
+
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if ((events & (EPOLLERR | EPOLLHUP)) || getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+        std::cerr << "[ERROR] CONNECT " << ex->req.path() << " failed" << std::endl;
+        finish_upstream(ex, poller, false, false);
+        reply_bad_gateway(ex);
+        flush_ready(ctx, poller);
+        return;
+    }
+
+    std::cout << "[STATE] Tunnel to " << ex->req.path() << " established, client_fd: " << ctx->client_fd
+              << ", upstream_fd: " << fd << std::endl;
+    static const std::string established = "HTTP/1.1 200 Connection Established\r\n\r\n";
+    ex->response.append(established.data(), established.size());
+    ex->done = true;
+    ex->upstream_fd = -1;
+    ctx->tunnel_fd = fd;
+    // CONNECT 之后不再解析请求，它必然是最后一条，flush 后管线为空，ex 随之释放
+    flush_ready(ctx, poller);
+    if (ctx->closed) return;
+
+    // 完成式收发的连接不经管道：客户端抢先发来的字节留在 in_buf，由 relay_tunnel 写给上游
+    if (ctx->completion) {
+        update_events(poller, fd, EPOLLIN | EPOLLOUT | EPOLLET);
+        relay_tunnel(ctx, poller);
+        return;
+    }
+
+    if (!open_pipe(ctx->to_upstream.fds) || !open_pipe(ctx->to_client.fds)) {
+        close_conn(ctx, poller);
+        return;
+    }
+    // 客户端在 200 之前抢先发来的字节（如 TLS ClientHello）先放进上行管道
+    auto early = ctx->in_buf.peek();
+    if (!early.empty()) {
+        ssize_t n = write(ctx->to_upstream.fds[1], early.data(), early.size());
+        if (n != static_cast<ssize_t>(early.size())) {
+            close_conn(ctx, poller);
+            return;
+        }
+        ctx->to_upstream.pending = n;
+        ctx->in_buf.read_all();
+    }
+
+    update_events(poller, fd, EPOLLIN | EPOLLOUT | EPOLLET);
+    pump_tunnel(ctx, poller);
+}
+
+void ConnectionManager::pump_tunnel(ConnCtx* ctx, Poller* poller) {
+    // 200 响应（以及之前排队的响应）写完之前，下行数据只进管道不写客户端
+    if (!write_client(*ctx) || !write_pinned(ctx, poller)) {
+        close_conn(ctx, poller);
+        return;
+    }
+
+    while (true) {
+        int up = pump(ctx->client_fd, ctx->tunnel_fd, ctx->to_upstream, true);
+        int down = pump(ctx->tunnel_fd, ctx->client_fd, ctx->to_client, ctx->out_buf.empty() && !ctx->pinned);
+        if (up < 0 || down < 0) {
+            close_conn(ctx, poller);
+            return;
+        }
+        if (!up && !down) break;
+    }
+
+    // 两个方向都已半关闭，隧道结束
+    if (ctx->to_upstream.shut && ctx->to_client.shut && ctx->zerocopy_sends.empty()) close_conn(ctx, poller);
+}
+
+void ConnectionManager::relay_tunnel(ConnCtx* ctx, Poller* poller) {
+    TunnelPipe& up = ctx->to_upstream;
+    TunnelPipe& down = ctx->to_client;
+    // 上行：写不完的留在 in_buf，等上游可写
+    if (!write_from(ctx->tunnel_fd, ctx->in_buf)) {
+        close_conn(ctx, poller);
+        return;
+    }
+    if (up.eof && ctx->in_buf.empty() && !up.shut) {
+        shutdown(ctx->tunnel_fd, SHUT_WR);
+        up.shut = true;
+    }
+    // 下行：out_buf 到高水位先停下，SEND 完成后接着读
+    if (!down.eof && ctx->out_buf.size() < _high_watermark && !read_into(ctx->tunnel_fd, ctx->out_buf, _high_watermark)) {
+        down.eof = true;
+    }
+    flush_send(ctx, poller);
+    if (ctx->closed) return;
+    if (down.eof && !ctx->sending && ctx->out_buf.empty() && !down.shut) {
+        shutdown(ctx->client_fd, SHUT_WR);
+        down.shut = true;
+    }
+
+    // 两个方向都已半关闭，隧道结束
+    if (up.shut && down.shut) {
+        close_conn(ctx, poller);
+        return;
+    }
+    // 上游写不动时停止接收客户端
+    ctx->read_paused = ctx->in_buf.size() >= _high_watermark;
+    update_client_events(ctx, poller, false);
+}
+
+void ConnectionManager::fail_exchange(ConnCtx* ctx, Exchange* ex, Poller* poller) {
+    std::cerr << "[ERROR] upstream " << (ex->backend ? ex->backend->key() : "?") << " failed" << std::endl;
+    ex->failed_backend = ex->backend;
+    finish_upstream(ex, poller, false, false);
+
+    // 响应头已经写给客户端，既不能重试也不能再补 502，只能断开
+    if (ex->splicing || ex->streaming) {
+        close_conn(ctx, poller);
+        return;
+    }
+    ex->response.read_all();
+    // 换后端重试的响应与已发布的字节对不上，等待者各自转发
+    if (ex->leader) abandon_flight(*ex);
+
+    // 对冲双方只要还有一方在途就等它的结果；都失败后才按原请求失败处理
+    if (ex->parent) {
+        Exchange* parent = ex->parent;
+        parent->hedge.reset();
+        if (parent->upstream_fd != -1 || parent->race) return;
+        ex = parent;
+    }
+    else if (ex->hedge) {
+        return;
+    }
+
+    // 请求可能已被上游处理，只有幂等请求才重试；已转发出去的上传消息体无法重发
+    if (!idempotent(ex->req) || ex->body_sent || ++ex->attempts >= MAX_UPSTREAM_ATTEMPTS) {
+        reply_bad_gateway(ex);
+    }
+    else {
+        ex->dispatched = false;
+    }
+    flush_ready(ctx, poller);
+    dispatch_pending(ctx, poller);
+}
+
+void ConnectionManager::start_race(ConnCtx* ctx, Exchange* ex, ConnectRace& race, Poller* poller) {
+    ex->race = std::make_unique<ConnectRace>(std::move(race));
+    std::vector<int> fds = ex->race->fds;
+    for (int fd : fds) watch_candidate(ctx, ex, fd, poller);
+    // 追加地址的时刻与总时限由 dispatch_pending / on_timer 随后调用的 arm_timer 设上；
+    // 候选全部登记失败时同样由定时器追加下一个地址或判负
+}
+
+void ConnectionManager::on_race_event(ConnCtx* ctx, Exchange* ex, int fd, uint32_t events, Poller* poller) {
+    if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) return;
+
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if ((events & (EPOLLERR | EPOLLHUP)) || getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+        drop_candidate(ex, fd, poller);
+        // 失败的地址立即由下一个地址补位，不必等满间隔
+        if (!advance_race(ctx, ex, poller)) lose_race(ctx, ex, poller);
+        return;
+    }
+
+    // 胜出：其余候选全部关闭，连接成为 upstream_fd，本次可写事件照常处理
+    ConnectRace& race = *ex->race;
+    UpstreamManager::getInstance()->race_won(race, fd);
+    while (!race.fds.empty()) drop_candidate(ex, race.fds.back(), poller);
+    ex->race.reset();
+    ex->upstream_fd = fd;
+    arm_timer(ctx, poller);
+    handle_upstream_event(ctx, ex, events, poller);
+}
+
+bool ConnectionManager::advance_race(ConnCtx* ctx, Exchange* ex, Poller* poller) {
+    ConnectRace& race = *ex->race;
+    auto now = std::chrono::steady_clock::now();
+    if (now >= race.deadline) return false;
+    if (race.fds.empty() || now >= race.next_at) {
+        int fd = UpstreamManager::getInstance()->race_next(race);
+        if (fd >= 0) watch_candidate(ctx, ex, fd, poller);
+    }
+    return !race.fds.empty();
+}
+
+void ConnectionManager::lose_race(ConnCtx* ctx, Exchange* ex, Poller* poller) {
+    if (ex->req.method() != "CONNECT") {
+        fail_exchange(ctx, ex, poller);
+        return;
+    }
+    std::cerr << "[ERROR] CONNECT " << ex->req.path() << " failed" << std::endl;
+    finish_upstream(ex, poller, false, false);
+    reply_bad_gateway(ex);
+    flush_ready(ctx, poller);
+}
+
+void ConnectionManager::drop_candidate(Exchange* ex, int fd, Poller* poller) {
+    auto& fds = ex->race->fds;
+    fds.erase(std::find(fds.begin(), fds.end(), fd));
+    remove_conn(fd);
+    poller->forget(fd);
+    close(fd);
+}
+
+void ConnectionManager::watch_candidate(ConnCtx* ctx, Exchange* ex, int fd, Poller* poller) {
+    if (register_conn(fd, ctx->shared_from_this())) {
+        update_events(poller, fd, race_events(*ex), EPOLL_CTL_ADD);
+        return;
+    }
+    auto& fds = ex->race->fds;
+    fds.erase(std::find(fds.begin(), fds.end(), fd));
+    close(fd);
+}
+
+void ConnectionManager::reply_bad_gateway(Exchange* ex) {
+    reply_error(ex, 502, "Bad Gateway");
+}
+
+void ConnectionManager::complete_exchange(Exchange* ex, Poller* poller) {
+    Exchange* owner = ex->parent ? ex->parent : ex;
+    if (ex->parent) {
+        finish_upstream(owner, poller, false, false, true);
+        owner->response = std::move(ex->response);
+        owner->hedge.reset();  // 释放 ex
+    }
+    else if (ex->hedge) {
+        finish_upstream(ex->hedge.get(), poller, false, false, true);
+        ex->hedge.reset();
+    }
+    owner->done = true;
+}
+
+void ConnectionManager::arm_timer(ConnCtx* ctx, Poller* poller) {
+    bool hedging = UpstreamManager::getInstance()->hedging().enabled();
+    auto next = std::chrono::steady_clock::time_point::max();
+    for (auto& ex : ctx->pipeline) {
+        if (hedging && ex->upstream_fd >= 0 && !ex->hedge) next = std::min(next, ex->hedge_at);
+        if ((ex->upstream_fd >= 0 || ex->race || ex->hedge) && !responding(*ex)) next = std::min(next, ex->deadline);
+        for (Exchange* e : {ex.get(), ex->hedge.get()}) {
+            if (e && e->race) next = std::min({next, e->race->next_at, e->race->deadline});
+        }
+    }
+    if (next == ctx->timer_at) return;
+    if (ctx->timer_fd < 0 && next == std::chrono::steady_clock::time_point::max()) return;
+
+    if (ctx->timer_fd < 0) {
+        ctx->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (ctx->timer_fd < 0) {
+            perror("timerfd_create");
+            return;
+        }
+        if (!register_conn(ctx->timer_fd, ctx->shared_from_this())) {
+            close(ctx->timer_fd);
+            ctx->timer_fd = -1;
+            return;
+        }
+        update_events(poller, ctx->timer_fd, EPOLLIN | EPOLLET, EPOLL_CTL_ADD);
+    }
+
+    // steady_clock 即 CLOCK_MONOTONIC，直接用绝对时刻；全零表示停止定时器
+    itimerspec spec{};
+    if (next != std::chrono::steady_clock::time_point::max()) {
+        auto ns = std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(next.time_since_epoch()).count());
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+    }
+    timerfd_settime(ctx->timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    ctx->timer_at = next;
+}
+
+void ConnectionManager::on_timer(ConnCtx* ctx, Poller* poller) {
+    uint64_t expirations;
+    while (read(ctx->timer_fd, &expirations, sizeof(expirations)) > 0) {}
+
+    auto now = std::chrono::steady_clock::now();
+    bool expired = false;
+    std::vector<Exchange*> lost;
+    for (auto& ex : ctx->pipeline) {
+        if (ex->deadline <= now && (ex->upstream_fd >= 0 || ex->race || ex->hedge)) {
+            // 已开始响应的不再计时，消息体由客户端的读取节奏决定
+            if (!responding(*ex)) {
+                expire_exchange(ex.get(), poller);
+                expired = true;
+                continue;
+            }
+            ex->deadline = std::chrono::steady_clock::time_point::max();
+        }
+        for (Exchange* e : {ex.get(), ex->hedge.get()}) {
+            if (e && e->race && !advance_race(ctx, e, poller)) lost.push_back(e);
+        }
+        if (ex->upstream_fd >= 0 && !ex->hedge && ex->hedge_at <= now) send_hedge(ctx, ex.get(), poller);
+    }
+    ctx->timer_at = std::chrono::steady_clock::time_point::min();
+    // 竞速中的请求不会完成，也不带对冲，处理其中一个不会释放另一个
+    for (Exchange* ex : lost) {
+        lose_race(ctx, ex, poller);
+        if (ctx->closed) return;
+        expired = true;
+    }
+    if (expired) {
+        flush_ready(ctx, poller);
+        dispatch_pending(ctx, poller);
+        return;
+    }
+    arm_timer(ctx, poller);
+}
+
+void ConnectionManager::send_hedge(ConnCtx* ctx, Exchange* ex, Poller* poller) {
+    ex->hedge_at = std::chrono::steady_clock::time_point::max();
+    // 原请求已经开始响应，说明后端没有卡住
+    if (!ex->upstream_in_buf.empty() || ex->splicing || ex->streaming) return;
+
+    auto upstreams = UpstreamManager::getInstance();
+    LoadBalancer& balancer = balancer_of(*ex);
+    Backend* backend = balancer.select(ex->req);
+    if (backend && backend == ex->backend) {
+        balancer.on_request_cancelled(backend);
+        backend = balancer.select(ex->req);
+    }
+    // 对冲到同一个后端没有意义；额度用完时不对冲
+    if (!backend || backend == ex->backend || !upstreams->hedging().try_acquire()) {
+        balancer.on_request_cancelled(backend);
+        return;
+    }
+
+    ConnectRace race;
+    int up = upstreams->acquire(backend->host, backend->port, &race);
+    if (up >= 0 && !register_conn(up, ctx->shared_from_this())) {
+        upstreams->release(up, false);
+        up = -1;
+    }
+    if (up < 0 && race.fds.empty()) {
+        balancer.on_request_done(backend, std::chrono::microseconds(0), false);
+        return;
+    }
+
+    auto hedge = std::make_unique<Exchange>();
+    hedge->req = ex->req;
+    hedge->route = ex->route;
+    hedge->cached = ex->cached;
+    hedge->parent = ex;
+    hedge->upstream_fd = up;
+    hedge->backend = backend;
+    hedge->start = std::chrono::steady_clock::now();
+    hedge->dispatched = true;
+    prepare_forward(*hedge, ctx->client_ip);
+    ex->hedge = std::move(hedge);
+
+    if (up < 0) {
+        start_race(ctx, ex->hedge.get(), race, poller);
+    }
+    else {
+        update_events(poller, up, EPOLLIN | EPOLLOUT | EPOLLET, EPOLL_CTL_ADD);
+    }
+    std::cout << "[STATE] Hedged " << ex->req.path() << " from " << ex->backend->key() << " to " << backend->key() << std::endl;
+}
+
+void ConnectionManager::expire_exchange(Exchange* ex, Poller* poller) {
+    std::cerr << "[ERROR] upstream " << (ex->backend ? ex->backend->key() : "?") << " timed out after "
+              << ex->route->timeout_ms << " ms on " << ex->req.path() << std::endl;
+    ex->deadline = std::chrono::steady_clock::time_point::max();
+    if (ex->hedge) {
+        finish_upstream(ex->hedge.get(), poller, false, false);
+        ex->hedge.reset();
+    }
+    // 超时计为后端失败，参与被动摘除；请求可能已被处理，不重试
+    finish_upstream(ex, poller, false, false);
+    if (ex->leader) abandon_flight(*ex);
+    ex->response.read_all();
+    reply_error(ex, 504, "Gateway Timeout");
+}
+
+void ConnectionManager::reply_error(Exchange* ex, int status, const std::string& reason) {
+    std::string resp =
+        "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: " + std::to_string(reason.size()) + "\r\n"
+        "\r\n" + reason;
+    ex->response.append(resp.data(), resp.size());
+    ex->dispatched = true;
+    ex->done = true;
+}
+
+void ConnectionManager::finish_upstream(Exchange* ex, Poller* poller, bool reusable, bool ok, bool cancelled) {
+    int up = ex->upstream_fd;
+    if (up == -1 && !ex->race) return;
+    // 上传的消息体没转发完，上游连接上的字节流已不完整
+    if (ex->uploading) reusable = false;
+
+    LoadBalancer& balancer = balancer_of(*ex);
+    if (cancelled) {
+        balancer.on_request_cancelled(ex->backend);
+    }
+    else {
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - ex->start);
+        balancer.on_request_done(ex->backend, latency, ok);
+        if (ok) UpstreamManager::getInstance()->hedging().record_latency(latency);
+    }
+    ex->backend = nullptr;
+    ex->upstream_fd = -1;
+    if (ex->race) {
+        // 竞速还没有结果，关闭全部候选
+        while (!ex->race->fds.empty()) drop_candidate(ex, ex->race->fds.back(), poller);
+        ex->race.reset();
+    }
+    else {
+        remove_conn(up);
+        // 空闲连接不留在事件循环中，重新借出时再注册
+        poller->del(up);
+    }
+    ex->upstream_in_buf.read_all();
+    ex->upstream_iov.clear();
+    ex->upstream_iov_pos = 0;
+    ex->read_paused = false;
+    ex->buffer_limit = 0;
+    UpstreamManager::getInstance()->release(up, reusable);
+}
+
+void ConnectionManager::flush_ready(ConnCtx* ctx, Poller* poller) {
+    bool flushed = false;
+    // pinned 中的字节发完之前，后面的响应不能进 out_buf
+    while (!ctx->pinned && !ctx->pipeline.empty() && ctx->pipeline.front()->done) {
+        Exchange* front = ctx->pipeline.front().get();
+        if (front->pinned && ctx->completion) {
+            // 完成式收发整体交给内核发送，缓存命中的消息体也复制进 out_buf
+            ctx->out_buf.append(front->response.data(), front->response.size());
+            ctx->out_buf.append(front->pinned.data.data(), front->pinned.data.size());
+            front->pinned = PinnedBytes{};
+        }
+        else if (front->pinned) {
+            ctx->out_buf.append(front->response.data(), front->response.size());
+            ctx->pinned = std::move(front->pinned);
+            ctx->pinned_sent = 0;
+        }
+        else if (_zerocopy_threshold > 0 && !ctx->completion && front->response.size() >= _zerocopy_threshold) {
+            // 大的缓冲响应不再复制进 out_buf，取走它的存储直接发送
+            auto bytes = std::make_shared<const std::vector<char>>(front->response.take());
+            ctx->pinned = PinnedBytes{bytes, std::string_view(bytes->data(), bytes->size())};
+            ctx->pinned_sent = 0;
+        }
+        else {
+            ctx->out_buf.append(front->response.data(), front->response.size());
+        }
+        if (front == ctx->upload) {
+            // 消息体没转发完就有了响应（上游提前作答或转发失败），剩余的消息体无法再分帧，写完响应后关闭
+            ctx->upload = nullptr;
+            ctx->upload_scanned = 0;
+            ctx->keep_alive = false;
+            ctx->in_buf.read_all();
+        }
+        ctx->pipeline.pop_front();
+        flushed = true;
+    }
+    // 排到队首的响应之前因背压暂停了读上游，现在恢复
+    if (!ctx->pinned && !ctx->pipeline.empty()) {
+        Exchange* front = ctx->pipeline.front().get();
+        if (front->read_paused && !front->streaming) resume_upstream(front, poller);
+        if (front->hedge && front->hedge->read_paused) resume_upstream(front->hedge.get(), poller);
+    }
+    // 等待中的合并请求排到队首后，已收到的字节先写给客户端
+    if (!ctx->pinned && !ctx->pipeline.empty()) {
+        Exchange* front = ctx->pipeline.front().get();
+        if (front->flight && !front->leader && !front->response.empty()) {
+            ctx->out_buf.append(front->response.data(), front->response.size());
+            front->response.read_all();
+            flushed = true;
+        }
+    }
+    if (flushed) {
+        update_client_events(ctx, poller, true);
+    }
+}
+
+bool ConnectionManager::write_pinned(ConnCtx* ctx, Poller* poller) {
+    while (ctx->pinned && ctx->out_buf.empty()) {
+        std::string_view data = ctx->pinned.data;
+        while (ctx->pinned_sent < data.size()) {
+            const char* p = data.data() + ctx->pinned_sent;
+            size_t left = data.size() - ctx->pinned_sent;
+            bool zerocopy = _zerocopy_threshold > 0 && left >= _zerocopy_threshold && !ctx->zerocopy_off;
+            if (zerocopy && !ctx->zerocopy) {
+                int one = 1;
+                ctx->zerocopy = setsockopt(ctx->client_fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+                ctx->zerocopy_off = !ctx->zerocopy;
+                zerocopy = ctx->zerocopy;
+            }
+            ssize_t n = -1;
+            if (zerocopy) {
+                n = send(ctx->client_fd, p, left, MSG_ZEROCOPY);
+                // 锁定的内存超过 optmem 上限时内核拒绝零拷贝，这次改为普通写
+                if (n < 0 && errno == ENOBUFS) zerocopy = false;
+            }
+            if (!zerocopy) {
+                n = ctx->ssl && !ctx->ktls_send ? TlsContext::write(ctx->ssl, p, left) : write(ctx->client_fd, p, left);
+            }
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+                perror(zerocopy ? "send" : "write");
+                return false;
+            }
+            if (zerocopy) track_zerocopy(*ctx, ctx->pinned.owner);
+            ctx->pinned_sent += n;
+        }
+        // 不再引用这段内存（零拷贝发送的由 zerocopy_sends 持有到完成通知），磁盘块可以被淘汰了；接着放行后面的响应
+        ctx->pinned = PinnedBytes{};
+        flush_ready(ctx, poller);
+        if (!write_client(*ctx)) return false;
+    }
+    return true;
+}
+
+void ConnectionManager::close_conn(ConnCtx* ctx, Poller* poller) {
+    for (auto& ex : ctx->pipeline) {
+        if (ex->hedge) finish_upstream(ex->hedge.get(), poller, false, false, true);
+        finish_upstream(ex.get(), poller, false, false, true);
+    }
+    if (ctx->timer_fd >= 0) {
+        remove_conn(ctx->timer_fd);
+        poller->forget(ctx->timer_fd);
+        close(ctx->timer_fd);
+        ctx->timer_fd = -1;
+    }
+    if (ctx->waker) {
+        remove_conn(ctx->waker->fd);
+        poller->del(ctx->waker->fd);
+        ctx->waker.reset();
+    }
+    if (ctx->tunnel_fd >= 0) {
+        remove_conn(ctx->tunnel_fd);
+        poller->del(ctx->tunnel_fd);
+        close(ctx->tunnel_fd);
+        ctx->tunnel_fd = -1;
+    }
+    ctx->upload = nullptr;
+    close_pipe(ctx->pipe_fds);
+    close_pipe(ctx->to_upstream.fds);
+    close_pipe(ctx->to_client.fds);
+    if (ctx->ssl) {
+        TlsContext::close(ctx->ssl);
+        ctx->ssl = nullptr;
+    }
+    ctx->closed = true;
+    // 内核发出零拷贝的字节前一直引用那段内存，关闭 fd 也不会让它放手，完成通知却只能从这个 fd 读到：
+    // 已排队的字节照常发完后送 FIN，fd 与 owner 保留到通知收齐；对端不再确认时由 TCP_USER_TIMEOUT 中止连接，
+    // 内核丢弃发送队列时同样会发出通知
+    if (!ctx->zerocopy_sends.empty()) {
+        int fd = ctx->client_fd;
+        int timeout = ZEROCOPY_LINGER_MS;
+        setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &timeout, sizeof(timeout));
+        shutdown(fd, SHUT_RDWR);
+        // 错误队列的通知以 EPOLLERR 报告，总会送达，不再关注读写
+        poller->mod(fd, _slab.handle(fd), EPOLLET);
+        ctx->lingering = true;
+    }
+    release_client(ctx, poller);
+}
+
+void ConnectionManager::release_client(ConnCtx* ctx, Poller* poller) {
+    if (ctx->lingering) {
+        reap_zerocopy(*ctx);
+        if (!ctx->zerocopy_sends.empty()) return;
+        ctx->lingering = false;
+    }
+    int fd = ctx->client_fd;
+    // 先解除映射再关闭，避免 fd 被新连接复用后误删新映射
+    remove_conn(fd);
+    poller->forget(fd);
+    close(fd);
+}
+
+void ConnectionManager::update_events(Poller* poller, int fd, uint32_t events, int op) {
+    if (op == EPOLL_CTL_ADD) poller->add(fd, _slab.handle(fd), events);
+    else poller->mod(fd, _slab.handle(fd), events);
 }
\ No newline at end of file
@@ -0,0 +1,334 @@
+#include "DiskCache.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+constexpr uint64_t DISK_MAGIC = 0x3130484341435850ULL;   // "PXCACH01"
+constexpr uint32_t RECORD_MAGIC = 0x52435850;             // "PXCR"
+constexpr size_t DISK_PAGE = 4096;
+constexpr size_t SLAB_SIZE = 1 << 20;
+constexpr size_t MIN_CHUNK = 4096;
+constexpr size_t SLOTS_PER_SLAB = SLAB_SIZE / MIN_CHUNK;
+constexpr int CHUNK_CLASSES = 9;                          // 4KB .. 1MB
+
+struct FileHeader {
+    uint64_t magic;
+    uint64_t slab_size;
+    uint64_t slab_count;
+};
+
+// 每 4KB 一项，hash 为 0 表示空闲；块大小由 length 推出
+struct DiskIndexEntry {
+    uint64_t hash;
+    uint32_t length;     // 记录总长
+    uint32_t checksum;   // 键、头部与消息体的校验和
+};
+
+struct RecordHeader {
+    uint32_t magic;
+    int32_t  status;
+    uint32_t key_len;
+    uint32_t head_len;
+    uint64_t body_len;
+    int64_t  stored_ms;
+    int64_t  fresh_until_ms;
+    int64_t  stale_until_ms;
+};
+
+static size_t round_up(size_t n, size_t align) {
+    return (n + align - 1) / align * align;
+}
+
+static uint64_t fnv1a(const char* data, size_t len, uint64_t h = 0xcbf29ce484222325ULL) {
+    for (size_t i = 0; i < len; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// 哈希 0 留作空闲标记
+static uint64_t key_hash(const std::string& key) {
+    uint64_t h = fnv1a(key.data(), key.size());
+    return h ? h : 1;
+}
+
+static uint32_t checksum(const char* rec) {
+    auto* hdr = reinterpret_cast<const RecordHeader*>(rec);
+    uint64_t h = fnv1a(rec + sizeof(RecordHeader), hdr->key_len + hdr->head_len + hdr->body_len);
+    return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+static int chunk_class(size_t length) {
+    for (int cls = 0; cls < CHUNK_CLASSES; ++cls) {
+        if (length <= (MIN_CHUNK << cls)) return cls;
+    }
+    return -1;
+}
+
+DiskHit::~DiskHit() {
+    cache->unpin(slot);
+}
+
+DiskCache::~DiskCache() {
+    close();
+}
+
+bool DiskCache::open(const std::string& path, size_t bytes) {
+    _slab_count = std::max<size_t>(1, bytes / SLAB_SIZE);
+    size_t index_bytes = round_up(_slab_count * SLOTS_PER_SLAB * sizeof(DiskIndexEntry), DISK_PAGE);
+    _size = DISK_PAGE + index_bytes + _slab_count * SLAB_SIZE;
+
+    _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        perror("open cache file");
+        return false;
+    }
+
+    // 格式或容量不符的旧文件截断为零后重建
+    FileHeader hdr{};
+    struct stat st{};
+    bool reuse = fstat(_fd, &st) == 0 && static_cast<size_t>(st.st_size) == _size &&
+                 pread(_fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+                 hdr.magic == DISK_MAGIC && hdr.slab_size == SLAB_SIZE && hdr.slab_count == _slab_count;
+    if (!reuse && (ftruncate(_fd, 0) < 0 || ftruncate(_fd, _size) < 0)) {
+        perror("ftruncate cache file");
+        close();
+        return false;
+    }
+
+    void* base = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap cache file");
+        close();
+        return false;
+    }
+    _base = static_cast<char*>(base);
+    _index = reinterpret_cast<DiskIndexEntry*>(_base + DISK_PAGE);
+    _slabs = _base + DISK_PAGE + index_bytes;
+    if (!reuse) {
+        hdr = FileHeader{DISK_MAGIC, SLAB_SIZE, _slab_count};
+        memcpy(_base, &hdr, sizeof(hdr));
+    }
+
+    load();
+    std::cout << "[INIT] Disk cache " << path << ": " << _slab_count << " slabs, "
+              << _slots.size() << " records " << (reuse ? "reloaded" : "(new file)") << std::endl;
+    return true;
+}
+
+void DiskCache::close() {
+    if (_base) munmap(_base, _size);
+    if (_fd >= 0) ::close(_fd);
+    _base = nullptr;
+    _fd = -1;
+}
+
+char* DiskCache::record(uint32_t slot) const {
+    return _slabs + static_cast<size_t>(slot) * MIN_CHUNK;
+}
+
+void DiskCache::load() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _slab_class.assign(_slab_count, -1);
+    _free_chunks.assign(CHUNK_CLASSES, {});
+    _lru.assign(CHUNK_CLASSES, {});
+    _free_slabs.clear();
+    _by_hash.clear();
+    _slots.clear();
+
+    size_t capacity = _slab_count * SLOTS_PER_SLAB;
+    for (uint32_t slot = 0; slot < capacity; ++slot) {
+        DiskIndexEntry& e = _index[slot];
+        if (e.hash == 0) continue;
+
+        // 与块对齐、slab 等级、记录头或键哈希任一不符的项作废
+        int cls = chunk_class(e.length);
+        size_t slab = slot / SLOTS_PER_SLAB;
+        auto* hdr = reinterpret_cast<const RecordHeader*>(record(slot));
+        bool ok = cls >= 0 && e.length >= sizeof(RecordHeader) &&
+                  (slot % SLOTS_PER_SLAB) % ((MIN_CHUNK << cls) / MIN_CHUNK) == 0 &&
+                  (_slab_class[slab] < 0 || _slab_class[slab] == cls) &&
+                  hdr->magic == RECORD_MAGIC &&
+                  sizeof(RecordHeader) + hdr->key_len + hdr->head_len + hdr->body_len == e.length &&
+                  key_hash(std::string(record(slot) + sizeof(RecordHeader), hdr->key_len)) == e.hash &&
+                  !_by_hash.count(e.hash);
+        if (!ok) {
+            e.hash = 0;
+            continue;
+        }
+        _slab_class[slab] = cls;
+        _by_hash[e.hash] = slot;
+        Slot& s = _slots[slot];
+        s.cls = cls;
+        _lru[cls].push_front(slot);
+        s.lru = _lru[cls].begin();
+    }
+
+    for (size_t slab = 0; slab < _slab_count; ++slab) {
+        int cls = _slab_class[slab];
+        if (cls < 0) {
+            _free_slabs.push_back(static_cast<uint32_t>(slab));
+            continue;
+        }
+        size_t step = (MIN_CHUNK << cls) / MIN_CHUNK;
+        for (size_t i = 0; i < SLOTS_PER_SLAB; i += step) {
+            uint32_t slot = static_cast<uint32_t>(slab * SLOTS_PER_SLAB + i);
+            if (!_slots.count(slot)) _free_chunks[cls].push_back(slot);
+        }
+    }
+}
+
+uint32_t DiskCache::allocate(int cls) {
+    auto& free = _free_chunks[cls];
+    if (free.empty() && !_free_slabs.empty()) {
+        // 新 slab 切成该等级的块；slab 一旦分配不再回收给其他等级
+        uint32_t slab = _free_slabs.back();
+        _free_slabs.pop_back();
+        _slab_class[slab] = cls;
+        size_t step = (MIN_CHUNK << cls) / MIN_CHUNK;
+        for (size_t i = SLOTS_PER_SLAB; i >= step; i -= step) {
+            free.push_back(static_cast<uint32_t>(slab * SLOTS_PER_SLAB + i - step));
+        }
+    }
+    if (free.empty()) {
+        for (auto it = _lru[cls].rbegin(); it != _lru[cls].rend(); ++it) {
+            if (_slots[*it].pins == 0) {
+                release(*it);
+                break;
+            }
+        }
+    }
+    if (free.empty()) return UINT32_MAX;
+    uint32_t slot = free.back();
+    free.pop_back();
+    return slot;
+}
+
+void DiskCache::release(uint32_t slot) {
+    auto it = _slots.find(slot);
+    if (it == _slots.end() || it->second.dead) return;
+    // 索引项立即清掉，重启后不会与新版本冲突；被引用的记录内容保持到命中释放
+    DiskIndexEntry& e = _index[slot];
+    _by_hash.erase(e.hash);
+    e.hash = 0;
+    _lru[it->second.cls].erase(it->second.lru);
+    if (it->second.pins > 0) {
+        it->second.dead = true;
+        return;
+    }
+    free_slot(slot);
+}
+
+void DiskCache::free_slot(uint32_t slot) {
+    int cls = _slots[slot].cls;
+    _slots.erase(slot);
+    _free_chunks[cls].push_back(slot);
+}
+
+void DiskCache::unpin(uint32_t slot) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _slots.find(slot);
+    if (it == _slots.end()) return;
+    if (--it->second.pins == 0 && it->second.dead) free_slot(slot);
+}
+
+DiskHitPtr DiskCache::lookup(const std::string& key) {
+    if (!is_open()) return nullptr;
+    uint64_t hash = key_hash(key);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto found = _by_hash.find(hash);
+    if (found == _by_hash.end()) return nullptr;
+    uint32_t slot = found->second;
+    const char* rec = record(slot);
+    auto* hdr = reinterpret_cast<const RecordHeader*>(rec);
+    const char* data = rec + sizeof(RecordHeader);
+    if (std::string_view(data, hdr->key_len) != key) return nullptr;
+
+    Slot& s = _slots[slot];
+    if (!s.verified) {
+        // 进程崩溃前可能只写了一半
+        if (checksum(rec) != _index[slot].checksum) {
+            release(slot);
+            return nullptr;
+        }
+        s.verified = true;
+    }
+    ++s.pins;
+    auto& lru = _lru[s.cls];
+    lru.splice(lru.begin(), lru, s.lru);
+
+    auto hit = std::make_shared<DiskHit>();
+    hit->cache = this;
+    hit->slot = slot;
+    hit->status = hdr->status;
+    hit->head = std::string_view(data + hdr->key_len, hdr->head_len);
+    hit->body = std::string_view(data + hdr->key_len + hdr->head_len, hdr->body_len);
+    hit->freshness = DiskFreshness{hdr->stored_ms, hdr->fresh_until_ms, hdr->stale_until_ms};
+    return hit;
+}
+
+void DiskCache::store(const std::string& key, int status, std::string_view head, std::string_view body, const DiskFreshness& freshness) {
+    if (!is_open()) return;
+    size_t length = sizeof(RecordHeader) + key.size() + head.size() + body.size();
+    int cls = chunk_class(length);
+    if (cls < 0) return;
+
+    uint32_t slot;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        slot = allocate(cls);
+        if (slot == UINT32_MAX) return;
+    }
+
+    // 块已从空闲表取出，拷贝可以在锁外进行
+    char* rec = record(slot);
+    RecordHeader hdr{RECORD_MAGIC, status, static_cast<uint32_t>(key.size()), static_cast<uint32_t>(head.size()),
+                     body.size(), freshness.stored_ms, freshness.fresh_until_ms, freshness.stale_until_ms};
+    memcpy(rec, &hdr, sizeof(hdr));
+    char* p = rec + sizeof(hdr);
+    memcpy(p, key.data(), key.size());
+    memcpy(p + key.size(), head.data(), head.size());
+    memcpy(p + key.size() + head.size(), body.data(), body.size());
+    uint32_t sum = checksum(rec);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint64_t hash = key_hash(key);
+    auto old = _by_hash.find(hash);
+    if (old != _by_hash.end()) release(old->second);
+
+    DiskIndexEntry& e = _index[slot];
+    e.length = static_cast<uint32_t>(length);
+    e.checksum = sum;
+    e.hash = hash;
+    _by_hash[hash] = slot;
+    Slot& s = _slots[slot];
+    s.cls = cls;
+    s.verified = true;
+    _lru[cls].push_front(slot);
+    s.lru = _lru[cls].begin();
+}
+
+void DiskCache::set_freshness(const std::string& key, const DiskFreshness& freshness) {
+    if (!is_open()) return;
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _by_hash.find(key_hash(key));
+    if (it == _by_hash.end()) return;
+    auto* hdr = reinterpret_cast<RecordHeader*>(record(it->second));
+    hdr->stored_ms = freshness.stored_ms;
+    hdr->fresh_until_ms = freshness.fresh_until_ms;
+    hdr->stale_until_ms = freshness.stale_until_ms;
+}
+
+void DiskCache::erase(const std::string& key) {
+    if (!is_open()) return;
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _by_hash.find(key_hash(key));
+    if (it != _by_hash.end()) release(it->second);
+}
@@ -22,6 +22,8 @@ const std::string& HTTPRequest::version() const { return _version; }
 const std::string& HTTPRequest::body()    const { return _body; }
 const std::unordered_map<std::string, std::string>& HTTPRequest::headers() const { return _headers; }
 ParseState HTTPRequest::state() const { return _state; }
+size_t HTTPRequest::content_length() const { return _content_length; }
+bool HTTPRequest::is_chunked() const { return _chunked; }
 
 std::string HTTPRequest::raw(){
     std::string result;
@@ -39,6 +41,85 @@ std::string HTTPRequest::raw(){
     return result;
 }
 
+void HTTPRequest::set_header(const std::string& name, const std::string& value){
+    _headers[name] = value;
+    if (std::find(_overrides.begin(), _overrides.end(), name) == _overrides.end()) _overrides.push_back(name);
+}
+
+// 逐跳头部只对本跳连接有意义，不转发给上游
+static bool hop_by_hop(const std::string& name) {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "te" || name == "trailer" || name == "upgrade";
+}
+
+static bool contains(const std::vector<std::string>& names, const std::string& name) {
+    return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+std::string HTTPRequest::forward_headers(const std::string& client_ip) const {
+    std::string head;
+    auto xff = _headers.find("x-forwarded-for");
+    head += "X-Forwarded-For: ";
+    if (xff != _headers.end() && !xff->second.empty()) head += xff->second + ", ";
+    head += client_ip + "\r\n";
+    auto via = _headers.find("via");
+    head += "Via: ";
+    if (via != _headers.end() && !via->second.empty()) head += via->second + ", ";
+    head += (_version.compare(0, 5, "HTTP/") == 0 ? _version.substr(5) : _version) + " proxy-server\r\n";
+    return head;
+}
+
+void HTTPRequest::forward_iov(const std::vector<std::string>& drop, std::string& extra, std::vector<iovec>& out) const {
+    // Connection 中列出的头部同样是逐跳的；协议升级请求保留 Connection/Upgrade 交给上游处理
+    std::vector<std::string> listed;
+    bool upgrade = _headers.count("upgrade") > 0;
+    auto conn = _headers.find("connection");
+    if (conn != _headers.end() && !upgrade) {
+        std::istringstream iss(conn->second);
+        std::string token;
+        while (std::getline(iss, token, ',')) {
+            auto l = token.find_first_not_of(" \t");
+            auto r = token.find_last_not_of(" \t");
+            if (l == std::string::npos) continue;
+            token = token.substr(l, r - l + 1);
+            std::transform(token.begin(), token.end(), token.begin(), ::tolower);
+            listed.push_back(token);
+        }
+    }
+
+    // 先补齐 extra，之后它的缓冲区不再变化，iovec 才能指向它
+    for (const auto& name : _overrides) {
+        extra += name + ": " + _headers.at(name) + "\r\n";
+    }
+
+    auto push = [&out](const char* base, size_t len) {
+        if (len == 0) return;
+        // 与上一段相邻时合并
+        if (!out.empty()) {
+            iovec& last = out.back();
+            if (static_cast<const char*>(last.iov_base) + last.iov_len == base) {
+                last.iov_len += len;
+                return;
+            }
+        }
+        out.push_back(iovec{const_cast<char*>(base), len});
+    };
+
+    size_t keep_from = 0;
+    std::string name;
+    for (const auto& line : _lines) {
+        name.assign(_raw, line.begin, line.name_len);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        bool hop = hop_by_hop(name) && !(upgrade && (name == "connection" || name == "upgrade"));
+        if (!hop && !contains(listed, name) && !contains(_overrides, name) && !contains(drop, name)) continue;
+        push(_raw.data() + keep_from, line.begin - keep_from);
+        keep_from = line.end;
+    }
+    push(_raw.data() + keep_from, _head_end - keep_from);
+    push(extra.data(), extra.size());
+    push(_raw.data() + _head_end, _raw.size() - _head_end);
+}
+
 bool HTTPRequest::parse(const char* data, size_t len, size_t& out_consumed) {
     size_t pos = 0, used = 0;
 
@@ -59,15 +140,30 @@ bool HTTPRequest::parse(const char* data, size_t len, size_t& out_consumed) {
         }
         if (!ok) return false;
         pos += used;
+        if (_state == ParseState::HEADERS) _headers_start = pos;
     }
 
     if (_state == ParseState::DONE) {
         out_consumed = pos;
+        _raw.assign(data, pos);
         return true;
     }
     return false;
 }
 
+bool HTTPRequest::parse_head(const char* data, size_t len, size_t& out_consumed) {
+    size_t pos = 0, used = 0;
+    if (!parse_request_line(data, len, used)) return false;
+    pos += used;
+    _headers_start = pos;
+    if (!parse_headers(data + pos, len - pos, used)) return false;
+    pos += used;
+
+    out_consumed = pos;
+    _raw.assign(data, pos);
+    return true;
+}
+
 bool HTTPRequest::parse_request_line(const char* data, size_t len, size_t& used) {
     int idx = find_crlf(data, len);
     if (idx < 0) return false;
@@ -92,7 +188,15 @@ bool HTTPRequest::parse_headers(const char* data, size_t len, size_t& used) {
 
         // 空行 => headers 结束
         if (idx == 0) {
+            _head_end = _headers_start + pos;
             pos += 2;
+            // 头部完整即可确定连接是否保持，流式转发消息体时不会走到 finalize
+            auto conn = _headers.find("connection");
+            if (_version == "HTTP/1.1") {
+                _keep_alive = (conn == _headers.end() || conn->second != "close");
+            } else {
+                _keep_alive = (conn != _headers.end() && conn->second == "keep-alive");
+            }
             auto it = _headers.find("content-length");
             if (it != _headers.end()) {
                 _content_length = std::stoul(it->second);
@@ -123,6 +227,7 @@ bool HTTPRequest::parse_headers(const char* data, size_t len, size_t& used) {
         auto r = val.find_last_not_of(" \t");
         val = (l == std::string::npos ? std::string() : val.substr(l, r - l + 1));
         _headers[key] = val;
+        _lines.push_back(HeaderLine{_headers_start + pos, _headers_start + pos + idx + 2, colon});
         pos += idx + 2;
     }
 }
@@ -174,13 +279,6 @@ bool HTTPRequest::parse_chunked_body(const char* data, size_t len, size_t& used)
 }
 
 void HTTPRequest::finalize() {
-    if (_version == "HTTP/1.1") {
-        auto it = _headers.find("connection");
-        _keep_alive = (it == _headers.end() || it->second != "close");
-    } else {
-        auto it = _headers.find("connection");
-        _keep_alive = (it != _headers.end() && it->second == "keep-alive");
-    }
     _state = ParseState::DONE;
 }
 
@@ -194,4 +292,9 @@ void HTTPRequest::reset() {
     _version.clear();
     _headers.clear();
     _body.clear();
+    _raw.clear();
+    _head_end = 0;
+    _headers_start = 0;
+    _lines.clear();
+    _overrides.clear();
 }
\ No newline at end of file
@@ -10,7 +10,9 @@ static int find_crlf(const char* data, size_t len) {
 HTTPResponse::HTTPResponse()
     : _state(ResponseParseState::STATUS_LINE),
       _chunked(false),
+      _no_body(false),
       _content_length(0),
+      _header_size(0),
       _status_code(0) {}
 
 bool HTTPResponse::is_complete() const { return _state == ResponseParseState::DONE; }
@@ -19,6 +21,11 @@ int HTTPResponse::status_code() const { return _status_code; }
 const std::string& HTTPResponse::reason_phrase() const { return _reason_phrase; }
 const std::unordered_map<std::string, std::string>& HTTPResponse::headers() const { return _headers; }
 const std::string& HTTPResponse::body() const { return _body; }
+ResponseParseState HTTPResponse::state() const { return _state; }
+size_t HTTPResponse::header_size() const { return _header_size; }
+size_t HTTPResponse::content_length() const { return _content_length; }
+bool HTTPResponse::is_chunked() const { return _chunked; }
+void HTTPResponse::set_no_body(bool no_body) { _no_body = no_body; }
 
 bool HTTPResponse::parse(const char* data, size_t len, size_t& out_consumed) {
     size_t pos = 0, used = 0;
@@ -31,6 +38,7 @@ bool HTTPResponse::parse(const char* data, size_t len, size_t& out_consumed) {
                 break;
             case ResponseParseState::HEADERS:
                 ok = parse_headers(data + pos, len - pos, used);
+                if (ok) _header_size = pos + used;
                 break;
             case ResponseParseState::BODY:
                 ok = parse_body(data + pos, len - pos, used);
@@ -77,7 +85,11 @@ bool HTTPResponse::parse_headers(const char* data, size_t len, size_t& used) {
         if (idx == 0) {
             pos += 2;
             auto it = _headers.find("content-length");
-            if (it != _headers.end()) {
+            // 1xx/204/304 以及 HEAD 的响应没有消息体
+            if (_no_body || (_status_code >= 100 && _status_code < 200) ||
+                _status_code == 204 || _status_code == 304) {
+                finalize();
+            } else if (it != _headers.end()) {
                 _content_length = std::stoul(it->second);
                 _state = ResponseParseState::BODY;
             } else if (_headers.find("transfer-encoding") != _headers.end() &&
@@ -0,0 +1,194 @@
+#include "HealthChecker.h"
+#include <iostream>
+#include <chrono>
+#include <cerrno>
+#include <string.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include "UpstreamManager.h"
+#include "Resolver.h"
+#include "HTTPResponse.h"
+
+HealthChecker::~HealthChecker() {
+    stop();
+}
+
+void HealthChecker::start(const HealthOptions& opts) {
+    if (opts.interval_ms <= 0 || _thread.joinable()) return;
+    _opts = opts;
+    _stop.store(false);
+    _thread = std::thread([this]() { run(); });
+    std::cout << "[INIT] Health checks every " << _opts.interval_ms << " ms on " << _opts.path << std::endl;
+}
+
+void HealthChecker::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop.store(true);
+    }
+    _cv.notify_all();
+    if (_thread.joinable()) _thread.join();
+}
+
+using Clock = std::chrono::steady_clock;
+
+// 一个后端的一次探测
+struct HealthChecker::Probe {
+    LoadBalancer* balancer = nullptr;
+    Backend* backend = nullptr;
+    std::vector<ResolvedAddr> addrs;
+    size_t next = 0;              // 下一个要尝试的地址
+    int fd = -1;
+    bool connected = false;
+    Clock::time_point attempt_deadline;  // 当前地址的连接时限，连上后为整轮的时限
+    std::string req;
+    size_t sent = 0;
+    std::string data;
+    bool done = false;
+    bool ok = false;
+};
+
+void HealthChecker::run() {
+    std::vector<LoadBalancer*> pools = UpstreamManager::getInstance()->pools();
+    std::vector<Probe> probes;
+    while (!_stop.load()) {
+        probes.clear();
+        for (LoadBalancer* balancer : pools) {
+            for (auto& backend : balancer->backends()) {
+                Probe& p = probes.emplace_back();
+                p.balancer = balancer;
+                p.backend = backend.get();
+            }
+        }
+        probe_all(probes);
+        if (_stop.load()) return;
+
+        for (auto& p : probes) {
+            int& streak = p.backend->probe_streak;
+            if (p.ok) {
+                streak = streak > 0 ? streak + 1 : 1;
+                if (streak >= _opts.rise) p.balancer->set_healthy(p.backend, true);
+            }
+            else {
+                streak = streak < 0 ? streak - 1 : -1;
+                if (-streak >= _opts.fall) p.balancer->set_healthy(p.backend, false);
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait_for(lock, std::chrono::milliseconds(_opts.interval_ms), [this]() { return _stop.load(); });
+    }
+}
+
+void HealthChecker::connect_next(Probe& p, Clock::time_point deadline) {
+    if (p.fd >= 0) close(p.fd);
+    p.fd = -1;
+    while (p.next < p.addrs.size()) {
+        const ResolvedAddr& addr = p.addrs[p.next++];
+        int fd = socket(addr.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd < 0) continue;
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&addr.addr), addr.len) < 0 && errno != EINPROGRESS) {
+            close(fd);
+            continue;
+        }
+        auto now = Clock::now();
+        p.fd = fd;
+        p.attempt_deadline = now + (deadline - now) / static_cast<int>(p.addrs.size() - p.next + 1);
+        return;
+    }
+    finish(p, false);
+}
+
+void HealthChecker::finish(Probe& p, bool ok) {
+    if (p.fd >= 0) close(p.fd);
+    p.fd = -1;
+    p.done = true;
+    p.ok = ok;
+}
+
+void HealthChecker::step(Probe& p, Clock::time_point deadline) {
+    if (!p.connected) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(p.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+            connect_next(p, deadline);
+            return;
+        }
+        p.connected = true;
+        p.attempt_deadline = deadline;
+    }
+
+    while (p.sent < p.req.size()) {
+        ssize_t n = send(p.fd, p.req.data() + p.sent, p.req.size() - p.sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            p.sent += n;
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) return;
+        finish(p, false);
+        return;
+    }
+
+    char buf[4096];
+    while (true) {
+        ssize_t n = recv(p.fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EAGAIN) return;
+        if (n <= 0) {
+            finish(p, false);
+            return;
+        }
+        p.data.append(buf, n);
+        HTTPResponse resp;
+        size_t consumed = 0;
+        if (resp.parse(p.data.data(), p.data.size(), consumed)) {
+            finish(p, resp.status_code() >= 200 && resp.status_code() < 400);
+            return;
+        }
+    }
+}
+
+void HealthChecker::probe_all(std::vector<Probe>& probes) {
+    auto deadline = Clock::now() + std::chrono::milliseconds(_opts.timeout_ms);
+    for (auto& p : probes) {
+        std::string host = is_unix_host(p.backend->host) ? "localhost" : p.backend->host;
+        p.req = "GET " + _opts.path + " HTTP/1.1\r\nHost: " + host +
+                "\r\nUser-Agent: proxy-health-check\r\nConnection: close\r\n\r\n";
+        if (!Resolver::getInstance()->lookup(p.backend->host, p.backend->port, p.addrs)) {
+            finish(p, false);
+            continue;
+        }
+        connect_next(p, deadline);
+    }
+
+    std::vector<pollfd> pfds;
+    std::vector<Probe*> owners;
+    while (!_stop.load()) {
+        auto now = Clock::now();
+        auto wake = deadline;
+        pfds.clear();
+        owners.clear();
+        for (auto& p : probes) {
+            // 当前地址没在时限内连上就换下一个地址；已连上的超过整轮时限即失败
+            if (!p.done && now >= p.attempt_deadline) {
+                if (p.connected || now >= deadline) finish(p, false);
+                else connect_next(p, deadline);
+            }
+            if (p.done) continue;
+            pfds.push_back(pollfd{p.fd, static_cast<short>(p.sent < p.req.size() ? POLLOUT : POLLIN), 0});
+            owners.push_back(&p);
+            wake = std::min(wake, p.attempt_deadline);
+        }
+        if (pfds.empty()) return;
+
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count() + 1;
+        if (poll(pfds.data(), pfds.size(), static_cast<int>(left)) < 0 && errno != EINTR) break;
+        for (size_t i = 0; i < pfds.size(); ++i) {
+            if (pfds[i].revents) step(*owners[i], deadline);
+        }
+    }
+    for (auto& p : probes) {
+        if (!p.done) finish(p, false);
+    }
+}
@@ -0,0 +1,47 @@
+#include "HedgePolicy.h"
+#include <algorithm>
+#include <vector>
+
+void HedgePolicy::set_options(const HedgeOptions& opts) {
+    _opts = opts;
+    _opts.percentile = std::clamp(_opts.percentile, 0.0, 100.0);
+    _enabled = (_opts.delay_ms > 0 || _opts.percentile > 0) && _opts.budget_percent > 0;
+}
+
+std::chrono::microseconds HedgePolicy::on_request() {
+    int64_t add = static_cast<int64_t>(_opts.budget_percent) * 10;
+    int64_t cur = _tokens.load(std::memory_order_relaxed);
+    while (cur < MAX_TOKENS && !_tokens.compare_exchange_weak(cur, std::min(cur + add, MAX_TOKENS))) {}
+
+    int64_t delay = static_cast<int64_t>(_opts.delay_ms) * 1000;
+    if (_opts.percentile > 0) delay = std::max(delay, _percentile_us.load(std::memory_order_relaxed));
+    // 百分位样本还不够且没有固定延迟时，保守地按 1 秒对冲
+    if (delay <= 0) delay = 1000000;
+    return std::chrono::microseconds(delay);
+}
+
+bool HedgePolicy::try_acquire() {
+    int64_t cur = _tokens.load(std::memory_order_relaxed);
+    while (cur >= 1000) {
+        if (_tokens.compare_exchange_weak(cur, cur - 1000)) return true;
+    }
+    return false;
+}
+
+void HedgePolicy::record_latency(std::chrono::microseconds latency) {
+    if (_opts.percentile <= 0) return;
+    uint32_t us = static_cast<uint32_t>(std::min<int64_t>(latency.count(), UINT32_MAX));
+    size_t n = _next_sample.fetch_add(1, std::memory_order_relaxed);
+    _samples[n % SAMPLES].store(us, std::memory_order_relaxed);
+    if ((n + 1) % RECOMPUTE_EVERY == 0 && n + 1 >= SAMPLES / 4) recompute();
+}
+
+void HedgePolicy::recompute() {
+    size_t count = std::min(_next_sample.load(std::memory_order_relaxed), SAMPLES);
+    std::vector<uint32_t> values(count);
+    for (size_t i = 0; i < count; ++i) values[i] = _samples[i].load(std::memory_order_relaxed);
+
+    size_t k = std::min(count - 1, static_cast<size_t>(count * _opts.percentile / 100.0));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    _percentile_us.store(values[k], std::memory_order_relaxed);
+}
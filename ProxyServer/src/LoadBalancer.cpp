@@ -0,0 +1,235 @@
+#include "LoadBalancer.h"
+#include <algorithm>
+#include <random>
+#include <iostream>
+
+// 一致性哈希中每单位权重对应的虚拟节点数
+constexpr int VNODES_PER_WEIGHT = 100;
+// EWMA 平滑系数，越大越偏向最近的样本
+constexpr double EWMA_ALPHA = 0.2;
+
+// FNV-1a 后接 murmur3 finalizer，使相近的键也能均匀散布在环上
+static uint64_t hash_key(const std::string& s) {
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint32_t fast_rand() {
+    thread_local std::minstd_rand rng(std::random_device{}());
+    return rng();
+}
+
+bool LoadBalancer::parse_policy(const std::string& name, LbPolicy& policy) {
+    if (name == "rr") policy = LbPolicy::ROUND_ROBIN;
+    else if (name == "least") policy = LbPolicy::LEAST_REQUEST;
+    else if (name == "p2c") policy = LbPolicy::P2C_EWMA;
+    else if (name == "hash") policy = LbPolicy::CONSISTENT_HASH;
+    else return false;
+    return true;
+}
+
+void LoadBalancer::set_backends(std::vector<std::shared_ptr<Backend>> backends) {
+    _backends = std::move(backends);
+    build_schedule();
+    build_ring();
+}
+
+void LoadBalancer::set_policy(LbPolicy policy) {
+    _policy = policy;
+}
+
+void LoadBalancer::set_outlier_options(const OutlierOptions& opts) {
+    _outlier = opts;
+}
+
+void LoadBalancer::set_hash_key(const std::string& spec) {
+    const std::string prefix = "header:";
+    if (spec.compare(0, prefix.size(), prefix) == 0) {
+        _hash_header = spec.substr(prefix.size());
+        std::transform(_hash_header.begin(), _hash_header.end(), _hash_header.begin(), ::tolower);
+    }
+    else {
+        _hash_header.clear();
+    }
+}
+
+// 平滑加权轮询（nginx 算法）预先展开成一个周期的序列，运行时只需原子自增取模
+void LoadBalancer::build_schedule() {
+    _schedule.clear();
+    int total = 0;
+    for (auto& b : _backends) total += b->weight;
+
+    std::vector<int> current(_backends.size(), 0);
+    for (int round = 0; round < total; ++round) {
+        size_t best = 0;
+        for (size_t i = 0; i < _backends.size(); ++i) {
+            current[i] += _backends[i]->weight;
+            if (current[i] > current[best]) best = i;
+        }
+        current[best] -= total;
+        _schedule.push_back(best);
+    }
+}
+
+void LoadBalancer::build_ring() {
+    _ring.clear();
+    for (size_t i = 0; i < _backends.size(); ++i) {
+        int vnodes = _backends[i]->weight * VNODES_PER_WEIGHT;
+        for (int v = 0; v < vnodes; ++v) {
+            _ring.emplace_back(hash_key(_backends[i]->key() + "#" + std::to_string(v)), i);
+        }
+    }
+    std::sort(_ring.begin(), _ring.end());
+}
+
+Backend* LoadBalancer::select(const HTTPRequest& req) {
+    if (_backends.empty()) return nullptr;
+
+    Backend* backend = nullptr;
+    switch (_policy) {
+        case LbPolicy::ROUND_ROBIN:     backend = select_round_robin(); break;
+        case LbPolicy::LEAST_REQUEST:   backend = select_least_request(); break;
+        case LbPolicy::P2C_EWMA:        backend = select_p2c(); break;
+        case LbPolicy::CONSISTENT_HASH: backend = select_hash(req); break;
+    }
+    if (backend) backend->outstanding.fetch_add(1);
+    return backend;
+}
+
+Backend* LoadBalancer::select_round_robin() {
+    int64_t now = now_ms();
+    uint64_t n = _rr_counter.fetch_add(1, std::memory_order_relaxed);
+    size_t size = _schedule.size();
+    Backend* fallback = nullptr;
+    for (size_t k = 0; k < size; ++k) {
+        Backend* b = _backends[_schedule[(n + k) % size]].get();
+        if (!available(b, now)) continue;
+        if (!fallback) fallback = b;
+        // 慢启动中的后端按权重系数概率性接收请求，落空则顺延给下一个
+        double factor = weight_factor(b, now);
+        if (factor >= 1.0 || fast_rand() % 1000 < factor * 1000) return b;
+    }
+    return fallback ? fallback : _backends[_schedule[n % size]].get();
+}
+
+// 按 (outstanding + 1) / 有效权重 取最小，起点轮转以免并列时总落在第一个后端
+Backend* LoadBalancer::select_least_request() {
+    int64_t now = now_ms();
+    size_t n = _backends.size();
+    size_t start = _rr_counter.fetch_add(1, std::memory_order_relaxed) % n;
+    Backend* best = nullptr;
+    double best_load = 0;
+    for (size_t k = 0; k < n; ++k) {
+        Backend* b = _backends[(start + k) % n].get();
+        if (!available(b, now)) continue;
+        double load = (b->outstanding.load() + 1.0) / (b->weight * weight_factor(b, now));
+        if (!best || load < best_load) {
+            best = b;
+            best_load = load;
+        }
+    }
+    return best ? best : _backends[start].get();
+}
+
+// 按权重随机抽两个可用后端，取 EWMA 延迟 × (在途数 + 1) / 慢启动系数 较小者
+Backend* LoadBalancer::select_p2c() {
+    int64_t now = now_ms();
+    size_t n = _schedule.size();
+    Backend* picks[2] = {nullptr, nullptr};
+    int found = 0;
+    for (int tries = 0; tries < 8 && found < 2; ++tries) {
+        Backend* b = _backends[_schedule[fast_rand() % n]].get();
+        if (!available(b, now) || (found == 1 && b == picks[0])) continue;
+        picks[found++] = b;
+    }
+    if (found == 0) return _backends[_schedule[fast_rand() % n]].get();
+    if (found == 1) return picks[0];
+
+    auto score = [this, now](const Backend* be) {
+        return (be->ewma_us.load() + 1.0) * (be->outstanding.load() + 1) / weight_factor(be, now);
+    };
+    return score(picks[0]) <= score(picks[1]) ? picks[0] : picks[1];
+}
+
+// 沿哈希环顺时针找到第一个可用后端，不可用的节点由其后继接管
+Backend* LoadBalancer::select_hash(const HTTPRequest& req) {
+    const std::string* key = &req.path();
+    if (!_hash_header.empty()) {
+        auto it = req.headers().find(_hash_header);
+        if (it != req.headers().end()) key = &it->second;
+    }
+
+    int64_t now = now_ms();
+    uint64_t h = hash_key(*key);
+    size_t pos = std::lower_bound(_ring.begin(), _ring.end(), std::make_pair(h, size_t(0))) - _ring.begin();
+    for (size_t k = 0; k < _ring.size(); ++k) {
+        Backend* b = _backends[_ring[(pos + k) % _ring.size()].second].get();
+        if (available(b, now)) return b;
+    }
+    return _backends[_ring[pos % _ring.size()].second].get();
+}
+
+void LoadBalancer::on_request_done(Backend* backend, std::chrono::microseconds latency, bool ok) {
+    if (!backend) return;
+    backend->outstanding.fetch_sub(1);
+    if (!ok) {
+        int failures = backend->consecutive_failures.fetch_add(1) + 1;
+        if (_outlier.consecutive_failures > 0 && failures >= _outlier.consecutive_failures) {
+            int64_t until = now_ms() + _outlier.ejection_ms;
+            backend->consecutive_failures.store(0);
+            backend->ejected_until_ms.store(until);
+            // 摘除结束即视为恢复，从那一刻开始慢启动
+            backend->recovered_ms.store(until);
+            std::cerr << "[HEALTH] Ejected backend " << backend->key() << " after "
+                      << failures << " consecutive failures" << std::endl;
+        }
+        return;
+    }
+    backend->consecutive_failures.store(0);
+
+    double sample = static_cast<double>(latency.count());
+    double old = backend->ewma_us.load();
+    double updated;
+    do {
+        updated = old == 0.0 ? sample : old + EWMA_ALPHA * (sample - old);
+    } while (!backend->ewma_us.compare_exchange_weak(old, updated));
+}
+
+void LoadBalancer::on_request_cancelled(Backend* backend) {
+    if (backend) backend->outstanding.fetch_sub(1);
+}
+
+void LoadBalancer::set_healthy(Backend* backend, bool healthy) {
+    bool was = backend->healthy.exchange(healthy);
+    if (was == healthy) return;
+
+    if (healthy) backend->recovered_ms.store(now_ms());
+    std::cerr << "[HEALTH] Backend " << backend->key() << " is now "
+              << (healthy ? "healthy" : "unhealthy") << std::endl;
+}
+
+int64_t LoadBalancer::now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool LoadBalancer::available(const Backend* backend, int64_t now) const {
+    return backend->healthy.load() && now >= backend->ejected_until_ms.load();
+}
+
+double LoadBalancer::weight_factor(const Backend* backend, int64_t now) const {
+    if (_outlier.slow_start_ms <= 0) return 1.0;
+    int64_t elapsed = now - backend->recovered_ms.load();
+    if (elapsed >= _outlier.slow_start_ms) return 1.0;
+    // 保留 10% 的下限，避免刚恢复的后端完全拿不到流量
+    return std::max(0.1, static_cast<double>(elapsed) / _outlier.slow_start_ms);
+}
@@ -0,0 +1,180 @@
+#include "Mirror.h"
+#include "UpstreamManager.h"
+#include "HTTPResponse.h"
+#include "BodyFramer.h"
+#include "Util.h"
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+
+using Clock = std::chrono::steady_clock;
+
+// 按百分比采样，每个线程各自的随机数发生器，不需要同步
+static bool sampled(double percent) {
+    if (percent >= 100) return true;
+    thread_local std::minstd_rand rng(std::random_device{}());
+    return std::uniform_real_distribution<double>(0, 100)(rng) < percent;
+}
+
+Mirror::~Mirror() {
+    stop();
+}
+
+void Mirror::start(const MirrorOptions& opts) {
+    if (!_threads.empty()) return;
+    _opts = opts;
+    _stop.store(false);
+    for (int i = 0; i < std::max(1, _opts.threads); ++i) {
+        _threads.emplace_back([this]() { run(); });
+    }
+    std::cout << "[INIT] Traffic mirroring enabled, " << _threads.size() << " threads, queue " << _opts.queue_size << std::endl;
+}
+
+void Mirror::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop.store(true);
+    }
+    _cv.notify_all();
+    for (auto& t : _threads) {
+        if (t.joinable()) t.join();
+    }
+    _threads.clear();
+}
+
+void Mirror::submit(const Route& route, const HTTPRequest& req, const std::string& client_ip) {
+    if (!route.mirror || _threads.empty() || !sampled(route.mirror_percent)) return;
+
+    // 在锁外复制请求，不拖慢后台线程取任务
+    Job job{route.mirror, req, client_ip};
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_queue.size() < _opts.queue_size) {
+            _queue.push_back(std::move(job));
+            _cv.notify_one();
+            return;
+        }
+    }
+    // 影子上游跟不上时丢弃，只在总数为 2 的幂时打印，避免刷屏
+    uint64_t total = ++_dropped;
+    if ((total & (total - 1)) == 0) {
+        std::cerr << "[ERROR] Mirror queue full, dropped " << total << " mirrored requests" << std::endl;
+    }
+}
+
+void Mirror::run() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cv.wait(lock, [this]() { return _stop.load() || !_queue.empty(); });
+            if (_stop.load()) return;
+            job = std::move(_queue.front());
+            _queue.pop_front();
+        }
+        if (send(job)) ++_sent;
+        else ++_failed;
+    }
+}
+
+bool Mirror::send(Job& job) {
+    auto upstreams = UpstreamManager::getInstance();
+    Backend* backend = job.balancer->select(job.req);
+    if (!backend) return false;
+    int fd = upstreams->acquire(backend->host, backend->port);
+    if (fd < 0) {
+        job.balancer->on_request_done(backend, std::chrono::microseconds(0), false);
+        return false;
+    }
+
+    // 与主路径相同的改写：去掉逐跳头部，追加 X-Forwarded-For 与 Via
+    std::string extra = job.req.forward_headers(job.client_ip);
+    std::vector<iovec> iov;
+    job.req.forward_iov({"x-forwarded-for", "via"}, extra, iov);
+
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::milliseconds(_opts.timeout_ms);
+    bool ok = true;
+    size_t pos = 0;
+    while (ok && pos < iov.size()) {
+        msghdr msg{};
+        msg.msg_iov = iov.data() + pos;
+        msg.msg_iovlen = std::min<size_t>(iov.size() - pos, IOV_MAX);
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) ok = wait_fd(fd, POLLOUT, deadline);
+            else ok = false;
+            continue;
+        }
+        // 跳过已写完的项，部分写出的项原地前移
+        while (pos < iov.size() && static_cast<size_t>(n) >= iov[pos].iov_len) n -= iov[pos++].iov_len;
+        if (n > 0) {
+            iov[pos].iov_base = static_cast<char*>(iov[pos].iov_base) + n;
+            iov[pos].iov_len -= n;
+        }
+    }
+
+    // 响应头解析出来之后消息体只分帧不保存，读完即丢弃
+    std::string head;
+    HTTPResponse resp;
+    BodyFramer body;
+    bool framing = false;
+    bool complete = false;
+    size_t leftover = 0;
+    char buf[16384];
+    while (ok && !complete) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            ok = wait_fd(fd, POLLIN, deadline);
+            continue;
+        }
+        if (n <= 0) {
+            ok = false;
+            continue;
+        }
+
+        const char* data = buf;
+        size_t len = n;
+        if (!framing) {
+            head.append(buf, n);
+            resp = HTTPResponse();
+            resp.set_no_body(job.req.method() == "HEAD");
+            size_t consumed = 0;
+            if (resp.parse(head.data(), head.size(), consumed)) {
+                complete = true;
+                leftover = head.size() - consumed;
+                continue;
+            }
+            if (resp.state() == ResponseParseState::ERROR) {
+                ok = false;
+                continue;
+            }
+            if (resp.state() != ResponseParseState::BODY) continue;
+            framing = true;
+            if (resp.is_chunked()) body.expect_chunked();
+            else body.expect_length(resp.content_length());
+            data = head.data() + resp.header_size();
+            len = head.size() - resp.header_size();
+        }
+        size_t used = 0;
+        ok = body.feed(data, len, used);
+        complete = ok && body.done();
+        leftover = len - used;
+    }
+
+    bool reusable = complete && leftover == 0 && resp.version() == "HTTP/1.1";
+    if (reusable) {
+        auto conn = resp.headers().find("connection");
+        reusable = conn == resp.headers().end() || conn->second != "close";
+    }
+    upstreams->release(fd, reusable);
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+    job.balancer->on_request_done(backend, latency, complete && resp.status_code() < 500);
+    return complete;
+}
@@ -2,8 +2,11 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <thread>
 #include <getopt.h>
 #include <cstring>
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
 #include <cerrno>
 #include <unistd.h>
@@ -15,6 +18,13 @@
 #include "ThreadPool.h"
 #include "ConnectionManager.h"
 #include "UpstreamManager.h"
+#include "HealthChecker.h"
+#include "ResponseCache.h"
+#include "Compressor.h"
+#include "Router.h"
+#include "Mirror.h"
+#include "TlsContext.h"
+#include "Poller.h"
 
 constexpr int MAX_EVENTS = 65535;
 
@@ -22,7 +32,30 @@ constexpr int MAX_EVENTS = 65535;
 std::string g_ip;
 int g_port = 0;
 int g_thread_count = 0;
-std::string g_proxy_url;
+int g_reactors = 0;  // 事件循环线程数，0 表示单个 epoll 线程 + 线程池
+std::string g_io_engine = "epoll";  // 反应堆线程的事件后端：epoll 或 uring
+size_t g_pipeline_depth = 8;
+size_t g_splice_threshold = 16384;
+size_t g_zerocopy_threshold = 0;
+size_t g_high_watermark = 256 << 10;
+size_t g_low_watermark = 64 << 10;
+std::string g_connect_ports = "443";
+std::string g_proxy_url = "http://127.0.0.1:8888";
+std::vector<std::string> g_pools;   // NAME=后端列表
+std::vector<std::string> g_routes;  // [HOST]/PREFIX=POOL[;timeout=MS]
+int g_upstream_timeout_ms = 0;
+MirrorOptions g_mirror_opts;
+std::string g_lb_policy = "rr";
+std::string g_hash_key = "path";
+PoolOptions g_pool_opts;
+HealthOptions g_health_opts;
+OutlierOptions g_outlier_opts;
+ResolverOptions g_resolver_opts;
+HedgeOptions g_hedge_opts;
+std::string g_source_ips;
+CacheOptions g_cache_opts;
+CompressOptions g_compress_opts;
+TlsOptions g_tls_opts;
 
 int set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
@@ -30,13 +63,136 @@ int set_nonblocking(int fd) {
     return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
+// 创建非阻塞的监听socket，失败返回 -1；reuse_port 时多个socket可以绑定同一地址
+int create_listener(bool reuse_port) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)); // 设置复用socket
+    if (reuse_port && setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        perror("setsockopt(SO_REUSEPORT)");
+        close(listen_fd);
+        return -1;
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(g_port);
+    inet_pton(AF_INET, g_ip.c_str(), &addr.sin_addr);
+
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+        perror("bind/listen");
+        close(listen_fd);
+        return -1;
+    }
+    set_nonblocking(listen_fd); //非阻塞
+    return listen_fd;
+}
+
+// 反应堆线程：独占一个监听socket和一个事件循环，接受的连接从头到尾都在本线程处理，事件不经线程池
+void run_reactor(int listen_fd) {
+    // io_uring 的环只能由创建它的线程使用，在本线程内创建
+    std::unique_ptr<Poller> poller = Poller::create(g_io_engine, MAX_EVENTS);
+    if (!poller || !poller->add_listener(listen_fd)) {
+        std::cerr << "[ERROR] Failed to start " << g_io_engine << " event loop" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::shared_ptr<ConnectionManager> ConnMgr = ConnectionManager::getInstance();
+
+    std::vector<PollEvent> events;
+    while (true) {
+        int n = poller->wait(events);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("poller wait");
+            break;
+        }
+
+        for (const PollEvent& ev : events) {
+            if (ev.kind == PollEvent::ACCEPT) {
+                if (ev.res >= 0) {
+                    ConnMgr->accept_conn(ev.res, poller.get());
+                }
+                else {
+                    errno = -ev.res;
+                    perror("accept");
+                }
+            }
+            else if (ev.kind != PollEvent::READY) {
+                ConnMgr->handle_completion(ev, poller.get());
+            }
+            else if (ev.handle == static_cast<uint64_t>(listen_fd)) {
+                ConnMgr->accept_new_conn(listen_fd, poller.get());
+            }
+            else {
+                ConnMgr->handle_io_event(ev.handle, ev.events, poller.get());
+            }
+        }
+    }
+}
+
 // 参数解析
 void parse_args(int argc, char* argv[]) {
     static struct option long_opts[] = {
         {"ip",      required_argument, nullptr, 'i'},
         {"port",    required_argument, nullptr, 'p'},
         {"threads", required_argument, nullptr, 't'},
+        {"reactors", required_argument, nullptr, 0 },
+        {"io-engine", required_argument, nullptr, 0 },
         {"proxy",   required_argument, nullptr,  0 },
+        {"pool",    required_argument, nullptr,  0 },
+        {"route",   required_argument, nullptr,  0 },
+        {"upstream-timeout", required_argument, nullptr, 0 },
+        {"mirror-queue",     required_argument, nullptr, 0 },
+        {"mirror-threads",   required_argument, nullptr, 0 },
+        {"mirror-timeout",   required_argument, nullptr, 0 },
+        {"pipeline-depth", required_argument, nullptr, 0 },
+        {"splice-threshold", required_argument, nullptr, 0 },
+        {"zerocopy-threshold", required_argument, nullptr, 0 },
+        {"buffer-high-watermark", required_argument, nullptr, 0 },
+        {"buffer-low-watermark",  required_argument, nullptr, 0 },
+        {"connect-ports",    required_argument, nullptr, 0 },
+        {"lb",       required_argument, nullptr, 0 },
+        {"hash-key", required_argument, nullptr, 0 },
+        {"pool-max-idle", required_argument, nullptr, 0 },
+        {"pool-lifetime", required_argument, nullptr, 0 },
+        {"pool-prewarm",  required_argument, nullptr, 0 },
+        {"connect-timeout", required_argument, nullptr, 0 },
+        {"connect-attempt-delay", required_argument, nullptr, 0 },
+        {"dns-ttl",         required_argument, nullptr, 0 },
+        {"health-path",     required_argument, nullptr, 0 },
+        {"health-interval", required_argument, nullptr, 0 },
+        {"health-timeout",  required_argument, nullptr, 0 },
+        {"health-rise",     required_argument, nullptr, 0 },
+        {"health-fall",     required_argument, nullptr, 0 },
+        {"eject-failures",  required_argument, nullptr, 0 },
+        {"eject-time",      required_argument, nullptr, 0 },
+        {"slow-start",      required_argument, nullptr, 0 },
+        {"hedge-delay",      required_argument, nullptr, 0 },
+        {"hedge-percentile", required_argument, nullptr, 0 },
+        {"hedge-budget",     required_argument, nullptr, 0 },
+        {"source-ips",       required_argument, nullptr, 0 },
+        {"source-ports",     required_argument, nullptr, 0 },
+        {"cache-size",        required_argument, nullptr, 0 },
+        {"cache-shards",      required_argument, nullptr, 0 },
+        {"cache-max-object",  required_argument, nullptr, 0 },
+        {"cache-default-ttl", required_argument, nullptr, 0 },
+        {"cache-disk",        required_argument, nullptr, 0 },
+        {"cache-disk-size",   required_argument, nullptr, 0 },
+        {"compress-level",    required_argument, nullptr, 0 },
+        {"compress-min-size", required_argument, nullptr, 0 },
+        {"compress-types",    required_argument, nullptr, 0 },
+        {"tls-cert",            required_argument, nullptr, 0 },
+        {"tls-key",             required_argument, nullptr, 0 },
+        {"tls-session-cache",   required_argument, nullptr, 0 },
+        {"tls-session-timeout", required_argument, nullptr, 0 },
+        {"tls-ticket-key",      required_argument, nullptr, 0 },
+        {"ktls",                required_argument, nullptr, 0 },
         {0, 0, nullptr, 0}
     };
 
@@ -46,85 +202,341 @@ void parse_args(int argc, char* argv[]) {
             case 'i': g_ip = optarg; break;
             case 'p': g_port = std::atoi(optarg); break;
             case 't': g_thread_count = std::atoi(optarg); break;
-            case 0:
-                if (std::string(long_opts[idx].name) == "proxy") {
+            case 0: {
+                std::string name = long_opts[idx].name;
+                if (name == "proxy") {
                     g_proxy_url = optarg;
                 }
+                else if (name == "pool") {
+                    g_pools.push_back(optarg);
+                }
+                else if (name == "route") {
+                    g_routes.push_back(optarg);
+                }
+                else if (name == "upstream-timeout") {
+                    g_upstream_timeout_ms = std::atoi(optarg);
+                }
+                else if (name == "mirror-queue") {
+                    g_mirror_opts.queue_size = std::strtoul(optarg, nullptr, 10);
+                }
+                else if (name == "mirror-threads") {
+                    g_mirror_opts.threads = std::atoi(optarg);
+                }
+                else if (name == "mirror-timeout") {
+                    g_mirror_opts.timeout_ms = std::atoi(optarg);
+                }
+                else if (name == "reactors") {
+                    g_reactors = std::atoi(optarg);
+                }
+                else if (name == "io-engine") {
+                    g_io_engine = optarg;
+                    if (g_io_engine != "epoll" && g_io_engine != "uring") {
+                        std::cerr << "[ERROR] --io-engine must be epoll or uring" << std::endl;
+                        std::exit(EXIT_FAILURE);
+                    }
+                }
+                else if (name == "pipeline-depth") {
+                    g_pipeline_depth = std::strtoul(optarg, nullptr, 10);
+                }
+                else if (name == "splice-threshold") {
+                    g_splice_threshold = std::strtoul(optarg, nullptr, 10);
+                }
+                else if (name == "zerocopy-threshold") {
+                    g_zerocopy_threshold = std::strtoul(optarg, nullptr, 10);
+                }
+                else if (name == "buffer-high-watermark") {
+                    g_high_watermark = std::strtoul(optarg, nullptr, 10);
+                }
+                else if (name == "buffer-low-watermark") {
+                    g_low_watermark = std::strtoul(optarg, nullptr, 10);
+                }
+                else if (name == "connect-ports") {
+                    g_connect_ports = optarg;
+                }
+                else if (name == "lb") {
+                    g_lb_policy = optarg;
+                }
+                else if (name == "hash-key") {
+                    g_hash_key = optarg;
+                }
+                else if (name == "pool-max-idle") {
+                    g_pool_opts.max_idle = std::strtoul(optarg, nullptr, 10);
+                }
+                else if (name == "pool-lifetime") {
+                    g_pool_opts.max_lifetime_ms = std::atoi(optarg);
+                }
+                else if (name == "pool-prewarm") {
+                    g_pool_opts.prewarm = std::strtoul(optarg, nullptr, 10);
+                }
+                else if (name == "connect-timeout") {
+                    g_pool_opts.connect_timeout_ms = std::atoi(optarg);
+                }
+                else if (name == "connect-attempt-delay") {
+                    g_pool_opts.attempt_delay_ms = std::atoi(optarg);
+                }
+                else if (name == "dns-ttl") {
+                    g_resolver_opts.default_ttl_ms = std::atoi(optarg);
+                }
+                else if (name == "health-path") {
+                    g_health_opts.path = optarg;
+                }
+                else if (name == "health-interval") {
+                    g_health_opts.interval_ms = std::atoi(optarg);
+                }
+                else if (name == "health-timeout") {
+                    g_health_opts.timeout_ms = std::atoi(optarg);
+                }
+                else if (name == "health-rise") {
+                    g_health_opts.rise = std::atoi(optarg);
+                }
+                else if (name == "health-fall") {
+                    g_health_opts.fall = std::atoi(optarg);
+                }
+                else if (name == "eject-failures") {
+                    g_outlier_opts.consecutive_failures = std::atoi(optarg);
+                }
+                else if (name == "eject-time") {
+                    g_outlier_opts.ejection_ms = std::atoi(optarg);
+                }
+                else if (name == "slow-start") {
+                    g_outlier_opts.slow_start_ms = std::atoi(optarg);
+                }
+                else if (name == "hedge-delay") {
+                    g_hedge_opts.delay_ms = std::atoi(optarg);
+                }
+                else if (name == "hedge-percentile") {
+                    g_hedge_opts.percentile = std::atof(optarg);
+                }
+                else if (name == "hedge-budget") {
+                    g_hedge_opts.budget_percent = std::atoi(optarg);
+                }
+                else if (name == "source-ips") {
+                    g_source_ips = optarg;
+                }
+                else if (name == "source-ports") {
+                    if (std::sscanf(optarg, "%d-%d", &g_pool_opts.source_port_min, &g_pool_opts.source_port_max) != 2 ||
+                        g_pool_opts.source_port_min <= 0 || g_pool_opts.source_port_max > 65535 ||
+                        g_pool_opts.source_port_min > g_pool_opts.source_port_max) {
+                        std::cerr << "[ERROR] Invalid source port range: " << optarg << std::endl;
+                        std::exit(EXIT_FAILURE);
+                    }
+                }
+                else if (name == "cache-size") {
+                    g_cache_opts.max_bytes = std::strtoul(optarg, nullptr, 10);
+                }
+                else if (name == "cache-shards") {
+                    g_cache_opts.shards = std::strtoul(optarg, nullptr, 10);
+                }
+                else if (name == "cache-max-object") {
+                    g_cache_opts.max_object_bytes = std::strtoul(optarg, nullptr, 10);
+                }
+                else if (name == "cache-default-ttl") {
+                    g_cache_opts.default_ttl_ms = std::atoi(optarg);
+                }
+                else if (name == "cache-disk") {
+                    g_cache_opts.disk_path = optarg;
+                }
+                else if (name == "cache-disk-size") {
+                    g_cache_opts.disk_bytes = std::strtoul(optarg, nullptr, 10);
+                }
+                else if (name == "compress-level") {
+                    g_compress_opts.level = std::atoi(optarg);
+                    if (g_compress_opts.level < 0 || g_compress_opts.level > 9) {
+                        std::cerr << "[ERROR] --compress-level must be between 0 and 9" << std::endl;
+                        std::exit(EXIT_FAILURE);
+                    }
+                }
+                else if (name == "compress-min-size") {
+                    g_compress_opts.min_bytes = std::strtoul(optarg, nullptr, 10);
+                }
+                else if (name == "compress-types") {
+                    g_compress_opts.types.clear();
+                    std::string types = optarg;
+                    size_t pos = 0;
+                    while (pos <= types.size()) {
+                        size_t comma = std::min(types.find(',', pos), types.size());
+                        g_compress_opts.types.push_back(types.substr(pos, comma - pos));
+                        pos = comma + 1;
+                    }
+                }
+                else if (name == "tls-cert") {
+                    g_tls_opts.cert_file = optarg;
+                }
+                else if (name == "tls-key") {
+                    g_tls_opts.key_file = optarg;
+                }
+                else if (name == "tls-session-cache") {
+                    g_tls_opts.session_cache = std::strtoul(optarg, nullptr, 10);
+                }
+                else if (name == "tls-session-timeout") {
+                    g_tls_opts.session_timeout = std::atoi(optarg);
+                }
+                else if (name == "tls-ticket-key") {
+                    g_tls_opts.ticket_key_file = optarg;
+                }
+                else if (name == "ktls") {
+                    std::string value = optarg;
+                    if (value != "on" && value != "off") {
+                        std::cerr << "[ERROR] --ktls must be on or off" << std::endl;
+                        std::exit(EXIT_FAILURE);
+                    }
+                    g_tls_opts.ktls = value == "on";
+                }
                 break;
+            }
             default:
-                std::cerr << "[ERROR] Usage: " << argv[0] << " --ip <IP> --port <PORT> --threads <N> [--proxy <URL>]" << std::endl;
+                std::cerr << "[ERROR] Usage: " << argv[0] << " --ip <IP> --port <PORT> --threads <N>|--reactors <N> [--io-engine epoll|uring] [--proxy <URL|unix:PATH[;weight=N],...>]"
+                          << " [--pool <NAME>=<URL[;weight=N],...>] [--route <[HOST]/PREFIX>=<POOL>[;timeout=MS][;mirror=POOL][;mirror-percent=P]] [--upstream-timeout <MS>]"
+                          << " [--mirror-queue <N>] [--mirror-threads <N>] [--mirror-timeout <MS>]"
+                          << " [--pipeline-depth <N>] [--splice-threshold <BYTES>] [--zerocopy-threshold <BYTES>]"
+                          << " [--buffer-high-watermark <BYTES>] [--buffer-low-watermark <BYTES>] [--connect-ports <P1,P2,...|*>] [--lb rr|least|p2c|hash] [--hash-key path|header:<NAME>]"
+                          << " [--pool-max-idle <N>] [--pool-lifetime <MS>] [--pool-prewarm <N>]"
+                          << " [--connect-timeout <MS>] [--connect-attempt-delay <MS>] [--dns-ttl <MS>]"
+                          << " [--health-path <PATH>] [--health-interval <MS>] [--health-timeout <MS>]"
+                          << " [--health-rise <N>] [--health-fall <N>]"
+                          << " [--eject-failures <N>] [--eject-time <MS>] [--slow-start <MS>]"
+                          << " [--hedge-delay <MS>] [--hedge-percentile <P>] [--hedge-budget <PERCENT>]"
+                          << " [--source-ips <IP,...>] [--source-ports <LO-HI>]"
+                          << " [--cache-size <BYTES>] [--cache-shards <N>] [--cache-max-object <BYTES>] [--cache-default-ttl <MS>]"
+                          << " [--cache-disk <PATH>] [--cache-disk-size <BYTES>]"
+                          << " [--compress-level <0-9>] [--compress-min-size <BYTES>] [--compress-types <TYPE,...>]"
+                          << " [--tls-cert <PEM>] [--tls-key <PEM>] [--tls-session-cache <N>] [--tls-session-timeout <SEC>]"
+                          << " [--tls-ticket-key <FILE>] [--ktls on|off]" << std::endl;
                 std::exit(EXIT_FAILURE);
         }
     }
 
-    if (g_ip.empty() || g_port <= 0 || g_thread_count <= 0) {
+    if (g_ip.empty() || g_port <= 0 || g_reactors < 0 || (g_thread_count <= 0 && g_reactors == 0)) {
         std::cerr << "[ERROR] Missing required parameters" << std::endl;
         std::exit(EXIT_FAILURE);
     }
+    // 环只由创建它的线程提交，线程池模式下各工作线程都要修改关注的事件，只能用 epoll
+    if (g_io_engine == "uring" && g_reactors == 0) {
+        std::cerr << "[ERROR] --io-engine uring requires --reactors" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    if (g_high_watermark == 0 || g_low_watermark > g_high_watermark) {
+        std::cerr << "[ERROR] --buffer-low-watermark must not exceed a non-zero --buffer-high-watermark" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
 }
 
 int main(int argc, char* argv[]) {
     // 1.解析参数
     parse_args(argc, argv);
 
-    // 2.创建监听socket
-    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_fd < 0) {
-        perror("socket");
-        return EXIT_FAILURE;
+    // 2.创建监听socket：反应堆模式下每个事件循环线程各一个，由内核按连接分给它们
+    std::vector<int> listen_fds;
+    for (int i = 0; i < std::max(1, g_reactors); ++i) {
+        int listen_fd = create_listener(g_reactors > 0);
+        if (listen_fd < 0) return EXIT_FAILURE;
+        listen_fds.push_back(listen_fd);
     }
 
-    int reuse = 1;
-    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)); // 设置复用socket
+    // 3.懒汉模式初始化
+    std::shared_ptr<ConnectionManager> ConnMgr = ConnectionManager::getInstance();
+    if (!ConnMgr){
+        std::cerr << "[ERROR] Failed to create ConnectionManager" << std::endl;
+        return EXIT_FAILURE;
+    }
+    ConnMgr->set_pipeline_depth(g_pipeline_depth);
+    ConnMgr->set_splice_threshold(g_splice_threshold);
+    ConnMgr->set_zerocopy_threshold(g_zerocopy_threshold);
+    ConnMgr->set_watermarks(g_high_watermark, g_low_watermark);
+    if (!ConnMgr->set_connect_ports(g_connect_ports)) {
+        return EXIT_FAILURE;
+    }
 
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(g_port);
-    inet_pton(AF_INET, g_ip.c_str(), &addr.sin_addr);
+    std::shared_ptr<UpstreamManager> UpMgr = UpstreamManager::getInstance();
+    if (!UpMgr){
+        std::cerr << "[ERROR] Failed to create UpstreamManager" << std::endl;
+        return EXIT_FAILURE;
+    }
+    LbPolicy policy;
+    if (!LoadBalancer::parse_policy(g_lb_policy, policy)) {
+        std::cerr << "[ERROR] Unknown load balancing policy: " << g_lb_policy << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!UpMgr->set_backends(g_proxy_url)) {
+        return EXIT_FAILURE;
+    }
+    for (auto& spec : g_pools) {
+        if (!UpMgr->add_pool(spec)) return EXIT_FAILURE;
+    }
+    for (LoadBalancer* balancer : UpMgr->pools()) {
+        balancer->set_policy(policy);
+        balancer->set_hash_key(g_hash_key);
+        balancer->set_outlier_options(g_outlier_opts);
+    }
 
-    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
-        perror("bind/listen");
-        close(listen_fd);
+    std::shared_ptr<Router> router = Router::getInstance();
+    router->set_default_timeout(g_upstream_timeout_ms);
+    for (auto& spec : g_routes) {
+        if (!router->add_route(spec)) return EXIT_FAILURE;
+    }
+    if (!router->start()) {
         return EXIT_FAILURE;
     }
-    set_nonblocking(listen_fd); //非阻塞
+    if (router->mirroring()) Mirror::getInstance()->start(g_mirror_opts);
+    UpMgr->set_pool_options(g_pool_opts);
+    if (!UpMgr->set_source_addresses(g_source_ips)) {
+        return EXIT_FAILURE;
+    }
+    UpMgr->hedging().set_options(g_hedge_opts);
 
-    // 3.初始化epoll
-    int epfd = epoll_create1(0);
-    if (epfd < 0) {
-        perror("epoll_create1");
+    // 启动时同步解析所有后端，之后由后台线程按 TTL 刷新
+    std::shared_ptr<Resolver> resolver = Resolver::getInstance();
+    resolver->start(g_resolver_opts);
+    for (LoadBalancer* balancer : UpMgr->pools()) {
+        for (auto& backend : balancer->backends()) {
+            if (!resolver->prefetch(backend->host, backend->port)) {
+                std::cerr << "[ERROR] Failed to resolve upstream " << backend->key() << std::endl;
+            }
+            UpMgr->prewarm(backend->host, backend->port);
+        }
+    }
+    HealthChecker::getInstance()->start(g_health_opts);
+    ResponseCache::getInstance()->start(g_cache_opts);
+    g_compress_opts.pool_backlog = g_reactors == 0;
+    Compressor::getInstance()->start(g_compress_opts);
+    g_tls_opts.session_id_context = "proxy-server";
+    if (!g_tls_opts.cert_file.empty() && !TlsContext::getInstance()->start(g_tls_opts)) {
         return EXIT_FAILURE;
     }
 
-    epoll_event ev{};
-    ev.events = EPOLLIN | EPOLLET;
-    ev.data.fd = listen_fd;
-    epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev);
+    std::cout << "[INIT] ProxyServer has started, ip: " << g_ip << ", port: " << g_port << ", "
+              << (g_reactors > 0 ? "reactors: " : "thread nums: ") << (g_reactors > 0 ? g_reactors : g_thread_count)
+              << ", io engine: " << (g_reactors > 0 ? g_io_engine : "epoll")
+              << ", upstream servers: " << g_proxy_url << ", lb: " << g_lb_policy << std::endl;
 
-    // 4.懒汉模式初始化
-    std::shared_ptr<ThreadPool> pool = ThreadPool::getInstance();
-    if (!pool) {
-        std::cerr << "[ERROR] Failed to create thread pool" << std::endl;
-        return EXIT_FAILURE;
+    // 4.转起来了
+    if (g_reactors > 0) {
+        std::vector<std::thread> reactors;
+        for (int listen_fd : listen_fds) reactors.emplace_back(run_reactor, listen_fd);
+        for (auto& reactor : reactors) reactor.join();
+        for (int listen_fd : listen_fds) close(listen_fd);
+        return 0;
     }
 
-    std::shared_ptr<ConnectionManager> ConnMgr = ConnectionManager::getInstance();
-    if (!ConnMgr){
-        std::cerr << "[ERROR] Failed to create ConnectionManager" << std::endl;
+    int listen_fd = listen_fds.front();
+    std::unique_ptr<Poller> poller = Poller::create("epoll", MAX_EVENTS);
+    if (!poller || !poller->add_listener(listen_fd)) {
         return EXIT_FAILURE;
     }
 
-    std::shared_ptr<UpstreamManager> UpMgr = UpstreamManager::getInstance();
-    if (!UpMgr){
-        std::cerr << "[ERROR] Failed to create UpstreamManager" << std::endl;
+    std::shared_ptr<ThreadPool> pool = ThreadPool::getInstance();
+    if (!pool) {
+        std::cerr << "[ERROR] Failed to create thread pool" << std::endl;
+        return EXIT_FAILURE;
     }
 
-    std::cout << "[INIT] ProxyServer has started, ip: " << g_ip << ", port: " << g_port << ", thread nums: " << g_thread_count << ", upstream server: " << g_proxy_url << std::endl;
-
-    // 5.转起来了
-    std::vector<epoll_event> events(MAX_EVENTS);
+    // 任务只能捕获裸指针和整数，才放得进线程池的定长槽位；
+    // ConnectionManager 单例一直存活到进程退出，经静态指针引用，不占捕获
+    static ConnectionManager* mgr = ConnMgr.get();
+    Poller* p = poller.get();
+    std::vector<PollEvent> events;
     while (true) {
-        int n = epoll_wait(epfd, events.data(), MAX_EVENTS, -1);
+        int n = poller->wait(events);
         if (n < 0) {
             if (errno == EINTR) continue;
             perror("epoll_wait");
@@ -133,25 +545,24 @@ int main(int argc, char* argv[]) {
         
         std::cout << "[STATE] epoll wait: got " << n << " events" << std::endl;
 
-        for (int i = 0; i < n; ++i) {
-            int fd = events[i].data.fd;
-            uint32_t evs = events[i].events;
+        for (const PollEvent& ev : events) {
+            uint64_t handle = ev.handle;
+            uint32_t evs = ev.events;
 
-            if (fd == listen_fd) { //新连接
-                pool->commit([ConnMgr, listen_fd, epfd]() {
-                    ConnMgr->accept_new_conn(listen_fd, epfd);
+            if (handle == static_cast<uint64_t>(listen_fd)) { //新连接
+                pool->post([p, listen_fd]() {
+                    mgr->accept_new_conn(listen_fd, p);
                 });
             }
             else { //已有连接
-                pool->commit([ConnMgr, fd, evs, epfd]() {
-                    ConnMgr->handle_io_event(fd, evs, epfd);
+                pool->post([p, handle, evs]() {
+                    mgr->handle_io_event(handle, evs, p);
                 });
             }
         }
     }
 
-    // 6.清理
+    // 5.清理
     close(listen_fd);
-    close(epfd);
     return 0;
 }
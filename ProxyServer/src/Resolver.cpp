@@ -0,0 +1,261 @@
+#include "Resolver.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <netdb.h>
+#include <sys/un.h>
+#include <resolv.h>
+#include <arpa/nameser.h>
+
+// 后台线程巡检缓存的间隔
+constexpr int RESOLVER_TICK_MS = 1000;
+// 缓存条目上限，超过后淘汰已过期的条目
+constexpr size_t RESOLVER_MAX_ENTRIES = 4096;
+
+// 按 RFC 8305 交替排列两个地址族，保留 getaddrinfo 给出的首选顺序
+static void interleave_families(std::vector<ResolvedAddr>& addrs) {
+    if (addrs.empty()) return;
+    int family = addrs.front().addr.ss_family;
+    std::vector<ResolvedAddr> first, second;
+    for (auto& a : addrs) (a.addr.ss_family == family ? first : second).push_back(a);
+
+    addrs.clear();
+    for (size_t i = 0; i < std::max(first.size(), second.size()); ++i) {
+        if (i < first.size()) addrs.push_back(first[i]);
+        if (i < second.size()) addrs.push_back(second[i]);
+    }
+}
+
+static bool getaddrinfo_into(const std::string& host, int port, int flags, std::vector<ResolvedAddr>& out) {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = flags;
+
+    int status = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res);
+    if (status != 0) {
+        if (!(flags & AI_NUMERICHOST)) std::cerr << "getaddrinfo error: " << gai_strerror(status) << std::endl;
+        return false;
+    }
+
+    out.clear();
+    for (struct addrinfo* p = res; p != nullptr; p = p->ai_next) {
+        ResolvedAddr a{};
+        memcpy(&a.addr, p->ai_addr, p->ai_addrlen);
+        a.len = p->ai_addrlen;
+        out.push_back(a);
+    }
+    freeaddrinfo(res);
+    interleave_families(out);
+    return !out.empty();
+}
+
+static bool unix_addr_into(const std::string& host, std::vector<ResolvedAddr>& out) {
+    std::string path = host.substr(5);
+    ResolvedAddr a{};
+    sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&a.addr);
+    if (path.empty() || path.size() >= sizeof(un->sun_path)) return false;
+
+    un->sun_family = AF_UNIX;
+    memcpy(un->sun_path, path.data(), path.size());
+    a.len = offsetof(sockaddr_un, sun_path) + path.size() + 1;
+    out.assign(1, a);
+    return true;
+}
+
+Resolver::~Resolver() {
+    stop();
+}
+
+void Resolver::start(const ResolverOptions& opts) {
+    if (_thread.joinable()) return;
+    _opts = opts;
+    _stop.store(false);
+    _thread = std::thread([this]() { run(); });
+}
+
+void Resolver::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        _stop.store(true);
+    }
+    _cv.notify_all();
+    if (_thread.joinable()) _thread.join();
+}
+
+bool Resolver::lookup(const std::string& host, int port, std::vector<ResolvedAddr>& out) {
+    return lookup(host, port, out, nullptr);
+}
+
+bool Resolver::lookup(const std::string& host, int port, std::vector<ResolvedAddr>& out, std::function<void()> done) {
+    std::string key = host + ":" + std::to_string(port);
+    auto now = Clock::now();
+    {
+        std::shared_lock<std::shared_mutex> lock(_cache_mutex);
+        auto it = _cache.find(key);
+        if (it != _cache.end()) {
+            Entry& entry = *it->second;
+            entry.last_used_ms.store(std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count());
+            out = entry.addrs;
+            // 过期条目照常返回，由后台刷新，热路径不等待解析
+            if (now >= entry.expires) enqueue(key, host, port);
+            return true;
+        }
+    }
+
+    // 数字地址和 Unix 套接字路径无需 DNS，就地解析不会阻塞
+    bool local = is_unix_host(host) ? unix_addr_into(host, out)
+                                    : getaddrinfo_into(host, port, AI_NUMERICHOST | AI_NUMERICSERV, out);
+    if (local) {
+        auto entry = std::make_shared<Entry>();
+        entry->host = host;
+        entry->port = port;
+        entry->addrs = out;
+        entry->expires = Clock::time_point::max();
+        std::unique_lock<std::shared_mutex> lock(_cache_mutex);
+        _cache[key] = entry;
+        return true;
+    }
+    if (is_unix_host(host)) return false;
+
+    enqueue(key, host, port, std::move(done));
+    return false;
+}
+
+bool Resolver::prefetch(const std::string& host, int port) {
+    std::string key = host + ":" + std::to_string(port);
+    {
+        std::unique_lock<std::shared_mutex> lock(_cache_mutex);
+        _pinned.insert(key);
+    }
+    std::vector<ResolvedAddr> addrs;
+    if (lookup(host, port, addrs)) return true;
+
+    auto entry = std::make_shared<Entry>();
+    if (!resolve(host, port, *entry)) return false;
+    std::unique_lock<std::shared_mutex> lock(_cache_mutex);
+    _cache[key] = entry;
+    return true;
+}
+
+void Resolver::enqueue(const std::string& key, const std::string& host, int port, std::function<void()> done) {
+    {
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        // 与 run 取走回调在同一把锁下：已在队列中的解析结束时一定会调用它
+        if (done) _waiters[key].push_back(std::move(done));
+        if (!_queued.insert(key).second) return;
+        _queue.emplace_back(host, port);
+    }
+    _cv.notify_one();
+}
+
+bool Resolver::resolve(const std::string& host, int port, Entry& entry) {
+    entry.host = host;
+    entry.port = port;
+    if (is_unix_host(host)) return false;
+    if (!getaddrinfo_into(host, port, AI_NUMERICSERV, entry.addrs)) return false;
+
+    int ttl = query_ttl_ms(host);
+    if (ttl < 0) ttl = _opts.default_ttl_ms;
+    ttl = std::clamp(ttl, _opts.min_ttl_ms, _opts.max_ttl_ms);
+    entry.expires = Clock::now() + std::chrono::milliseconds(ttl);
+    entry.last_used_ms.store(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count());
+    return true;
+}
+
+// getaddrinfo 不暴露 TTL，另发 A/AAAA 查询取应答中最小的 TTL；查不到返回 -1
+int Resolver::query_ttl_ms(const std::string& host) {
+    struct __res_state state;
+    memset(&state, 0, sizeof(state));
+    if (res_ninit(&state) != 0) return -1;
+
+    long min_ttl = -1;
+    unsigned char answer[4096];
+    for (int type : {ns_t_a, ns_t_aaaa}) {
+        int len = res_nsearch(&state, host.c_str(), ns_c_in, type, answer, sizeof(answer));
+        ns_msg msg;
+        if (len <= 0 || ns_initparse(answer, len, &msg) != 0) continue;
+
+        for (int i = 0; i < ns_msg_count(msg, ns_s_an); ++i) {
+            ns_rr rr;
+            if (ns_parserr(&msg, ns_s_an, i, &rr) != 0) continue;
+            long ttl = ns_rr_ttl(rr);
+            if (min_ttl < 0 || ttl < min_ttl) min_ttl = ttl;
+        }
+    }
+    res_nclose(&state);
+    return min_ttl < 0 ? -1 : static_cast<int>(std::min(min_ttl * 1000, 86400000L));
+}
+
+void Resolver::run() {
+    while (true) {
+        std::pair<std::string, int> job;
+        {
+            std::unique_lock<std::mutex> lock(_queue_mutex);
+            bool woke = _cv.wait_for(lock, std::chrono::milliseconds(RESOLVER_TICK_MS),
+                                     [this]() { return _stop.load() || !_queue.empty(); });
+            if (_stop.load()) return;
+            if (woke) {
+                job = std::move(_queue.front());
+                _queue.pop_front();
+            }
+        }
+
+        if (!job.first.empty()) {
+            std::string key = job.first + ":" + std::to_string(job.second);
+            auto entry = std::make_shared<Entry>();
+            bool ok = resolve(job.first, job.second, *entry);
+            {
+                std::unique_lock<std::shared_mutex> lock(_cache_mutex);
+                // 解析失败时保留旧结果继续服务，稍后再试
+                auto it = _cache.find(key);
+                if (ok && it != _cache.end()) {
+                    // 刷新不算使用，否则条目永远不会因闲置被淘汰
+                    entry->last_used_ms.store(it->second->last_used_ms.load());
+                    it->second = entry;
+                }
+                else if (ok) {
+                    _cache[key] = entry;
+                }
+            }
+            std::vector<std::function<void()>> waiters;
+            {
+                std::lock_guard<std::mutex> lock(_queue_mutex);
+                _queued.erase(key);
+                auto it = _waiters.find(key);
+                if (it != _waiters.end()) {
+                    waiters = std::move(it->second);
+                    _waiters.erase(it);
+                }
+            }
+            for (auto& done : waiters) done();
+            continue;
+        }
+
+        // 空闲时巡检：即将过期且近期被用过的条目提前刷新，长期未用的条目淘汰；
+        // 配置的后端可能长时间没有请求（如关闭了健康检查），淘汰后下一个请求会因未命中而失败，始终保留并刷新
+        auto now = Clock::now();
+        int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+        std::vector<std::pair<std::string, int>> refresh;
+        {
+            std::unique_lock<std::shared_mutex> lock(_cache_mutex);
+            for (auto it = _cache.begin(); it != _cache.end();) {
+                Entry& entry = *it->second;
+                bool pinned = _pinned.count(it->first) != 0;
+                bool idle = !pinned && now_ms - entry.last_used_ms.load() > _opts.max_ttl_ms;
+                if (!pinned && now >= entry.expires && (idle || _cache.size() > RESOLVER_MAX_ENTRIES)) {
+                    it = _cache.erase(it);
+                    continue;
+                }
+                if (!idle && entry.expires != Clock::time_point::max() &&
+                    entry.expires - now < std::chrono::milliseconds(RESOLVER_TICK_MS * 2)) {
+                    refresh.emplace_back(entry.host, entry.port);
+                }
+                ++it;
+            }
+        }
+        for (auto& [host, port] : refresh) enqueue(host + ":" + std::to_string(port), host, port);
+    }
+}
@@ -0,0 +1,606 @@
+#include "ResponseCache.h"
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <cerrno>
+#include <ctime>
+#include <string.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include "UpstreamManager.h"
+#include "Router.h"
+#include "BodyFramer.h"
+#include "Util.h"
+
+// 没有显式有效期时，按 Last-Modified 推算的启发式有效期上限
+constexpr auto CACHE_HEURISTIC_MAX = std::chrono::hours(24);
+// 后台刷新请求的超时
+constexpr int CACHE_REFRESH_TIMEOUT_MS = 10000;
+// 频率草图的计数累计到宽度的这么多倍后整体减半
+constexpr size_t SKETCH_SAMPLE_FACTOR = 10;
+
+static int64_t wall_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// 磁盘层跨重启保存时间，与 steady_clock 之间按当前时刻换算
+static int64_t to_wall_ms(std::chrono::steady_clock::time_point t) {
+    auto now = std::chrono::steady_clock::now();
+    if (t == std::chrono::steady_clock::time_point::max()) return INT64_MAX;
+    return wall_ms() + std::chrono::duration_cast<std::chrono::milliseconds>(t - now).count();
+}
+
+static std::chrono::steady_clock::time_point from_wall_ms(int64_t ms) {
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(ms - wall_ms());
+}
+
+static std::string header(const std::unordered_map<std::string, std::string>& headers, const std::string& name) {
+    auto it = headers.find(name);
+    return it == headers.end() ? std::string() : it->second;
+}
+
+// 逗号分隔的列表，如 Vary
+static std::vector<std::string> split_list(const std::string& value) {
+    std::vector<std::string> out;
+    size_t pos = 0;
+    while (pos <= value.size()) {
+        size_t comma = value.find(',', pos);
+        if (comma == std::string::npos) comma = value.size();
+        std::string item = lower(trim(value.substr(pos, comma - pos)));
+        if (!item.empty()) out.push_back(item);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+// Cache-Control 指令 -> 参数（去掉引号），无参数的指令值为空串
+static std::unordered_map<std::string, std::string> cache_control(const std::string& value) {
+    std::unordered_map<std::string, std::string> out;
+    for (const auto& item : split_list(value)) {
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            out[item] = "";
+            continue;
+        }
+        std::string arg = trim(item.substr(eq + 1));
+        if (arg.size() >= 2 && arg.front() == '"' && arg.back() == '"') arg = arg.substr(1, arg.size() - 2);
+        out[trim(item.substr(0, eq))] = arg;
+    }
+    return out;
+}
+
+static bool parse_seconds(const std::string& value, long& out) {
+    if (value.empty()) return false;
+    char* end = nullptr;
+    errno = 0;
+    long n = strtol(value.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0' || n < 0) return false;
+    out = n;
+    return true;
+}
+
+// 解析 IMF-fixdate，如 "Sun, 06 Nov 1994 08:49:37 GMT"
+static bool parse_http_date(const std::string& value, std::time_t& out) {
+    if (value.empty()) return false;
+    struct tm tm{};
+    const char* end = strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end) return false;
+    out = timegm(&tm);
+    return true;
+}
+
+ResponseCache::FrequencySketch::FrequencySketch(size_t width) {
+    size_t size = 1;
+    while (size < width) size <<= 1;
+    _counters.assign(size * 4, 0);
+    _mask = size - 1;
+}
+
+size_t ResponseCache::FrequencySketch::index(uint64_t hash, int row) const {
+    // 每行用不同的种子重新混合，得到相互独立的位置
+    uint64_t h = (hash + row * 0x9e3779b97f4a7c15ULL) * 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 31;
+    return row * (_mask + 1) + (h & _mask);
+}
+
+void ResponseCache::FrequencySketch::increment(uint64_t hash) {
+    for (int row = 0; row < 4; ++row) {
+        uint8_t& c = _counters[index(hash, row)];
+        if (c < 15) ++c;
+    }
+    if (++_additions >= (_mask + 1) * SKETCH_SAMPLE_FACTOR) {
+        for (auto& c : _counters) c >>= 1;
+        _additions /= 2;
+    }
+}
+
+int ResponseCache::FrequencySketch::estimate(uint64_t hash) const {
+    int min = 15;
+    for (int row = 0; row < 4; ++row) min = std::min<int>(min, _counters[index(hash, row)]);
+    return min;
+}
+
+ResponseCache::~ResponseCache() {
+    stop();
+}
+
+void ResponseCache::start(const CacheOptions& opts) {
+    if (opts.max_bytes == 0 || _thread.joinable()) return;
+    _opts = opts;
+    _opts.shards = std::max<size_t>(1, _opts.shards);
+    _shards.clear();
+    for (size_t i = 0; i < _opts.shards; ++i) _shards.push_back(std::make_unique<Shard>());
+    if (!_opts.disk_path.empty() && !_disk.open(_opts.disk_path, _opts.disk_bytes)) {
+        std::cerr << "[ERROR] Disk cache disabled: " << _opts.disk_path << std::endl;
+    }
+    _stop.store(false);
+    _thread = std::thread([this]() { run(); });
+    std::cout << "[INIT] Response cache " << _opts.max_bytes << " bytes in " << _opts.shards
+              << " shards, objects up to " << _opts.max_object_bytes << " bytes" << std::endl;
+}
+
+void ResponseCache::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        _stop.store(true);
+    }
+    _cv.notify_all();
+    if (_thread.joinable()) _thread.join();
+}
+
+std::string ResponseCache::base_key(const HTTPRequest& req) {
+    // HEAD 与 GET 共用条目
+    return header(req.headers(), "host") + " " + req.path();
+}
+
+std::string ResponseCache::full_key(const std::string& base, const std::vector<std::string>& vary, const HTTPRequest& req) {
+    std::string key = base;
+    for (const auto& name : vary) {
+        key += '\n';
+        key += name;
+        key += ':';
+        key += header(req.headers(), name);
+    }
+    return key;
+}
+
+ResponseCache::Shard& ResponseCache::shard_for(const std::string& base) {
+    return *_shards[std::hash<std::string>{}(base) % _shards.size()];
+}
+
+ResponseCache::Freshness ResponseCache::freshness(const std::unordered_map<std::string, std::string>& headers, int status) const {
+    Freshness f;
+    switch (status) {
+        case 200: case 203: case 204: case 300: case 301: case 308: case 404: case 410: break;
+        default: return f;
+    }
+    auto cc = cache_control(header(headers, "cache-control"));
+    if (cc.count("no-store") || cc.count("private") || headers.count("set-cookie")) return f;
+    if (header(headers, "vary").find('*') != std::string::npos) return f;
+
+    using std::chrono::seconds;
+    long n = 0;
+    std::time_t date = 0, expires = 0, modified = 0;
+    bool has_date = parse_http_date(header(headers, "date"), date);
+    if (!has_date) date = std::time(nullptr);
+
+    if (cc.count("no-cache")) {
+        f.lifetime = Clock::duration::zero();
+    }
+    else if (cc.count("s-maxage") && parse_seconds(cc["s-maxage"], n)) {
+        f.lifetime = seconds(n);
+    }
+    else if (cc.count("max-age") && parse_seconds(cc["max-age"], n)) {
+        f.lifetime = seconds(n);
+    }
+    else if (headers.count("expires")) {
+        // 无法解析的 Expires 视为已过期
+        if (parse_http_date(header(headers, "expires"), expires) && expires > date) f.lifetime = seconds(expires - date);
+    }
+    else if (parse_http_date(header(headers, "last-modified"), modified) && modified < date) {
+        auto heuristic = seconds((date - modified) / 10);
+        f.lifetime = std::min<Clock::duration>(heuristic, CACHE_HEURISTIC_MAX);
+    }
+    else {
+        f.lifetime = std::chrono::milliseconds(_opts.default_ttl_ms);
+    }
+
+    if (!cc.count("must-revalidate") && !cc.count("proxy-revalidate") && !cc.count("no-cache") &&
+        cc.count("stale-while-revalidate") && parse_seconds(cc["stale-while-revalidate"], n)) {
+        f.stale_while_revalidate = seconds(n);
+    }
+
+    bool validators = headers.count("etag") || headers.count("last-modified");
+    f.storable = f.lifetime > Clock::duration::zero() || validators;
+    return f;
+}
+
+bool ResponseCache::storable(const HTTPRequest& req, const HTTPResponse& resp) const {
+    if (!enabled() || req.method() != "GET") return false;
+    const auto& headers = req.headers();
+    if (headers.count("authorization") || headers.count("range")) return false;
+    if (cache_control(header(headers, "cache-control")).count("no-store")) return false;
+    if (!resp.is_chunked() && resp.headers().count("content-length") && resp.content_length() > _opts.max_object_bytes) return false;
+    return freshness(resp.headers(), resp.status_code()).storable;
+}
+
+void ResponseCache::store(const HTTPRequest& req, const HTTPResponse& resp, const char* raw, size_t len) {
+    if (len > _opts.max_object_bytes || !storable(req, resp)) return;
+    size_t head_size = resp.header_size();
+    if (head_size < 2 || head_size > len) return;
+
+    auto entry = std::make_shared<CacheEntry>();
+    entry->base = base_key(req);
+    entry->vary = vary_names(resp);
+    entry->key = full_key(entry->base, entry->vary, req);
+    entry->status = resp.status_code();
+    entry->headers = resp.headers();
+    entry->etag = header(resp.headers(), "etag");
+    entry->last_modified = header(resp.headers(), "last-modified");
+    entry->body = std::make_shared<const std::string>(raw + head_size, len - head_size);
+
+    // 保留原样的头部行，去掉逐跳头部和 Age（命中时重新生成）
+    std::string_view head(raw, head_size - 2);
+    size_t pos = 0;
+    while (pos < head.size()) {
+        size_t eol = head.find("\r\n", pos);
+        if (eol == std::string_view::npos) eol = head.size();
+        std::string_view line = head.substr(pos, eol - pos);
+        std::string name = lower(std::string(line.substr(0, line.find(':'))));
+        if (pos == 0 || (name != "connection" && name != "keep-alive" && name != "age")) {
+            entry->head.append(line.data(), line.size());
+            entry->head += "\r\n";
+        }
+        pos = eol + 2;
+    }
+
+    Freshness f = freshness(entry->headers, entry->status);
+    long age = 0;
+    parse_seconds(header(resp.headers(), "age"), age);
+    entry->stored = Clock::now() - std::chrono::seconds(age);
+    entry->fresh_until = entry->stored + f.lifetime;
+    entry->stale_until = entry->fresh_until + f.stale_while_revalidate;
+
+    Shard& shard = shard_for(entry->base);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        insert(shard, entry);
+    }
+    // 磁盘层直写，重启后不丢；按 Vary 区分的变体只留在内存
+    if (entry->vary.empty()) {
+        _disk.store(entry->key, entry->status, entry->head, *entry->body,
+                    DiskFreshness{to_wall_ms(entry->stored), to_wall_ms(entry->fresh_until), to_wall_ms(entry->stale_until)});
+    }
+}
+
+CacheEntryPtr ResponseCache::promote(const std::string& key, const DiskHit& hit) {
+    std::string raw(hit.head);
+    raw += "\r\n";
+    HTTPResponse resp;
+    resp.set_no_body(true);
+    size_t consumed = 0;
+    if (!resp.parse(raw.data(), raw.size(), consumed)) return nullptr;
+
+    auto entry = std::make_shared<CacheEntry>();
+    entry->key = key;
+    entry->base = key;
+    entry->status = hit.status;
+    entry->head = std::string(hit.head);
+    entry->body = std::make_shared<const std::string>(hit.body);
+    entry->headers = resp.headers();
+    entry->etag = header(entry->headers, "etag");
+    entry->last_modified = header(entry->headers, "last-modified");
+    entry->stored = from_wall_ms(hit.freshness.stored_ms);
+    entry->fresh_until = from_wall_ms(hit.freshness.fresh_until_ms);
+    entry->stale_until = from_wall_ms(hit.freshness.stale_until_ms);
+
+    Shard& shard = shard_for(entry->base);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    insert(shard, entry);
+    return entry;
+}
+
+void ResponseCache::insert(Shard& shard, CacheEntryPtr entry) {
+    size_t capacity = _opts.max_bytes / _opts.shards;
+    if (entry->size() > capacity) return;
+
+    auto it = shard.index.find(entry->key);
+    if (it != shard.index.end()) {
+        // 同一个键的新版本直接替换，不需要准入
+        remove(shard, it->second);
+    }
+    else if (shard.bytes + entry->size() > capacity && !shard.lru.empty()) {
+        // TinyLFU 准入：新对象的访问频率不高于待淘汰对象时不放入
+        std::hash<std::string> hasher;
+        const CacheEntryPtr& victim = shard.lru.back();
+        if (shard.sketch.estimate(hasher(entry->key)) <= shard.sketch.estimate(hasher(victim->key))) return;
+    }
+
+    while (shard.bytes + entry->size() > capacity && !shard.lru.empty()) {
+        remove(shard, std::prev(shard.lru.end()));
+    }
+
+    shard.lru.push_front(entry);
+    shard.index[entry->key] = shard.lru.begin();
+    shard.bytes += entry->size();
+    // 映射在淘汰之后再更新，替换或淘汰同一基础键的旧变体不会把它删掉
+    if (entry->vary.empty()) {
+        shard.vary.erase(entry->base);
+    }
+    else {
+        shard.vary[entry->base] = entry->vary;
+        ++shard.variants[entry->base];
+    }
+}
+
+void ResponseCache::remove(Shard& shard, std::list<std::shared_ptr<const CacheEntry>>::iterator it) {
+    const CacheEntryPtr& entry = *it;
+    if (!entry->vary.empty()) {
+        auto count = shard.variants.find(entry->base);
+        if (count != shard.variants.end() && --count->second == 0) {
+            shard.variants.erase(count);
+            shard.vary.erase(entry->base);
+        }
+    }
+    shard.bytes -= entry->size();
+    shard.index.erase(entry->key);
+    shard.lru.erase(it);
+}
+
+bool ResponseCache::bypass(const HTTPRequest& req) {
+    const auto& headers = req.headers();
+    // 带凭证、分段或客户端自己的条件请求直接交给上游
+    if (headers.count("authorization") || headers.count("range") ||
+        headers.count("if-none-match") || headers.count("if-modified-since")) return true;
+    auto cc = cache_control(header(headers, "cache-control"));
+    return cc.count("no-cache") || cc.count("no-store") || header(headers, "pragma") == "no-cache";
+}
+
+bool ResponseCache::collapse_key(const HTTPRequest& req, std::string& key) {
+    if (!enabled() || req.method() != "GET" || bypass(req) || req.headers().count("upgrade")) return false;
+    std::string base = base_key(req);
+    Shard& shard = shard_for(base);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto vary = shard.vary.find(base);
+    key = vary == shard.vary.end() ? base : full_key(base, vary->second, req);
+    return true;
+}
+
+std::vector<std::string> ResponseCache::vary_names(const HTTPResponse& resp) {
+    return split_list(header(resp.headers(), "vary"));
+}
+
+CacheResult ResponseCache::lookup(const HTTPRequest& req, CacheEntryPtr& out, DiskHitPtr& mapped) {
+    if (!enabled() || (req.method() != "GET" && req.method() != "HEAD") || bypass(req)) return CacheResult::MISS;
+
+    std::string base = base_key(req);
+    Shard& shard = shard_for(base);
+    auto now = Clock::now();
+    std::string key;
+    bool try_disk = false;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto vary = shard.vary.find(base);
+        key = vary == shard.vary.end() ? base : full_key(base, vary->second, req);
+        shard.sketch.increment(std::hash<std::string>{}(key));
+
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            out = *it->second;
+        }
+        else {
+            try_disk = vary == shard.vary.end();
+        }
+    }
+
+    if (try_disk) {
+        DiskHitPtr hit = _disk.lookup(key);
+        if (!hit) return CacheResult::MISS;
+        // 新鲜的磁盘记录直接从映射区发送；过期的复制进内存走刷新或校验
+        if (wall_ms() < hit->freshness.fresh_until_ms) {
+            mapped = hit;
+            return CacheResult::FRESH;
+        }
+        out = promote(key, *hit);
+    }
+    if (!out) return CacheResult::MISS;
+
+    if (now < out->fresh_until) return CacheResult::FRESH;
+    if (now < out->stale_until) {
+        enqueue_refresh(req, out);
+        return CacheResult::STALE;
+    }
+    if (!out->etag.empty() || !out->last_modified.empty()) return CacheResult::REVALIDATE;
+    out.reset();
+    return CacheResult::MISS;
+}
+
+CacheEntryPtr ResponseCache::freshen(const HTTPRequest& req, const CacheEntryPtr& entry, const HTTPResponse& resp) {
+    auto updated = std::make_shared<CacheEntry>(*entry);
+    for (const auto& [name, value] : resp.headers()) {
+        if (name == "content-length" || name == "transfer-encoding" || name == "connection" ||
+            name == "keep-alive" || name == "age") continue;
+        updated->headers[name] = value;
+    }
+    updated->etag = header(updated->headers, "etag");
+    updated->last_modified = header(updated->headers, "last-modified");
+
+    Freshness f = freshness(updated->headers, updated->status);
+    long age = 0;
+    parse_seconds(header(resp.headers(), "age"), age);
+    updated->stored = Clock::now() - std::chrono::seconds(age);
+    updated->fresh_until = updated->stored + f.lifetime;
+    updated->stale_until = updated->fresh_until + f.stale_while_revalidate;
+
+    bool keep = f.storable && !cache_control(header(req.headers(), "cache-control")).count("no-store");
+    Shard& shard = shard_for(updated->base);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (keep) {
+            insert(shard, updated);
+        }
+        else {
+            auto it = shard.index.find(updated->key);
+            if (it != shard.index.end()) remove(shard, it->second);
+        }
+    }
+    if (keep) {
+        _disk.set_freshness(updated->key, DiskFreshness{to_wall_ms(updated->stored), to_wall_ms(updated->fresh_until),
+                                                        to_wall_ms(updated->stale_until)});
+    }
+    else {
+        _disk.erase(updated->key);
+    }
+    return updated;
+}
+
+std::string ResponseCache::render(const CacheEntry& entry, bool head_only, const char* tag) {
+    auto age = std::chrono::duration_cast<std::chrono::seconds>(Clock::now() - entry.stored).count();
+    std::string out;
+    out.reserve(entry.head.size() + 64 + (head_only ? 0 : entry.body->size()));
+    out += entry.head;
+    out += "Age: " + std::to_string(std::max<long long>(0, age)) + "\r\n";
+    out += "X-Cache: ";
+    out += tag;
+    out += "\r\n\r\n";
+    if (!head_only) out += *entry.body;
+    return out;
+}
+
+std::string ResponseCache::render_head(const DiskHit& hit) {
+    int64_t age = (wall_ms() - hit.freshness.stored_ms) / 1000;
+    std::string out;
+    out.reserve(hit.head.size() + 64);
+    out.append(hit.head.data(), hit.head.size());
+    out += "Age: " + std::to_string(std::max<int64_t>(0, age)) + "\r\n";
+    out += "X-Cache: HIT-DISK\r\n\r\n";
+    return out;
+}
+
+void ResponseCache::add_validators(HTTPRequest& req, const CacheEntry& entry) {
+    if (!entry.etag.empty()) req.set_header("if-none-match", entry.etag);
+    if (!entry.last_modified.empty()) req.set_header("if-modified-since", entry.last_modified);
+}
+
+void ResponseCache::enqueue_refresh(const HTTPRequest& req, const CacheEntryPtr& entry) {
+    {
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        if (!_queued.insert(entry->key).second) return;
+        _queue.emplace_back(req, entry);
+    }
+    _cv.notify_one();
+}
+
+void ResponseCache::run() {
+    while (true) {
+        std::pair<HTTPRequest, CacheEntryPtr> job;
+        {
+            std::unique_lock<std::mutex> lock(_queue_mutex);
+            _cv.wait(lock, [this]() { return _stop.load() || !_queue.empty(); });
+            if (_stop.load()) return;
+            job = std::move(_queue.front());
+            _queue.pop_front();
+        }
+        std::string key = job.second->key;
+        refresh(std::move(job.first), std::move(job.second));
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        _queued.erase(key);
+    }
+}
+
+void ResponseCache::refresh(HTTPRequest req, CacheEntryPtr entry) {
+    auto upstreams = UpstreamManager::getInstance();
+    if (req.method() == "HEAD") return;
+    add_validators(req, *entry);
+
+    LoadBalancer& balancer = *Router::getInstance()->match(req).balancer;
+    Backend* backend = balancer.select(req);
+    if (!backend) return;
+    int fd = upstreams->acquire(backend->host, backend->port);
+    if (fd < 0) {
+        balancer.on_request_done(backend, std::chrono::microseconds(0), false);
+        return;
+    }
+
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::milliseconds(CACHE_REFRESH_TIMEOUT_MS);
+    std::string out = req.raw();
+    size_t sent = 0;
+    bool ok = true;
+    while (ok && sent < out.size()) {
+        ssize_t n = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) sent += n;
+        else if (n < 0 && errno == EAGAIN) ok = wait_fd(fd, POLLOUT, deadline);
+        else ok = false;
+    }
+
+    // 响应头只解析一次，之后交给 BodyFramer 增量分帧；超过单个对象上限就放弃，反正也不会缓存
+    std::string data;
+    HTTPResponse resp;
+    BodyFramer body;
+    bool framing = false;
+    bool complete = false;
+    bool oversized = false;
+    size_t leftover = 0;
+    char buf[4096];
+    while (ok && !complete) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EAGAIN) {
+            ok = wait_fd(fd, POLLIN, deadline);
+            continue;
+        }
+        if (n <= 0) {
+            ok = false;
+            continue;
+        }
+
+        size_t used = 0;
+        if (framing) {
+            ok = body.feed(buf, n, used);
+            data.append(buf, used);
+            leftover = n - used;
+        }
+        else {
+            data.append(buf, n);
+            resp = HTTPResponse();
+            size_t consumed = 0;
+            if (resp.parse(data.data(), data.size(), consumed)) {
+                complete = true;
+                leftover = data.size() - consumed;
+                data.resize(consumed);
+                continue;
+            }
+            if (resp.state() == ResponseParseState::ERROR) {
+                ok = false;
+                continue;
+            }
+            if (resp.state() == ResponseParseState::BODY) {
+                framing = true;
+                if (resp.is_chunked()) body.expect_chunked();
+                else body.expect_length(resp.content_length());
+                size_t head_size = resp.header_size();
+                ok = body.feed(data.data() + head_size, data.size() - head_size, used);
+                leftover = data.size() - head_size - used;
+                data.resize(head_size + used);
+            }
+        }
+        complete = ok && framing && body.done();
+        if (data.size() > _opts.max_object_bytes) {
+            oversized = true;
+            complete = false;
+            break;
+        }
+    }
+
+    bool reusable = complete && leftover == 0 && resp.version() == "HTTP/1.1" &&
+                    lower(header(resp.headers(), "connection")) != "close";
+    upstreams->release(fd, reusable);
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+    balancer.on_request_done(backend, latency, (complete || oversized) && resp.status_code() < 500);
+    if (!complete) return;
+
+    if (resp.status_code() == 304) freshen(req, entry, resp);
+    else store(req, resp, data.data(), data.size());
+}
@@ -0,0 +1,207 @@
+#include "Router.h"
+#include "UpstreamManager.h"
+#include <iostream>
+#include <cstdlib>
+#include <cctype>
+
+// 去掉 Host 中的端口与末尾的点；IPv6 字面量保留方括号
+static std::string_view host_name(std::string_view host) {
+    if (!host.empty() && host.front() == '[') {
+        size_t close = host.find(']');
+        return close == std::string_view::npos ? host : host.substr(0, close + 1);
+    }
+    size_t colon = host.find(':');
+    if (colon != std::string_view::npos) host = host.substr(0, colon);
+    if (!host.empty() && host.back() == '.') host.remove_suffix(1);
+    return host;
+}
+
+// absolute-form 的请求目标只取路径部分
+static std::string_view request_path(std::string_view target) {
+    if (target.empty() || target.front() == '/') return target;
+    size_t scheme = target.find("://");
+    if (scheme == std::string_view::npos) return target;
+    size_t slash = target.find('/', scheme + 3);
+    return slash == std::string_view::npos ? std::string_view("/") : target.substr(slash);
+}
+
+size_t Router::HostHash::operator()(std::string_view host) const {
+    // FNV-1a，按小写计算
+    size_t h = 1469598103934665603ULL;
+    for (char c : host) {
+        h ^= static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(c)));
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+bool Router::HostEqual::operator()(std::string_view a, std::string_view b) const {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) return false;
+    }
+    return true;
+}
+
+bool Router::add_route(const std::string& spec) {
+    // [HOST]/PREFIX=POOL[;OPTION...]：选项从第一个 ; 开始，池名在其前最后一个 = 之后
+    size_t semi = spec.find(';');
+    std::string target = spec.substr(0, semi);
+    size_t eq = target.rfind('=');
+    size_t slash = target.find('/');
+    if (eq == std::string::npos || slash == std::string::npos || slash > eq || eq + 1 == target.size()) {
+        std::cerr << "[ERROR] Invalid route: " << spec << std::endl;
+        return false;
+    }
+
+    Route route;
+    route.host = std::string(host_name(std::string_view(target).substr(0, slash)));
+    if (route.host == "*") route.host.clear();
+    for (auto& c : route.host) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    route.prefix = target.substr(slash, eq - slash);
+    route.pool = target.substr(eq + 1);
+    route.timeout_ms = -1;
+
+    while (semi != std::string::npos) {
+        size_t next = spec.find(';', semi + 1);
+        std::string opt = spec.substr(semi + 1, next == std::string::npos ? std::string::npos : next - semi - 1);
+        semi = next;
+        if (opt.compare(0, 8, "timeout=") == 0 && std::isdigit(static_cast<unsigned char>(opt[8]))) {
+            route.timeout_ms = std::atoi(opt.c_str() + 8);
+            continue;
+        }
+        if (opt.compare(0, 7, "mirror=") == 0 && opt.size() > 7) {
+            route.mirror_pool = opt.substr(7);
+            continue;
+        }
+        if (opt.compare(0, 15, "mirror-percent=") == 0) {
+            char* end = nullptr;
+            route.mirror_percent = std::strtod(opt.c_str() + 15, &end);
+            if (end != opt.c_str() + 15 && *end == '\0' && route.mirror_percent > 0 && route.mirror_percent <= 100) continue;
+        }
+        std::cerr << "[ERROR] Invalid route option: " << opt << std::endl;
+        return false;
+    }
+
+    Node& root = route.host.empty() ? _any : _hosts[route.host];
+    int index = static_cast<int>(_routes.size());
+    if (insert(root, route.prefix, index) >= 0) {
+        std::cerr << "[ERROR] Duplicate route: " << spec << std::endl;
+        return false;
+    }
+    _routes.push_back(std::move(route));
+    return true;
+}
+
+void Router::set_default_timeout(int ms) {
+    _default_timeout_ms = ms;
+}
+
+bool Router::start() {
+    auto upstreams = UpstreamManager::getInstance();
+    _default.prefix = "/";
+    _default.pool = "default";
+    _default.balancer = upstreams->pool(_default.pool);
+    _default.timeout_ms = _default_timeout_ms;
+    for (auto& route : _routes) {
+        route.balancer = upstreams->pool(route.pool);
+        if (!route.balancer) {
+            std::cerr << "[ERROR] Route " << (route.host.empty() ? "*" : route.host) << route.prefix
+                      << " refers to unknown pool " << route.pool << std::endl;
+            return false;
+        }
+        if (!route.mirror_pool.empty() && !(route.mirror = upstreams->pool(route.mirror_pool))) {
+            std::cerr << "[ERROR] Route " << (route.host.empty() ? "*" : route.host) << route.prefix
+                      << " mirrors to unknown pool " << route.mirror_pool << std::endl;
+            return false;
+        }
+        if (route.timeout_ms < 0) route.timeout_ms = _default_timeout_ms;
+        std::cout << "[INIT] Route " << (route.host.empty() ? "*" : route.host) << route.prefix << " -> " << route.pool;
+        if (route.timeout_ms > 0) std::cout << ", timeout " << route.timeout_ms << " ms";
+        if (route.mirror) std::cout << ", mirror " << route.mirror_percent << "% to " << route.mirror_pool;
+        std::cout << std::endl;
+    }
+    return true;
+}
+
+bool Router::mirroring() const {
+    for (const auto& route : _routes) {
+        if (route.mirror) return true;
+    }
+    return false;
+}
+
+const Route& Router::match(const HTTPRequest& req) const {
+    if (_routes.empty()) return _default;
+
+    std::string_view path = request_path(req.path());
+    int index = -1;
+    if (!_hosts.empty()) {
+        auto host = req.headers().find("host");
+        if (host != req.headers().end()) {
+            auto tree = _hosts.find(host_name(host->second));
+            if (tree != _hosts.end()) index = longest_prefix(tree->second, path);
+        }
+    }
+    if (index < 0) index = longest_prefix(_any, path);
+    return index < 0 ? _default : _routes[index];
+}
+
+int Router::insert(Node& root, std::string_view prefix, int route) {
+    Node* node = &root;
+    while (!prefix.empty()) {
+        std::unique_ptr<Node>* slot = nullptr;
+        for (auto& child : node->children) {
+            if (child->label.front() == prefix.front()) {
+                slot = &child;
+                break;
+            }
+        }
+        if (!slot) {
+            auto leaf = std::make_unique<Node>();
+            leaf->label = std::string(prefix);
+            leaf->route = route;
+            node->children.push_back(std::move(leaf));
+            return -1;
+        }
+
+        Node* child = slot->get();
+        size_t common = 0;
+        while (common < child->label.size() && common < prefix.size() && child->label[common] == prefix[common]) ++common;
+        if (common < child->label.size()) {
+            // 前缀在边的中间分叉：公共部分拆成新的中间节点
+            auto mid = std::make_unique<Node>();
+            mid->label = child->label.substr(0, common);
+            child->label.erase(0, common);
+            mid->children.push_back(std::move(*slot));
+            *slot = std::move(mid);
+            child = slot->get();
+        }
+        prefix.remove_prefix(common);
+        node = child;
+    }
+
+    int previous = node->route;
+    if (previous < 0) node->route = route;
+    return previous;
+}
+
+int Router::longest_prefix(const Node& root, std::string_view path) {
+    const Node* node = &root;
+    int best = root.route;
+    size_t pos = 0;
+    while (pos < path.size()) {
+        const Node* next = nullptr;
+        for (const auto& child : node->children) {
+            if (child->label.front() == path[pos]) {
+                next = child.get();
+                break;
+            }
+        }
+        if (!next || path.compare(pos, next->label.size(), next->label) != 0) break;
+        pos += next->label.size();
+        node = next;
+        if (node->route >= 0) best = node->route;
+    }
+    return best;
+}
@@ -1,14 +1,42 @@
 #include "UpstreamManager.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef IP_LOCAL_PORT_RANGE
+#define IP_LOCAL_PORT_RANGE 51
+#endif
 
 UpstreamManager::~UpstreamManager() {
     std::lock_guard<std::mutex> lock(_mutex);
     for (auto& [fd, _] : _active_connections) {
         close(fd); // 关闭所有活跃连接
     }
+    _active_connections.clear();
+    _idle.clear();
+}
+
+void UpstreamManager::set_pool_options(const PoolOptions& opts) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _opts = opts;
 }
 
 // 解析 URL 提取 host 和 port
 bool UpstreamManager::parse_url(const std::string& url, std::string& host, int& port) {
+    // unix:/path/to.sock 走 Unix 域套接字，整个 URL 作为 host
+    if (is_unix_host(url)) {
+        if (url.size() <= 5 || url.size() - 5 >= sizeof(sockaddr_un::sun_path)) {
+            std::cerr << "[ERROR] Invalid unix socket path: " << url << std::endl;
+            return false;
+        }
+        host = url;
+        port = 0;
+        return true;
+    }
+
     size_t protocol_pos = url.find("://");
     if (protocol_pos == std::string::npos) {
         std::cerr << "[ERROR] Invalid URL: missing protocol" << std::endl;
@@ -19,64 +47,412 @@ bool UpstreamManager::parse_url(const std::string& url, std::string& host, int&
     size_t host_end = url.find('/', host_start);
     std::string host_port = (host_end == std::string::npos) ? url.substr(host_start) : url.substr(host_start, host_end - host_start);
 
-    size_t colon_pos = host_port.find(':');
-    if (colon_pos != std::string::npos) {
-        host = host_port.substr(0, colon_pos);
-        port = std::stoi(host_port.substr(colon_pos + 1));
+    // IPv6 字面量写作 [addr]:port，地址本身带冒号
+    size_t colon_pos;
+    if (!host_port.empty() && host_port[0] == '[') {
+        size_t bracket = host_port.find(']');
+        if (bracket == std::string::npos || (bracket + 1 < host_port.size() && host_port[bracket + 1] != ':')) {
+            std::cerr << "[ERROR] Invalid URL: " << url << std::endl;
+            return false;
+        }
+        host = host_port.substr(1, bracket - 1);
+        colon_pos = bracket + 1 < host_port.size() ? bracket + 1 : std::string::npos;
     }
     else {
-        host = host_port;
+        colon_pos = host_port.find(':');
+        host = host_port.substr(0, colon_pos);
+    }
+    if (host.empty()) {
+        std::cerr << "[ERROR] Invalid URL: " << url << std::endl;
+        return false;
+    }
+
+    if (colon_pos == std::string::npos) {
         port = 80; // 默认 HTTP 端口
+        return true;
+    }
+    std::string port_str = host_port.substr(colon_pos + 1);
+    char* end = nullptr;
+    errno = 0;
+    long value = std::strtol(port_str.c_str(), &end, 10);
+    if (port_str.empty() || *end != '\0' || errno != 0 || value < 1 || value > 65535) {
+        std::cerr << "[ERROR] Invalid URL: " << url << std::endl;
+        return false;
+    }
+    port = static_cast<int>(value);
+    return true;
+}
+
+bool UpstreamManager::set_backends(const std::string& spec) {
+    std::vector<std::shared_ptr<Backend>> backends;
+    if (!parse_backends(spec, backends)) return false;
+    _balancer.set_backends(std::move(backends));
+    return true;
+}
+
+bool UpstreamManager::add_pool(const std::string& spec) {
+    size_t eq = spec.find('=');
+    std::string name = spec.substr(0, eq);
+    if (eq == std::string::npos || name.empty() || pool(name)) {
+        std::cerr << "[ERROR] Invalid or duplicate upstream pool: " << spec << std::endl;
+        return false;
+    }
+
+    std::vector<std::shared_ptr<Backend>> backends;
+    if (!parse_backends(spec.substr(eq + 1), backends)) return false;
+    auto balancer = std::make_unique<LoadBalancer>();
+    balancer->set_backends(std::move(backends));
+    _pools.emplace_back(name, std::move(balancer));
+    return true;
+}
+
+LoadBalancer* UpstreamManager::pool(const std::string& name) {
+    if (name == "default") return &_balancer;
+    for (auto& p : _pools) {
+        if (p.first == name) return p.second.get();
+    }
+    return nullptr;
+}
+
+std::vector<LoadBalancer*> UpstreamManager::pools() {
+    std::vector<LoadBalancer*> all{&_balancer};
+    for (auto& p : _pools) all.push_back(p.second.get());
+    return all;
+}
+
+bool UpstreamManager::parse_backends(const std::string& spec, std::vector<std::shared_ptr<Backend>>& backends) {
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) end = spec.size();
+        std::string item = spec.substr(start, end - start);
+        start = end + 1;
+        if (item.empty()) continue;
+
+        auto backend = std::make_shared<Backend>();
+        size_t semi = item.find(';');
+        if (semi != std::string::npos) {
+            std::string opt = item.substr(semi + 1);
+            item.resize(semi);
+            if (opt.compare(0, 7, "weight=") != 0 || (backend->weight = std::atoi(opt.c_str() + 7)) <= 0) {
+                std::cerr << "[ERROR] Invalid backend option: " << opt << std::endl;
+                return false;
+            }
+        }
+        if (!parse_url(item, backend->host, backend->port)) return false;
+        backends.push_back(std::move(backend));
+    }
+
+    if (backends.empty()) {
+        std::cerr << "[ERROR] No upstream backend configured" << std::endl;
+        return false;
     }
     return true;
 }
 
 // 创建并连接到上游服务器的非阻塞套接字
-int UpstreamManager::connect_to_upstream(const std::string& host, int port) {
-    struct addrinfo hints, *res;
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-
-    int status = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res);
-    if (status != 0) {
-        std::cerr << "getaddrinfo error: " << gai_strerror(status) << std::endl;
+int UpstreamManager::connect_to_upstream(const std::string& host, int port, ConnectRace* race) {
+    // 只读解析缓存，未命中时由后台线程解析，本次连接按失败处理
+    std::vector<ResolvedAddr> addrs;
+    if (!Resolver::getInstance()->lookup(host, port, addrs)) {
+        std::cerr << "[ERROR] " << host << " is not resolved yet" << std::endl;
         return -1;
     }
+    return start_race(host + ":" + std::to_string(port), addrs, race);
+}
+
+bool UpstreamManager::set_source_addresses(const std::string& spec) {
+    _sources.clear();
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) end = spec.size();
+        std::string ip = spec.substr(start, end - start);
+        start = end + 1;
+        if (ip.empty()) continue;
+
+        auto src = std::make_unique<SourceAddr>();
+        src->name = ip;
+        sockaddr_in* in4 = reinterpret_cast<sockaddr_in*>(&src->addr.addr);
+        sockaddr_in6* in6 = reinterpret_cast<sockaddr_in6*>(&src->addr.addr);
+        if (inet_pton(AF_INET, ip.c_str(), &in4->sin_addr) == 1) {
+            in4->sin_family = AF_INET;
+            src->addr.len = sizeof(sockaddr_in);
+        }
+        else if (inet_pton(AF_INET6, ip.c_str(), &in6->sin6_addr) == 1) {
+            in6->sin6_family = AF_INET6;
+            src->addr.len = sizeof(sockaddr_in6);
+        }
+        else {
+            std::cerr << "[ERROR] Invalid source address: " << ip << std::endl;
+            return false;
+        }
+        _sources.push_back(std::move(src));
+    }
+    if (!_sources.empty()) std::cout << "[INIT] Using " << _sources.size() << " upstream source addresses" << std::endl;
+    return true;
+}
 
-    int sockfd = -1;
-    for (struct addrinfo* p = res; p != nullptr; p = p->ai_next) {
-        sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-        if (sockfd == -1) continue;
+UpstreamManager::SourceAddr* UpstreamManager::bind_source(int fd, int family) {
+    // 只在同一地址族的源地址之间轮转，保证分布均匀
+    size_t matching = 0;
+    for (auto& src : _sources) matching += src->addr.addr.ss_family == family;
+    if (matching == 0) return nullptr;
 
-        // 设置为非阻塞模式
-        int flags = fcntl(sockfd, F_GETFL, 0);
-        if (fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) == -1) {
-            close(sockfd);
-            continue;
+    size_t k = _next_source.fetch_add(1, std::memory_order_relaxed) % matching;
+    for (auto& entry : _sources) {
+        SourceAddr* src = entry.get();
+        if (src->addr.addr.ss_family != family || k-- > 0) continue;
+
+        // 端口推迟到 connect 时按四元组分配，同一个本地端口可以复用到不同后端
+        int on = 1;
+        setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &on, sizeof(on));
+        if (bind(fd, reinterpret_cast<const sockaddr*>(&src->addr.addr), src->addr.len) < 0) {
+            perror("bind (source address)");
+            return nullptr;
         }
+        return src;
+    }
+    return nullptr;
+}
 
-        // 发起非阻塞连接
-        if (connect(sockfd, p->ai_addr, p->ai_addrlen) == -1) {
-            if (errno == EINPROGRESS) {
-                // 连接进行中，需后续通过 epoll 检查
-                break;
-            } else {
-                close(sockfd);
-                sockfd = -1;
+int UpstreamManager::open_connection(const ResolvedAddr& addr, int port_min, int port_max, bool& connected) {
+    int family = addr.addr.ss_family;
+    size_t tries = 1;
+    if (family != AF_UNIX) {
+        size_t matching = 0;
+        for (auto& src : _sources) matching += src->addr.addr.ss_family == family;
+        tries = std::max<size_t>(1, matching);
+    }
+
+    for (size_t i = 0; i < tries; ++i) {
+        int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd == -1) return -1;
+
+        SourceAddr* src = nullptr;
+        if (family != AF_UNIX) {
+            // 高 16 位为上限、低 16 位为下限；老内核不支持时沿用系统端口范围
+            if (port_min > 0 && port_max >= port_min) {
+                uint32_t range = (static_cast<uint32_t>(port_max) << 16) | static_cast<uint32_t>(port_min);
+                setsockopt(fd, IPPROTO_IP, IP_LOCAL_PORT_RANGE, &range, sizeof(range));
+            }
+            src = bind_source(fd, family);
+        }
+
+        int rc = connect(fd, reinterpret_cast<const sockaddr*>(&addr.addr), addr.len);
+        if (rc == 0 || errno == EINPROGRESS) {
+            connected = rc == 0;
+            if (src) src->connects.fetch_add(1, std::memory_order_relaxed);
+            return fd;
+        }
+
+        int err = errno;
+        close(fd);
+        if (err != EADDRNOTAVAIL) return -1;
+
+        // 本地端口耗尽：计数后换下一个源地址
+        uint64_t total = _addr_not_avail.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (src) src->addr_not_avail.fetch_add(1, std::memory_order_relaxed);
+        // 只在总数为 2 的幂时打印，避免端口耗尽时刷屏
+        if ((total & (total - 1)) == 0) {
+            std::cerr << "[ERROR] Local ports exhausted (EADDRNOTAVAIL) from source " << (src ? src->name : "default")
+                      << ", total " << total << std::endl;
+        }
+    }
+    return -1;
+}
+
+int UpstreamManager::start_race(const std::string& key, const std::vector<ResolvedAddr>& addrs, ConnectRace* race) {
+    ConnectRace local;
+    ConnectRace& r = race ? *race : local;
+    int timeout;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        timeout = _opts.connect_timeout_ms;
+    }
+    r.key = key;
+    r.addrs = addrs;
+    r.next = 0;
+    r.fds.clear();
+    r.deadline = Clock::now() + std::chrono::milliseconds(timeout);
+
+    bool connected = false;
+    int fd = race_next(r, connected);
+    if (fd == -1) return -1;
+    // 立即连上或只有一个候选时不必竞速，握手交给调用方的事件循环完成
+    if (connected || r.next == r.addrs.size()) {
+        race_won(r, fd);
+        return fd;
+    }
+    return race ? -1 : wait_race(r);
+}
+
+int UpstreamManager::race_next(ConnectRace& race) {
+    bool connected = false;
+    return race_next(race, connected);
+}
+
+int UpstreamManager::race_next(ConnectRace& race, bool& connected) {
+    int attempt_delay, port_min, port_max;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        attempt_delay = _opts.attempt_delay_ms;
+        port_min = _opts.source_port_min;
+        port_max = _opts.source_port_max;
+    }
+
+    // 立即失败的地址直接跳过
+    while (race.next < race.addrs.size()) {
+        int fd = open_connection(race.addrs[race.next++], port_min, port_max, connected);
+        if (fd == -1) continue;
+        race.fds.push_back(fd);
+        race.next_at = race.next < race.addrs.size() ? Clock::now() + std::chrono::milliseconds(attempt_delay)
+                                                     : Clock::time_point::max();
+        return fd;
+    }
+    race.next_at = Clock::time_point::max();
+    return -1;
+}
+
+void UpstreamManager::race_won(ConnectRace& race, int fd) {
+    race.fds.erase(std::remove(race.fds.begin(), race.fds.end(), fd), race.fds.end());
+    if (race.key.empty()) return;
+    std::lock_guard<std::mutex> lock(_mutex);
+    _active_connections[fd] = ConnInfo{race.key, Clock::now()};
+}
+
+int UpstreamManager::wait_race(ConnectRace& race) {
+    std::vector<pollfd> pending;
+    int winner = -1;
+    while (winner == -1 && !race.fds.empty()) {
+        auto now = Clock::now();
+        if (now >= race.deadline) break;
+        // 到了追加时刻就让下一个地址参与竞速
+        if (now >= race.next_at) race_next(race);
+
+        pending.clear();
+        for (int fd : race.fds) pending.push_back(pollfd{fd, POLLOUT, 0});
+        auto until = std::min(race.deadline, race.next_at);
+        int wait = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(until - now).count()) + 1;
+        int n = poll(pending.data(), pending.size(), wait);
+        if (n < 0 && errno != EINTR) break;
+
+        for (auto& p : pending) {
+            if (!p.revents) continue;
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (winner == -1 && getsockopt(p.fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+                winner = p.fd;
                 continue;
             }
+            close(p.fd);
+            race.fds.erase(std::find(race.fds.begin(), race.fds.end(), p.fd));
         }
-        break; // 连接立即成功
+        // 失败的地址立即由下一个地址补位，不必等满间隔
+        if (winner == -1 && race.fds.empty()) race_next(race);
     }
 
-    freeaddrinfo(res);
+    if (winner != -1) race_won(race, winner);
+    for (int fd : race.fds) close(fd);
+    race.fds.clear();
+    return winner;
+}
+
+bool UpstreamManager::expired(const ConnInfo& info, Clock::time_point now) const {
+    return _opts.max_lifetime_ms > 0 &&
+           now - info.created >= std::chrono::milliseconds(_opts.max_lifetime_ms);
+}
+
+// 空闲连接上不应有任何可读数据：读到 EOF 或多余字节都说明连接已不可用
+bool UpstreamManager::is_alive(int fd) {
+    char c;
+    ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+void UpstreamManager::close_locked(int fd) {
+    _active_connections.erase(fd);
+    close(fd);
+}
 
-    if (sockfd != -1) {
+void UpstreamManager::prewarm(const std::string& host, int port) {
+    size_t count;
+    {
         std::lock_guard<std::mutex> lock(_mutex);
-        _active_connections[sockfd] = host + ":" + std::to_string(port);
+        count = _opts.prewarm;
     }
-    return sockfd;
+
+    size_t ready = 0;
+    for (size_t i = 0; i < count; ++i) {
+        int fd = connect_to_upstream(host, port, nullptr);
+        if (fd < 0) break;
+
+        // 启动阶段允许阻塞等待握手完成，确保放进池里的都是已建立的连接
+        pollfd pfd{fd, POLLOUT, 0};
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (poll(&pfd, 1, 1000) != 1 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            close_locked(fd);
+            break;
+        }
+        release(fd, true);
+        ++ready;
+    }
+    std::cout << "[INIT] Prewarmed " << ready << "/" << count << " upstream connections to " << host << ":" << port << std::endl;
+}
+
+int UpstreamManager::acquire(const std::string& host, int port, ConnectRace* race) {
+    std::string key = host + ":" + std::to_string(port);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _idle.find(key);
+        if (it != _idle.end()) {
+            auto now = Clock::now();
+            auto& idle = it->second;
+            // 后进先出：最近归还的连接最可能仍然存活
+            while (!idle.empty()) {
+                int fd = idle.back();
+                idle.pop_back();
+                auto info = _active_connections.find(fd);
+                if (info == _active_connections.end() || expired(info->second, now) || !is_alive(fd)) {
+                    close_locked(fd);
+                    continue;
+                }
+                return fd;
+            }
+        }
+    }
+    return connect_to_upstream(host, port, race);
+}
+
+void UpstreamManager::release(int fd, bool reusable) {
+    if (fd < 0) return;
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _active_connections.find(fd);
+    if (it == _active_connections.end()) {
+        close(fd);
+        return;
+    }
+
+    auto now = Clock::now();
+    auto& idle = _idle[it->second.key];
+    // 顺带淘汰队首（最旧的）已过期连接
+    while (!idle.empty() && expired(_active_connections[idle.front()], now)) {
+        close_locked(idle.front());
+        idle.pop_front();
+    }
+
+    if (!reusable || idle.size() >= _opts.max_idle || expired(it->second, now)) {
+        close_locked(fd);
+        return;
+    }
+    idle.push_back(fd);
+}
+
+int UpstreamManager::connect_tunnel(const std::vector<ResolvedAddr>& addrs, ConnectRace& race) {
+    // 隧道连接不进连接池，key 留空
+    return start_race(std::string(), addrs, &race);
 }
 
 // 外部接口：根据 URL 获取上游连接 fd
@@ -85,5 +461,5 @@ int UpstreamManager::get_upstream_fd(const std::string& url) {
     int port;
     if (!parse_url(url, host, port)) return -1;
 
-    return connect_to_upstream(host, port);
+    return connect_to_upstream(host, port, nullptr);
 }